@@ -0,0 +1,89 @@
+/*
+  Input: [num_kmers]
+
+  Compare the throughput (labels per second) of assignBucketsGeneric,
+  the kernel specialized for n (looked up once by assignBucketsFor) and
+  assignBucketsBatch for n = 10, 11, ..., 30 (the largest n whose labels
+  fit, see BUCKET_MAX_N) on num_kmers random n-mers (default 2^20). The outputs of the three are also checked to be
+  identical.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include <time.h>
+#include <string.h>
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[]){
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 1lu<<20;
+    int reps = 5;
+
+    srand(time(0));
+
+    kmer* xs = malloc_harder(sizeof *xs * num);
+    blabel *generic, *scalar, *batch;
+
+    size_t i;
+    int n, rep, max_n = BUCKET_MAX_N(BUCKET_FUNC_OPT12);
+    double st, generic_t, scalar_t, batch_t, labels;
+    AssignBucketsFn assign;
+
+    printf("n\tgeneric(labels/s)\tfixed(labels/s)\tbatch(labels/s)"
+	   "\tfixed_speedup\tbatch_speedup\n");
+    if(max_n > ASSIGN_FIXED_MAX_N) max_n = ASSIGN_FIXED_MAX_N;
+    for(n=10; n<=max_n; n+=1){
+	for(i=0; i<num; i+=1){
+	    xs[i] = randomKMer(n);
+	}
+	generic = malloc_harder(sizeof *generic * num * n);
+	scalar = malloc_harder(sizeof *scalar * num * n);
+	batch = malloc_harder(sizeof *batch * num * n);
+
+	assign = assignBucketsFor(n);
+	generic_t = scalar_t = batch_t = 1e100;
+	for(rep=0; rep<reps; rep+=1){
+	    st = seconds();
+	    for(i=0; i<num; i+=1){
+		assignBucketsGeneric(xs[i], n, generic, i*n);
+	    }
+	    st = seconds() - st;
+	    if(st < generic_t) generic_t = st;
+
+	    st = seconds();
+	    for(i=0; i<num; i+=1){
+		assign(xs[i], n, scalar, i*n);
+	    }
+	    st = seconds() - st;
+	    if(st < scalar_t) scalar_t = st;
+
+	    st = seconds();
+	    assignBucketsBatch(xs, num, n, batch);
+	    st = seconds() - st;
+	    if(st < batch_t) batch_t = st;
+	}
+
+	if(memcmp(generic, scalar, sizeof *scalar * num * n)){
+	    fprintf(stderr, "n=%d: the kernel for n differs from assignBucketsGeneric\n", n);
+	    return 1;
+	}
+	if(memcmp(generic, batch, sizeof *scalar * num * n)){
+	    fprintf(stderr, "n=%d: assignBucketsBatch differs from assignBucketsGeneric\n", n);
+	    return 1;
+	}
+
+	labels = (double) num * n;
+	printf("%d\t%.3e\t%.3e\t%.3e\t%.2fx\t%.2fx\n", n, labels/generic_t,
+	       labels/scalar_t, labels/batch_t, generic_t/scalar_t, generic_t/batch_t);
+	free(generic);
+	free(scalar);
+	free(batch);
+    }
+
+    free(xs);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+  A small harness shared by the benchmarks: a kernel is run on a range
+  of inputs split into chunks, each chunk is timed on its own, and the
+  median and 99th percentile of the time per operation over all chunks
+  of all repetitions are reported (after warm-up repetitions that are
+  not timed). Results are written as CSV rows.
+*/
+
+#ifndef _BENCH_H
+#define _BENCH_H 1
+
+#include "util.h"
+#include <time.h>
+#include <string.h>
+
+//ops per timed chunk, large enough to hide the cost of the clock
+#define BENCH_CHUNK 64
+
+typedef struct {
+    double median_ns; //per op
+    double p99_ns;
+    double ops_per_s; //from the total time of the timed repetitions
+} BenchStats;
+
+//results of the kernels are xor'ed into bench_sink so they are not optimized away
+static volatile long unsigned bench_sink;
+
+static inline void benchSink(long unsigned x){
+    bench_sink ^= x;
+}
+
+static inline double benchSeconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline int benchCmpDouble(const void* a, const void* b){
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : (x > y);
+}
+
+/*
+  Run fn(arg, from, to) over [0, ops) in chunks of BENCH_CHUNK ops,
+  warmup times untimed then reps times timed, and fill st.
+*/
+static inline void benchMeasure(void (*fn)(void*, size_t, size_t), void* arg,
+				size_t ops, int warmup, int reps, BenchStats* st){
+    size_t chunks = (ops + BENCH_CHUNK - 1) / BENCH_CHUNK, i, c, num = 0, to;
+    double* samples = malloc_harder(sizeof *samples * chunks * reps);
+    double t0, total = 0;
+    int rep;
+    for(rep=0; rep<warmup; rep+=1) fn(arg, 0, ops);
+    for(rep=0; rep<reps; rep+=1){
+	for(c=0, i=0; c<chunks; c+=1, i=to){
+	    to = i + BENCH_CHUNK < ops ? i + BENCH_CHUNK : ops;
+	    t0 = benchSeconds();
+	    fn(arg, i, to);
+	    t0 = benchSeconds() - t0;
+	    total += t0;
+	    samples[num++] = t0 * 1e9 / (to - i);
+	}
+    }
+    qsort(samples, num, sizeof *samples, benchCmpDouble);
+    st->median_ns = samples[num/2];
+    st->p99_ns = samples[(size_t) (num * 0.99) < num ? (size_t) (num * 0.99) : num-1];
+    st->ops_per_s = total > 0 ? ops * reps / total : 0;
+    free(samples);
+}
+
+#define BENCH_CSV_HEADER "label,kernel,k,ops,reps,median_ns,p99_ns,ops_per_s\n"
+
+static inline void benchCSVRow(FILE* fout, const char* label, const char* kernel,
+			       int k, size_t ops, int reps, const BenchStats* st){
+    fprintf(fout, "%s,%s,%d,%zu,%d,%.2f,%.2f,%.0f\n", label, kernel, k, ops, reps,
+	    st->median_ns, st->p99_ns, st->ops_per_s);
+}
+
+#endif // bench.h
@@ -0,0 +1,214 @@
+/*
+  Input: [len] [k]
+
+  Check that every level of simd.h supported by the CPU gives the same
+  results for the conversions of codec.h as encode and decode of util.h,
+  and compare their throughput. A random sequence of len (default 2^26)
+  bases is converted to codes, packed, unpacked, and split into all its
+  k-mers (default k=31), and back, at each level. Short sequences in
+  lower case, and with a non-base at every position, check that lower
+  case bases are encoded and that each conversion stops at a non-base.
+  Any difference is reported and the exit status is 1.
+
+  The throughput (GB of bases per second, the best of 3 runs) is printed
+  per level, after that of encode and decode of util.h: the former one
+  base at a time as in the rolling k-mers of the tools, the latter one
+  k-mer at a time.
+*/
+
+#include "util.h"
+#include "codec.h"
+#include "simd.h"
+#include "bench.h"
+
+#define REPS 3
+#define SHORT_LEN 300
+
+typedef struct {
+    size_t len;
+    int k;
+    char* str;
+    unsigned char* codes;
+    unsigned char* packed;
+    char* out;
+    kmer* kmers;
+} CodecData;
+
+typedef void (*CodecKernel)(CodecData*);
+
+static void runEncodeBases(CodecData* b){
+    benchSink(encodeBases(b->str, b->len, b->codes));
+}
+
+static void runDecodeBases(CodecData* b){
+    decodeBases(b->codes, b->len, b->out);
+}
+
+static void runPackBases(CodecData* b){
+    benchSink(packBases(b->str, b->len, b->packed));
+}
+
+static void runUnpackBases(CodecData* b){
+    unpackBases(b->packed, b->len, b->out);
+}
+
+static void runEncodeKMers(CodecData* b){
+    benchSink(encodeKMers(b->str, b->len, b->k, b->kmers));
+}
+
+//the rolling k-mers of the tools, encoding one base at a time
+static void runEncode(CodecData* b){
+    const kmer mask = KMER_MASK(b->k);
+    kmer x = encode(b->str, b->k-1);
+    size_t i;
+    for(i=b->k-1; i<b->len; i+=1){
+	x = ((x << 2) | encode(b->str+i, 1)) & mask;
+	b->kmers[i+1-b->k] = x;
+    }
+}
+
+//decode the non-overlapping k-mers
+static void runDecode(CodecData* b){
+    size_t i;
+    for(i=0; i+b->k<=b->len; i+=b->k){
+	decode(b->kmers[i], b->k, b->out+i);
+    }
+}
+
+//the best time of REPS runs, in GB of bases per second
+static double throughput(CodecKernel fn, CodecData* b){
+    double t, best_t = 1e100;
+    int rep;
+    for(rep=0; rep<REPS; rep+=1){
+	t = benchSeconds();
+	fn(b);
+	t = benchSeconds() - t;
+	if(t < best_t) best_t = t;
+    }
+    return b->len / best_t * 1e-9;
+}
+
+//the conversions of short sequences of every length, in lower case, and
+//with a non-base at every position
+static int checkShort(const char* str, int k){
+    static const char non_bases[] = "N@q-";
+    char s[SHORT_LEN], out[SHORT_LEN];
+    unsigned char codes[SHORT_LEN], packed[SHORT_LEN/4 + 1];
+    kmer kmers[SHORT_LEN];
+    size_t len, p, i;
+    for(len=0; len<=SHORT_LEN; len+=1){
+	if(encodeBases(str, len, codes) != len || packBases(str, len, packed) != len
+	   || encodeKMers(str, len, k, kmers) != len) return 0;
+	decodeBases(codes, len, out);
+	if(memcmp(out, str, len)) return 0;
+	unpackBases(packed, len, out);
+	if(memcmp(out, str, len)) return 0;
+	if((len & 3) && (packed[len >> 2] & ((1 << ((4 - (len & 3)) << 1)) - 1))) return 0;
+	for(i=0; i+k<=len; i+=1){
+	    if(kmers[i] != encode(str+i, k)) return 0;
+	}
+    }
+    for(i=0; i<SHORT_LEN; i+=1) s[i] = str[i] | 0x20;
+    if(encodeBases(s, SHORT_LEN, codes) != SHORT_LEN
+       || encodeKMers(s, SHORT_LEN, k, kmers) != SHORT_LEN) return 0;
+    for(i=0; i<SHORT_LEN; i+=1){
+	if(codes[i] != encode(str+i, 1) || (i+k <= SHORT_LEN && kmers[i] != encode(str+i, k))){
+	    return 0;
+	}
+    }
+    for(p=0; p<SHORT_LEN; p+=1){
+	memcpy(s, str, SHORT_LEN);
+	s[p] = non_bases[p & 3];
+	if(encodeBases(s, SHORT_LEN, codes) != p || packBases(s, SHORT_LEN, packed) != p
+	   || encodeKMers(s, SHORT_LEN, k, kmers) != p) return 0;
+	unpackBases(packed, p, out);
+	if(memcmp(out, str, p)) return 0;
+	for(i=0; i+k<=p; i+=1){
+	    if(kmers[i] != encode(str+i, k)) return 0;
+	}
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[]){
+    size_t len = argc > 1 ? strtoul(argv[1], NULL, 10) : 1lu<<26;
+    int k = argc > 2 ? atoi(argv[2]) : 31;
+    if(len < SHORT_LEN || k < 1 || k > KMER_MAX_K){
+	printf("usage: bench-codec.out [len] [k], len >= %d, k <= %d\n", SHORT_LEN, KMER_MAX_K);
+	return 1;
+    }
+    srand(time(0));
+
+    static const char bases[] = "ACGT";
+    CodecData b = {len, k};
+    char* str = malloc_harder(len);
+    unsigned char* ref_codes = malloc_harder(len);
+    kmer* ref_kmers = malloc_harder(sizeof *ref_kmers * len);
+    size_t i;
+    for(i=0; i<len; i+=1){
+	str[i] = bases[rand() & 3];
+	ref_codes[i] = encode(str+i, 1);
+    }
+    b.str = str;
+    b.codes = malloc_harder(len);
+    b.packed = malloc_harder(len/4 + 1);
+    b.out = malloc_harder(len);
+    b.kmers = ref_kmers;
+    memset(b.out, 0, len);
+
+    int level, best = simdDetect(), bound, failed = 0, same;
+    SimdLevel startup = simdLevel();
+    double enc_rate = throughput(runEncode, &b), dec_rate = throughput(runDecode, &b);
+    b.kmers = malloc_harder(sizeof *b.kmers * len);
+    memset(b.codes, 0, len);
+    memset(b.packed, 0, len/4 + 1);
+    memset(b.kmers, 0, sizeof *b.kmers * len);
+
+    printf("len=%zu, k=%d, CPU level: %s, bound at startup: %s\n",
+	   len, k, simdLevelName(best), simdLevelName(startup));
+    printf("util.h encode: %.3f GB/s, decode: %.3f GB/s\n", enc_rate, dec_rate);
+    printf("level\tencodeBases(GB/s)\tdecodeBases(GB/s)\tpackBases(GB/s)"
+	   "\tunpackBases(GB/s)\tencodeKMers(GB/s)\tidentical\n");
+    for(level=SIMD_SCALAR; level<=best; level+=1){
+	bound = simdSetLevel(level);
+	same = checkShort(str, k);
+	if(!same) fprintf(stderr, "%s: the short sequences differ\n", simdLevelName(bound));
+
+	printf("%s\t%.3f", simdLevelName(bound), throughput(runEncodeBases, &b));
+	if(encodeBases(str, len, b.codes) != len || memcmp(b.codes, ref_codes, len)){
+	    fprintf(stderr, "%s: encodeBases differs\n", simdLevelName(bound));
+	    same = 0;
+	}
+	printf("\t%.3f", throughput(runDecodeBases, &b));
+	if(memcmp(b.out, str, len)){
+	    fprintf(stderr, "%s: decodeBases differs\n", simdLevelName(bound));
+	    same = 0;
+	}
+	memset(b.out, 0, len);
+	printf("\t%.3f", throughput(runPackBases, &b));
+	printf("\t%.3f", throughput(runUnpackBases, &b));
+	if(packBases(str, len, b.packed) != len || memcmp(b.out, str, len)){
+	    fprintf(stderr, "%s: packBases or unpackBases differs\n", simdLevelName(bound));
+	    same = 0;
+	}
+	memset(b.out, 0, len);
+	printf("\t%.3f", throughput(runEncodeKMers, &b));
+	if(memcmp(b.kmers, ref_kmers, sizeof *b.kmers * (len-k+1))){
+	    fprintf(stderr, "%s: encodeKMers differs\n", simdLevelName(bound));
+	    same = 0;
+	}
+	memset(b.kmers, 0, sizeof *b.kmers * len);
+	printf("\t%s\n", same ? "yes" : "no");
+	failed |= !same;
+    }
+    simdSetLevel(startup);
+
+    free(str);
+    free(ref_codes);
+    free(ref_kmers);
+    free(b.codes);
+    free(b.packed);
+    free(b.out);
+    free(b.kmers);
+    return failed;
+}
@@ -0,0 +1,175 @@
+/*
+  Input: [k]
+
+  Compare HashTable and GroupHashTable on sets of k-mers (default k=16):
+  - random: uniformly random k-mers;
+  - neighbors: the k-mers within 2 substitutions of random k-mers, as in
+    the neighborhoods built by LSB-statistics;
+  - aligned: i << 2*(k/2), whose low bits are all 0.
+  For each set, print the time per insertion, per successful search and
+  per unsuccessful search, and the probe lengths (slots for HashTable,
+  groups for GroupHashTable). The tables are checked to hold the same
+  k-mers, and GroupHashTable is checked after deleting half of them.
+*/
+
+#include "util.h"
+#include "HashTable.h"
+#include "GroupHashTable.h"
+#include <time.h>
+#include <string.h>
+
+#define NUM_KMERS (1lu<<20)
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//the slots checked by a successful search in table
+static void HTableProbeStats(const HashTable* table, double* avg, size_t* max){
+    size_t i, probes, total = 0;
+    *max = 0;
+    for(i=0; i<table->size; i+=1){
+	if(table->arr[i] == 0) continue;
+	probes = (i + table->size - (table->arr[i]-1) % table->size) % table->size + 1;
+	total += probes;
+	if(probes > *max) *max = probes;
+    }
+    *avg = table->used ? (double) total / table->used : 0;
+}
+
+//distinct k-mers within 2 substitutions of random centers
+static size_t neighborKMers(kmer* xs, size_t num, int k){
+    size_t used = 0;
+    int i, j, a, b;
+    kmer c, y;
+    GroupHashTable seen;
+    GHTableInit(&seen);
+    while(used < num){
+	c = randomKMer(k);
+	for(i=0; i<k && used<num; i+=1){
+	    for(a=0; a<4 && used<num; a+=1){
+		for(j=i; j<k && used<num; j+=1){
+		    for(b=0; b<4 && used<num; b+=1){
+			y = (c & ~((kmer) 3 << (i<<1))) | ((kmer) a << (i<<1));
+			y = (y & ~((kmer) 3 << (j<<1))) | ((kmer) b << (j<<1));
+			if(GHTableInsert(&seen, y)) xs[used++] = y;
+		    }
+		}
+	    }
+	}
+    }
+    GHTableFree(&seen);
+    return used;
+}
+
+static void run(const char* name, const kmer* xs, const kmer* misses,
+		size_t num){
+    HashTable ht;
+    GroupHashTable gt;
+    size_t i, found, max;
+    double st, t[6], avg;
+
+    HTableInit(&ht);
+    st = seconds();
+    for(i=0; i<num; i+=1) HTableInsert(&ht, xs[i]);
+    t[0] = seconds() - st;
+    st = seconds();
+    for(i=0, found=0; i<num; i+=1) found += HTableSearch(&ht, xs[i]);
+    t[1] = seconds() - st;
+    st = seconds();
+    for(i=0; i<num; i+=1) found += HTableSearch(&ht, misses[i]);
+    t[2] = seconds() - st;
+    if(found != num){
+	fprintf(stderr, "%s: HashTable found %zu of %zu\n", name, found, num);
+	exit(1);
+    }
+
+    GHTableInit(&gt);
+    st = seconds();
+    for(i=0; i<num; i+=1) GHTableInsert(&gt, xs[i]);
+    t[3] = seconds() - st;
+    st = seconds();
+    for(i=0, found=0; i<num; i+=1) found += GHTableSearch(&gt, xs[i]);
+    t[4] = seconds() - st;
+    st = seconds();
+    for(i=0; i<num; i+=1) found += GHTableSearch(&gt, misses[i]);
+    t[5] = seconds() - st;
+    if(found != num || gt.used != ht.used){
+	fprintf(stderr, "%s: GroupHashTable found %zu of %zu\n", name, found, num);
+	exit(1);
+    }
+
+    HTableProbeStats(&ht, &avg, &max);
+    printf("%s\tHashTable\t%.1f\t%.1f\t%.1f\t%.2f\t%zu\n", name,
+	   t[0]*1e9/num, t[1]*1e9/num, t[2]*1e9/num, avg, max);
+    GHTableProbeStats(&gt, &avg, &max);
+    printf("%s\tGroupHashTable\t%.1f\t%.1f\t%.1f\t%.2f\t%zu\n", name,
+	   t[3]*1e9/num, t[4]*1e9/num, t[5]*1e9/num, avg, max);
+
+    for(i=0; i<num; i+=2){
+	if(!GHTableDelete(&gt, xs[i])){
+	    fprintf(stderr, "%s: cannot delete a k-mer\n", name);
+	    exit(1);
+	}
+    }
+    for(i=0; i<num; i+=1){
+	if(GHTableSearch(&gt, xs[i]) != (i & 1)){
+	    fprintf(stderr, "%s: wrong search after deletion\n", name);
+	    exit(1);
+	}
+    }
+
+    HTableFree(&ht);
+    GHTableFree(&gt);
+}
+
+int main(int argc, char* argv[]){
+    int k = argc > 1 ? atoi(argv[1]) : 16;
+    if(k < 8 || k >= KMER_MAX_K){
+	printf("usage: bench-hashTable.out [k], 8 <= k < %d\n", KMER_MAX_K);
+	return 1;
+    }
+    srand(time(0));
+
+    kmer* xs = malloc_harder(sizeof *xs * NUM_KMERS);
+    kmer* misses = malloc_harder(sizeof *misses * NUM_KMERS);
+    GroupHashTable all;
+    size_t i, num;
+
+    printf("keys\ttable\tinsert(ns)\thit(ns)\tmiss(ns)\tavg_probes\tmax_probes\n");
+
+    //random k-mers, the misses are random k-mers not in the set
+    GHTableInitSize(&all, NUM_KMERS << 1);
+    for(num=0; num<NUM_KMERS; ){
+	xs[num] = randomKMer(k);
+	if(GHTableInsert(&all, xs[num])) num += 1;
+    }
+    for(i=0; i<NUM_KMERS; ){
+	misses[i] = randomKMer(k);
+	if(!GHTableSearch(&all, misses[i])) i += 1;
+    }
+    run("random", xs, misses, num);
+    GHTableFree(&all);
+
+    num = neighborKMers(xs, NUM_KMERS, k);
+    GHTableInitSize(&all, num);
+    for(i=0; i<num; i+=1) GHTableInsert(&all, xs[i]);
+    for(i=0; i<num; ){
+	misses[i] = randomKMer(k);
+	if(!GHTableSearch(&all, misses[i])) i += 1;
+    }
+    run("neighbors", xs, misses, num);
+    GHTableFree(&all);
+
+    for(i=0; i<NUM_KMERS; i+=1){
+	xs[i] = (kmer) i << ((k>>1)<<1);
+	misses[i] = xs[i] | 1;
+    }
+    run("aligned", xs, misses, NUM_KMERS);
+
+    free(xs);
+    free(misses);
+    return 0;
+}
@@ -0,0 +1,298 @@
+/*
+  Input: [-r reps] [-o csv_file] [-l label] [-s scale]
+
+  Microbenchmarks of the core kernels for k = 10, 15, 20, 25, 31 (and
+  40, 50, 63 with KMER_BITS=128): the edit distances, encode/decode,
+  isInSampleD1, isSubsequence, isSubstring, assignBuckets, randomEdit,
+  bfsNeighborsInSampleRadius with r = 1, 2, HTableInsert/HTableSearch
+  and AVLAdd/AVLSearch. Each kernel runs on precomputed random inputs,
+  2 warm-up repetitions and reps (default 10) timed ones (see bench.h);
+  the median and p99 time per op over all timed chunks and the ops per
+  second are written as CSV to stdout or appended to csv_file (with a
+  header if it is new). The label (e.g. a commit id) is the first column
+  so that the rows of several commits can be kept in one file. scale
+  (default 1) multiplies the number of ops of every kernel.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "HashTable.h"
+#include "AVLTree.h"
+#include "Neighborhood.h"
+#include "bench.h"
+#include <getopt.h>
+
+#define WARMUP 2
+#define NUM_OPS (1<<16)
+#define MAX_OPS (NUM_OPS * 2)
+
+typedef struct {
+    int k;
+    size_t num; //inputs below, at least the ops of any kernel
+    kmer* xs; //random k-mers
+    kmer* ys; //random edits of xs at distance 2
+    kmer* zs; //random (k-1)-mers
+    kmer* subs; //random (k/2)-mers
+    char* strs_x; //xs and ys decoded, k+1 chars each
+    char* strs_y;
+    blabel* buckets;
+    HashTable table; //xs[0..num/2) for the searches
+    HashTable grow; //rebuilt by the inserts
+    AVLNode* tree; //same as table
+    AVLNode* grow_tree;
+    NbhdWorkspace w1, w2;
+    AVLArena arena;
+} KernelData;
+
+static int cmpKMer(const void* a, const void* b){
+    kmer x = *(const kmer*) a, y = *(const kmer*) b;
+    return x < y ? -1 : (x > y);
+}
+
+static void benchEditDist(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(editDist(b->xs[i], b->ys[i], b->k, -1));
+}
+
+static void benchEditDist2(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(editDist2(b->xs[i], b->k, b->zs[i], b->k-1, -1));
+}
+
+static void benchEditDist3(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1){
+	benchSink(editDist3(b->strs_x + i*(b->k+1), b->k, b->strs_y + i*(b->k+1), b->k, -1));
+    }
+}
+
+static void benchEncode(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(encode(b->strs_x + i*(b->k+1), b->k));
+}
+
+static void benchDecode(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    char buf[b->k+1];
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(decode(b->xs[i], b->k, buf)[0]);
+}
+
+static void benchIsInSampleD1(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(isInSampleD1(b->xs[i], b->k));
+}
+
+static void benchIsSubsequence(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(isSubsequence(b->subs[i], b->k/2, b->xs[i], b->k));
+}
+
+static void benchIsSubstring(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(isSubstring(b->subs[i], b->k/2, b->xs[i], b->k));
+}
+
+static void benchAssignBuckets(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1){
+	assignBuckets(b->xs[i], b->k, b->buckets, 0);
+	benchSink(b->buckets[0]);
+    }
+}
+
+static void benchRandomEdit(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(randomEdit(b->xs[i], b->k, 2));
+}
+
+static void benchBfs(KernelData* b, NbhdWorkspace* w, size_t from, size_t to){
+    size_t i;
+    for(i=from; i<to; i+=1){
+	benchSink(AVLKMERSIZE(bfsNeighborsInSampleRadius(w, &b->arena, b->xs[i], 1)));
+	AVLArenaReset(&b->arena);
+    }
+}
+
+static void benchBfs1(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    benchBfs(b, &b->w1, from, to);
+}
+
+static void benchBfs2(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    benchBfs(b, &b->w2, from, to);
+}
+
+static void benchHTableInsert(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    if(from == 0){
+	HTableFree(&b->grow);
+	HTableInit(&b->grow);
+    }
+    for(i=from; i<to; i+=1) HTableInsert(&b->grow, b->xs[i]);
+}
+
+//half of the searched k-mers are in the table
+static void benchHTableSearch(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1) benchSink(HTableSearch(&b->table, b->xs[i + (i&1)*b->num/2]));
+}
+
+static void benchAVLAdd(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    if(from == 0){
+	AVLFreeTree(b->grow_tree, NULL);
+	b->grow_tree = NULL;
+    }
+    for(i=from; i<to; i+=1) b->grow_tree = AVLAdd(b->grow_tree, b->xs+i, cmpKMer);
+}
+
+static void benchAVLSearch(void* arg, size_t from, size_t to){
+    KernelData* b = arg;
+    size_t i;
+    for(i=from; i<to; i+=1){
+	benchSink(AVLSearch(b->tree, b->xs + i + (i&1)*b->num/2, cmpKMer) != NULL);
+    }
+}
+
+typedef struct {
+    const char* name;
+    void (*fn)(void*, size_t, size_t);
+    size_t ops; //per repetition, before scaling
+} Kernel;
+
+static const Kernel kernels[] = {
+    {"editDist", benchEditDist, NUM_OPS},
+    {"editDist2", benchEditDist2, NUM_OPS},
+    {"editDist3", benchEditDist3, NUM_OPS},
+    {"encode", benchEncode, NUM_OPS},
+    {"decode", benchDecode, NUM_OPS},
+    {"isInSampleD1", benchIsInSampleD1, NUM_OPS},
+    {"isSubsequence", benchIsSubsequence, NUM_OPS},
+    {"isSubstring", benchIsSubstring, NUM_OPS},
+    {"assignBuckets", benchAssignBuckets, NUM_OPS},
+    {"randomEdit", benchRandomEdit, NUM_OPS},
+    {"bfsNeighborsInSampleRadius_r1", benchBfs1, NUM_OPS/16},
+    {"bfsNeighborsInSampleRadius_r2", benchBfs2, NUM_OPS/256},
+    {"HTableInsert", benchHTableInsert, NUM_OPS},
+    {"HTableSearch", benchHTableSearch, NUM_OPS},
+    {"AVLAdd", benchAVLAdd, NUM_OPS},
+    {"AVLSearch", benchAVLSearch, NUM_OPS}
+};
+
+static void kernelDataInit(KernelData* b, int k, size_t num){
+    size_t i;
+    b->k = k;
+    b->num = num;
+    b->xs = malloc_harder(sizeof *b->xs * num);
+    b->ys = malloc_harder(sizeof *b->ys * num);
+    b->zs = malloc_harder(sizeof *b->zs * num);
+    b->subs = malloc_harder(sizeof *b->subs * num);
+    b->strs_x = malloc_harder(num * (k+1));
+    b->strs_y = malloc_harder(num * (k+1));
+    b->buckets = malloc_harder(sizeof *b->buckets * k);
+    for(i=0; i<num; i+=1){
+	b->xs[i] = randomKMer(k);
+	b->ys[i] = randomEdit(b->xs[i], k, 2);
+	b->zs[i] = randomKMer(k-1);
+	b->subs[i] = randomKMer(k/2);
+	decode(b->xs[i], k, b->strs_x + i*(k+1));
+	decode(b->ys[i], k, b->strs_y + i*(k+1));
+	b->strs_x[i*(k+1)+k] = b->strs_y[i*(k+1)+k] = '\0';
+    }
+    HTableInit(&b->table);
+    HTableInit(&b->grow);
+    b->tree = b->grow_tree = NULL;
+    for(i=0; i<num/2; i+=1){
+	HTableInsert(&b->table, b->xs[i]);
+	b->tree = AVLAdd(b->tree, b->xs+i, cmpKMer);
+    }
+    NbhdInit(&b->w1, k, 1);
+    NbhdInit(&b->w2, k, 2);
+    AVLArenaInit(&b->arena);
+}
+
+static void kernelDataFree(KernelData* b){
+    free(b->xs);
+    free(b->ys);
+    free(b->zs);
+    free(b->subs);
+    free(b->strs_x);
+    free(b->strs_y);
+    free(b->buckets);
+    HTableFree(&b->table);
+    HTableFree(&b->grow);
+    AVLFreeTree(b->tree, NULL);
+    AVLFreeTree(b->grow_tree, NULL);
+    NbhdFree(&b->w1);
+    NbhdFree(&b->w2);
+    AVLArenaFree(&b->arena);
+}
+
+int main(int argc, char* argv[]){
+    int reps = 10, opt;
+    double scale = 1;
+    const char* csv = NULL;
+    const char* label = "-";
+    while((opt = getopt(argc, argv, "r:o:l:s:")) != -1){
+	switch(opt){
+	case 'r': reps = atoi(optarg); break;
+	case 'o': csv = optarg; break;
+	case 'l': label = optarg; break;
+	case 's': scale = atof(optarg); break;
+	default: reps = 0;
+	}
+    }
+    if(reps < 1 || scale <= 0 || optind != argc){
+	printf("usage: bench-kernels.out [-r reps] [-o csv_file] [-l label] [-s scale]\n");
+	return 1;
+    }
+    srand(time(0));
+
+    FILE* fout = stdout;
+    if(csv){
+	fout = fopen(csv, "a");
+	if(fout == NULL){
+	    fprintf(stderr, "Cannot open %s\n", csv);
+	    return 1;
+	}
+    }
+    if(ftell(fout) <= 0) fprintf(fout, BENCH_CSV_HEADER);
+
+#if KMER_BITS == 128
+    static const int ks[] = {10, 15, 20, 25, 31, 40, 50, 63};
+#else
+    static const int ks[] = {10, 15, 20, 25, 31};
+#endif
+    size_t num = MAX_OPS * scale, ops;
+    int i, j;
+    KernelData b;
+    BenchStats st;
+    for(i=0; i<(int) (sizeof ks / sizeof *ks); i+=1){
+	kernelDataInit(&b, ks[i], num);
+	for(j=0; j<(int) (sizeof kernels / sizeof *kernels); j+=1){
+	    ops = kernels[j].ops * scale;
+	    if(ops < 1) ops = 1;
+	    benchMeasure(kernels[j].fn, &b, ops, WARMUP, reps, &st);
+	    benchCSVRow(fout, label, kernels[j].name, ks[i], ops, reps, &st);
+	    fflush(fout);
+	}
+	kernelDataFree(&b);
+    }
+
+    if(fout != stdout) fclose(fout);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+  Input: [num] [k]
+
+  Compare KVecSort with qsort on num (default 10^7) random k-mers
+  (default k=31), check that the results are identical and report the
+  number of distinct k-mers found by KVecUnique.
+*/
+
+#include "util.h"
+#include "KmerVec.h"
+#include <time.h>
+#include <string.h>
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmpKMer(const void* a, const void* b){
+    kmer x = *(const kmer*) a, y = *(const kmer*) b;
+    return x < y ? -1 : (x > y);
+}
+
+int main(int argc, char* argv[]){
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    int k = argc > 2 ? atoi(argv[2]) : 31;
+    if(k < 1 || k >= KMER_MAX_K){
+	printf("usage: bench-kmerVec.out [num] [k], 1 <= k < %d\n", KMER_MAX_K);
+	return 1;
+    }
+    srand(time(0));
+
+    KmerVec v;
+    KVecInitSize(&v, num);
+    size_t i;
+    for(i=0; i<num; i+=1){
+	KVecPush(&v, randomKMer(k));
+    }
+    kmer* copy = malloc_harder(sizeof *copy * num);
+    memcpy(copy, v.arr, sizeof *copy * num);
+
+    double st = seconds(), radix_t, qsort_t;
+    KVecSort(&v);
+    radix_t = seconds() - st;
+
+    st = seconds();
+    qsort(copy, num, sizeof *copy, cmpKMer);
+    qsort_t = seconds() - st;
+
+    if(memcmp(copy, v.arr, sizeof *copy * num)){
+	fprintf(stderr, "KVecSort differs from qsort\n");
+	return 1;
+    }
+    size_t distinct = KVecUnique(&v);
+
+    printf("num\tk\tKVecSort(s)\tqsort(s)\tspeedup\tdistinct\n");
+    printf("%zu\t%d\t%.3f\t%.3f\t%.1fx\t%zu\n", num, k, radix_t, qsort_t,
+	   qsort_t / radix_t, distinct);
+
+    free(copy);
+    KVecFree(&v);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+  Input: [k] [r] [max_threads] [reps]
+
+  Expand the radius-r neighborhoods (default k=25, r=3) of reps (default 3)
+  random k-mers with bfsNeighborsInSampleRadius using 1, 2, 4, ...,
+  max_threads (default: number of cores) threads. Check that every
+  thread count gives the same set of k-mers as the sequential expansion
+  and print the time and speedup of each, and the CPU time of all the
+  threads (cpu/time is the average number of busy threads, so with as
+  many cores as threads, time*threads - cpu is the time lost to the
+  parts run by one thread and to waiting at the barriers).
+*/
+
+#include "util.h"
+#include "AVLTree.h"
+#include "Neighborhood.h"
+#include <time.h>
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//CPU time of all the threads of the process
+static double cpuSeconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//write the keys of the tree in order to out, return the number written
+static size_t inorder(const AVLKmerNode* root, kmer* out){
+    if(root == NULL) return 0;
+    size_t num = inorder(root->left, out);
+    out[num++] = root->key;
+    return num + inorder(root->right, out + num);
+}
+
+int main(int argc, char* argv[]){
+    int k = argc > 1 ? atoi(argv[1]) : 25;
+    int r = argc > 2 ? atoi(argv[2]) : 3;
+    int max_threads = argc > 3 ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+    int reps = argc > 4 ? atoi(argv[4]) : 3;
+    if(k < 2 || k >= KMER_MAX_K || r < 1 || max_threads < 1 || reps < 1){
+	printf("usage: bench-neighborhood.out [k] [r] [max_threads] [reps]\n");
+	return 1;
+    }
+    srand(time(0));
+
+    kmer centers[reps];
+    int i, threads;
+    for(i=0; i<reps; i+=1) centers[i] = randomKMer(k);
+
+    NbhdWorkspace w;
+    NbhdInit(&w, k, r);
+    AVLArena arena;
+    AVLArenaInit(&arena);
+    kmer* expected[reps];
+    size_t expected_size[reps], num;
+    double st, cpu_st, t, cpu, t1 = 0;
+    AVLKmerNode* hs;
+
+    printf("threads\tnodes\ttime(s)\tspeedup\tcpu(s)\n");
+    for(threads=1; threads<=max_threads; threads<<=1){
+	NbhdSetThreads(&w, threads);
+	t = cpu = 0;
+	num = 0;
+	for(i=0; i<reps; i+=1){
+	    st = seconds();
+	    cpu_st = cpuSeconds();
+	    hs = bfsNeighborsInSampleRadius(&w, &arena, centers[i], 0);
+	    t += seconds() - st;
+	    cpu += cpuSeconds() - cpu_st;
+
+	    if(threads == 1){
+		expected[i] = malloc_harder(sizeof(kmer) * (AVLKMERSIZE(hs)+1));
+		expected_size[i] = inorder(hs, expected[i]);
+	    }else{
+		kmer* got = malloc_harder(sizeof(kmer) * (AVLKMERSIZE(hs)+1));
+		size_t got_size = inorder(hs, got), j;
+		for(j=0; j<got_size && j<expected_size[i]; j+=1){
+		    if(got[j] != expected[i][j]) break;
+		}
+		if(got_size != expected_size[i] || j < got_size){
+		    fprintf(stderr, "%d threads: the neighborhood differs\n", threads);
+		    return 1;
+		}
+		free(got);
+	    }
+	    num += AVLKMERSIZE(hs);
+	    AVLArenaReset(&arena);
+	}
+	if(threads == 1) t1 = t;
+	printf("%d\t%zu\t%.3f\t%.2f\t%.3f\n", threads, num, t, t1 / t, cpu);
+    }
+
+    for(i=0; i<reps; i+=1) free(expected[i]);
+    NbhdFree(&w);
+    AVLArenaFree(&arena);
+    return 0;
+}
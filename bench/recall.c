@@ -0,0 +1,303 @@
+/*
+  Input: [-n n] [-b background] [-p planted] [-d max_d] [-s sample] [-t threads]
+
+  End-to-end benchmark of the bucket-and-verify pipeline (selfJoinKMers)
+  on synthetic data with known answers. background (default 10^6) random
+  n-mers (default n=20, at most 30 for the (1,2)-sensitive function) are
+  mixed with, for each e = 1, ..., max_d+1, planted (default 10^4) pairs
+  (s, randomEdit(s, n, e)) of fresh random n-mers s. The pipeline is
+  then run with the threshold max_d (default 2) for the (1,2)-sensitive
+  function (assignBuckets) and the (1,3)-sensitive function labeled by
+  the (1,1)-guaranteed sample, each in its own child process so that its
+  peak RSS is its own.
+
+  The ground truth is every pair within max_d of one of sample (default
+  1000) random n-mers of the whole set, found by brute force (editDist2
+  against all n-mers, skipping those whose counts of 2-mers differ by
+  more than 4*max_d), so it includes the pairs of background n-mers, not
+  only the planted ones.
+
+  For each function, print the candidates (distinct pairs sharing a
+  bucket), the reported pairs, the throughput, the peak RSS, the recall
+  of the ground truth at each distance e <= max_d, the recall of the
+  planted pairs at each distance e <= max_d, the planted pairs at
+  distance max_d+1 that were reported (always 0, they are filtered by
+  the verification), and the precision of the candidates: the fraction
+  of the candidates that are within max_d, i.e. worth verifying.
+*/
+
+#include "util.h"
+#include "SelfJoin.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+//pair i of the planted ones is xs[background + 2i], xs[background + 2i + 1]
+typedef struct {
+    int n, max_d;
+    size_t background;
+    size_t planted; //pairs per distance
+    size_t num; //background + 2 * planted * (max_d+1)
+    kmer* xs;
+} PlantedSet;
+
+static void plantedSetInit(PlantedSet* ps, int n, size_t background,
+			   size_t planted, int max_d){
+    size_t i, j;
+    int e;
+    ps->n = n;
+    ps->max_d = max_d;
+    ps->background = background;
+    ps->planted = planted;
+    ps->num = background + 2 * planted * (max_d+1);
+    ps->xs = malloc_harder(sizeof *ps->xs * ps->num);
+    for(i=0; i<background; i+=1) ps->xs[i] = randomKMer(n);
+    for(e=1, j=background; e<=max_d+1; e+=1){
+	for(i=0; i<planted; i+=1, j+=2){
+	    ps->xs[j] = randomKMer(n);
+	    ps->xs[j+1] = randomEdit(ps->xs[j], n, e);
+	}
+    }
+}
+
+//the planted distance of the pair (a, b), a < b, or 0 if not planted
+static int plantedDist(const PlantedSet* ps, size_t a, size_t b){
+    if(a < ps->background || ((a - ps->background) & 1) || b != a+1) return 0;
+    return (a - ps->background) / 2 / ps->planted + 1;
+}
+
+//the count of each of the 16 2-mers of an n-mer, one per byte (n < 128)
+typedef struct {
+    long unsigned w[2];
+} Profile;
+
+static void profileOf(kmer x, int n, Profile* p){
+    p->w[0] = p->w[1] = 0;
+    for(; n>1; n-=1, x>>=2) p->w[(x & 15) >> 3] += 1lu << ((x & 7) << 3);
+}
+
+#define BYTES_HIGH 0x8080808080808080lu
+#define BYTES_ONE 0x0101010101010101lu
+
+//sum of the absolute differences of the bytes (all < 128) of a and b
+static inline int sadBytes(long unsigned a, long unsigned b){
+    long unsigned u = (a | BYTES_HIGH) - b, v = (b | BYTES_HIGH) - a;
+    long unsigned ge = ((u & BYTES_HIGH) >> 7) * 0xff; //bytes with a >= b
+    return (((((u & ge) | (v & ~ge)) & ~BYTES_HIGH) * BYTES_ONE) >> 56);
+}
+
+//L1 distance of two profiles, an edit changes it by at most 4 (q-gram lemma)
+static int profileDist(const Profile* a, const Profile* b){
+    return sadBytes(a->w[0], b->w[0]) + sadBytes(a->w[1], b->w[1]);
+}
+
+//the brute force of the queries [st, ed) of a thread
+typedef struct {
+    const PlantedSet* ps;
+    const Profile* profiles;
+    const size_t* queries;
+    size_t st, ed;
+    KMerPair* pairs;
+    size_t pairs_size, pairs_used;
+} TruthWork;
+
+static void* truthWorker(void* arg){
+    TruthWork* w = arg;
+    const PlantedSet* ps = w->ps;
+    size_t i, a, b;
+    int d;
+    for(i=w->st; i<w->ed; i+=1){
+	a = w->queries[i];
+	for(b=0; b<ps->num; b+=1){
+	    if(b == a || profileDist(w->profiles+a, w->profiles+b) > 4 * ps->max_d) continue;
+	    d = editDist2(ps->xs[a], ps->n, ps->xs[b], ps->n, ps->max_d+1);
+	    if(d > ps->max_d) continue;
+	    if(w->pairs_used == w->pairs_size){
+		w->pairs_size = w->pairs_size ? w->pairs_size << 1 : 1024;
+		w->pairs = realloc_harder(w->pairs, sizeof *w->pairs * w->pairs_size);
+	    }
+	    w->pairs[w->pairs_used].a = a < b ? a : b;
+	    w->pairs[w->pairs_used].b = a < b ? b : a;
+	    w->pairs[w->pairs_used].dist = d;
+	    w->pairs_used += 1;
+	}
+    }
+    return NULL;
+}
+
+static int cmpPairs(const void* x, const void* y){
+    const KMerPair *p = x, *q = y;
+    if(p->a != q->a) return p->a < q->a ? -1 : 1;
+    return p->b < q->b ? -1 : (p->b > q->b);
+}
+
+/*
+  All the pairs within max_d of sample distinct random n-mers of ps,
+  sorted and without duplicates, in a newly allocated *truth; return
+  their number.
+*/
+static size_t groundTruth(const PlantedSet* ps, size_t sample, int threads,
+			  KMerPair** truth){
+    size_t* ids = malloc_harder(sizeof *ids * ps->num);
+    Profile* profiles = malloc_harder(sizeof *profiles * ps->num);
+    size_t i, j, tmp, num = 0;
+    for(i=0; i<ps->num; i+=1){
+	ids[i] = i;
+	profileOf(ps->xs[i], ps->n, profiles+i);
+    }
+    if(sample > ps->num) sample = ps->num;
+    for(i=0; i<sample; i+=1){
+	j = i + ((size_t) rand() * RAND_MAX + rand()) % (ps->num - i);
+	tmp = ids[i];
+	ids[i] = ids[j];
+	ids[j] = tmp;
+    }
+
+    TruthWork works[threads];
+    pthread_t tids[threads];
+    int t;
+    for(t=0; t<threads; t+=1){
+	works[t].ps = ps;
+	works[t].profiles = profiles;
+	works[t].queries = ids;
+	works[t].st = sample / threads * t;
+	works[t].ed = t == threads-1 ? sample : sample / threads * (t+1);
+	works[t].pairs = NULL;
+	works[t].pairs_size = works[t].pairs_used = 0;
+	if(t) pthread_create(tids+t, NULL, truthWorker, works+t);
+    }
+    truthWorker(works);
+    for(t=1; t<threads; t+=1) pthread_join(tids[t], NULL);
+
+    for(t=0; t<threads; t+=1) num += works[t].pairs_used;
+    *truth = malloc_harder(sizeof **truth * (num+1));
+    for(t=0, num=0; t<threads; t+=1){
+	memcpy(*truth + num, works[t].pairs, sizeof **truth * works[t].pairs_used);
+	num += works[t].pairs_used;
+	free(works[t].pairs);
+    }
+    //a pair of two sampled n-mers is found twice
+    qsort(*truth, num, sizeof **truth, cmpPairs);
+    for(i=0, j=0; i<num; i+=1){
+	if(j == 0 || cmpPairs(*truth + i, *truth + j-1)) (*truth)[j++] = (*truth)[i];
+    }
+    free(ids);
+    free(profiles);
+    return j;
+}
+
+static void runPipeline(const PlantedSet* ps, int func, int threads,
+			const KMerPair* truth, size_t num_truth){
+    KMerPair* pairs;
+    SelfJoinStats stats;
+    size_t num_pairs = selfJoinKMers(ps->xs, ps->num, ps->n, func, ps->max_d,
+				     threads, &pairs, &stats);
+
+    size_t found[ps->max_d+2], true_pairs[ps->max_d+1], true_found[ps->max_d+1], i;
+    int e;
+    for(e=0; e<=ps->max_d+1; e+=1) found[e] = 0;
+    for(i=0; i<num_pairs; i+=1){
+	found[plantedDist(ps, pairs[i].a, pairs[i].b)] += 1;
+    }
+    for(e=0; e<=ps->max_d; e+=1) true_pairs[e] = true_found[e] = 0;
+    qsort(pairs, num_pairs, sizeof *pairs, cmpPairs);
+    for(i=0; i<num_truth; i+=1){
+	true_pairs[truth[i].dist] += 1;
+	if(bsearch(truth+i, pairs, num_pairs, sizeof *pairs, cmpPairs)){
+	    true_found[truth[i].dist] += 1;
+	}
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double total = stats.bucket_time + stats.sort_time + stats.join_time;
+    printf("%s\t%zu\t%zu\t%.3f\t%.3e\t%.3e\t%.1f",
+	   func == BUCKET_FUNC_OPT12 ? "(1,2)" : "(1,3)s",
+	   stats.candidates, num_pairs, total, ps->num / total,
+	   total > 0 ? stats.candidates / total : 0.0, usage.ru_maxrss / 1024.0);
+    for(e=1; e<=ps->max_d; e+=1){
+	printf("\t%.2f%%", true_pairs[e] ? true_found[e] * 100.0 / true_pairs[e] : 100.0);
+    }
+    for(e=1; e<=ps->max_d; e+=1){
+	printf("\t%.2f%%", found[e] * 100.0 / ps->planted);
+    }
+    printf("\t%zu\t%.2f%%\n", found[ps->max_d+1],
+	   stats.candidates ? num_pairs * 100.0 / stats.candidates : 100.0);
+    fflush(stdout);
+    free(pairs);
+}
+
+int main(int argc, char* argv[]){
+    int n = 20, max_d = 2, threads = sysconf(_SC_NPROCESSORS_ONLN), opt, e;
+    size_t background = 1000000, planted = 10000, sample = 1000;
+    while((opt = getopt(argc, argv, "n:b:p:d:s:t:")) != -1){
+	switch(opt){
+	case 'n': n = atoi(optarg); break;
+	case 'b': background = strtoul(optarg, NULL, 10); break;
+	case 'p': planted = strtoul(optarg, NULL, 10); break;
+	case 'd': max_d = atoi(optarg); break;
+	case 's': sample = strtoul(optarg, NULL, 10); break;
+	case 't': threads = atoi(optarg); break;
+	default: n = 0;
+	}
+    }
+    if(n < 4 || n > BUCKET_MAX_N(BUCKET_FUNC_OPT12) || max_d < 1 || max_d+1 >= n
+       || planted < 1 || threads < 1){
+	printf("usage: bench-recall.out [-n n] [-b background] [-p planted]"
+	       " [-d max_d] [-s sample] [-t threads], 4 <= n <= %d\n",
+	       BUCKET_MAX_N(BUCKET_FUNC_OPT12));
+	return 1;
+    }
+    srand(time(0));
+
+    PlantedSet ps;
+    plantedSetInit(&ps, n, background, planted, max_d);
+    printf("n=%d, %zu n-mers (%zu background, %zu planted pairs at each"
+	   " distance 1..%d), max_d=%d, %d threads\n",
+	   n, ps.num, background, planted, max_d+1, max_d, threads);
+
+    KMerPair* truth;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double t = ts.tv_sec + ts.tv_nsec * 1e-9;
+    size_t num_truth = groundTruth(&ps, sample, threads, &truth), i, at_d;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    printf("ground truth of %zu sampled n-mers (%.1fs):", sample < ps.num ? sample : ps.num,
+	   ts.tv_sec + ts.tv_nsec * 1e-9 - t);
+    for(e=1; e<=max_d; e+=1){
+	for(i=0, at_d=0; i<num_truth; i+=1) at_d += truth[i].dist == e;
+	printf(" %zu pairs at d=%d%s", at_d, e, e < max_d ? "," : "\n");
+    }
+
+    printf("func\tcandidates\tpairs\ttime(s)\tn-mers/s\tcandidates/s\tpeakRSS(MB)");
+    for(e=1; e<=max_d; e+=1) printf("\trecall_d%d", e);
+    for(e=1; e<=max_d; e+=1) printf("\tplanted_d%d", e);
+    printf("\tfound_d%d\tprecision\n", max_d+1);
+    fflush(stdout);
+
+    int funcs[2] = {BUCKET_FUNC_OPT12, BUCKET_FUNC_SAMPLE}, status;
+    pid_t pid;
+    for(e=0; e<2; e+=1){
+	pid = fork();
+	if(pid < 0){
+	    fprintf(stderr, "Cannot fork\n");
+	    return 1;
+	}
+	if(pid == 0){
+	    runPipeline(&ps, funcs[e], threads, truth, num_truth);
+	    exit(0);
+	}
+	waitpid(pid, &status, 0);
+	if(!WIFEXITED(status) || WEXITSTATUS(status)){
+	    fprintf(stderr, "the pipeline of function %d failed\n", funcs[e]);
+	    return 1;
+	}
+    }
+
+    free(truth);
+    free(ps.xs);
+    return 0;
+}
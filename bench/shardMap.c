@@ -0,0 +1,113 @@
+/*
+  Input: [num_kmers] [num_shards]
+
+  Check that the shard maps of lib/ShardedIndex.h cover all the labels
+  of both bucketing functions for every n up to BUCKET_MAX_N, including
+  the n whose labels fill a size_t (n >= 31 with KMER_BITS=128, where
+  maxBucketLabel is SIZE_MAX). For each n, the labels of num_kmers
+  (default 2^16) random n-mers are counted in a histogram as by
+  bucketIndex.out shard and split into 1 to num_shards (default 8)
+  shards by ShardMapBalance. The ranges must start at 0, not decrease
+  and end at maxBucketLabel, and ShardMapFind must return for each label
+  (and for 0 and maxBucketLabel) the shard whose range holds it. Any
+  failure is reported and the exit status is 1.
+
+  For num_shards shards, the largest share of the labels in one shard
+  (1/num_shards if balanced) and the lookups per second of ShardMapFind
+  are printed per n.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "ShardedIndex.h"
+#include "bench.h"
+
+//1 if label is in the range of shard i
+static int inShard(const ShardMap* m, const int i, const size_t label){
+    if(label < m->bounds[i] || label > ShardMapLast(m, i)) return 0;
+    return i == m->num_shards - 1 ? label <= m->bounds[i+1] : label < m->bounds[i+1];
+}
+
+//check the ranges of m and the shard of each label, count the labels per shard
+static int checkMap(const ShardMap* m, const size_t max_label,
+		    const size_t* labels, const size_t num, size_t* counts){
+    int i;
+    if(m->bounds[0] != 0 || m->bounds[m->num_shards] != max_label) return 0;
+    for(i=0; i<m->num_shards; i+=1){
+	if(m->bounds[i+1] < m->bounds[i]) return 0;
+	counts[i] = 0;
+    }
+    if(!inShard(m, ShardMapFind(m, 0), 0)
+       || ShardMapFind(m, max_label) != m->num_shards - 1) return 0;
+    size_t j;
+    for(j=0; j<num; j+=1){
+	i = ShardMapFind(m, labels[j]);
+	if(!inShard(m, i, labels[j])) return 0;
+	counts[i] += 1;
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[]){
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 1lu<<16;
+    int max_shards = argc > 2 ? atoi(argv[2]) : 8;
+    if(num < 1 || max_shards < 1){
+	printf("usage: bench-shardMap.out [num_kmers] [num_shards]\n");
+	return 1;
+    }
+    srand(time(0));
+
+    int max_n = BUCKET_MAX_N(BUCKET_FUNC_SAMPLE);
+    size_t* labels = malloc_harder(sizeof *labels * num * max_n);
+    size_t* counts = malloc_harder(sizeof *counts * max_shards);
+    int func, n, shift, shards, failed = 0, same;
+    size_t max_label, num_labels, max_count, i, *hist;
+    double t;
+    ShardMap m;
+
+    printf("func\tn\tmax_label\tmax_share\tlookups/s\tcovered\n");
+    for(func=BUCKET_FUNC_OPT12; func<=BUCKET_FUNC_SAMPLE; func+=1){
+	for(n=1; n<=BUCKET_MAX_N(func); n+=1){
+	    max_label = maxBucketLabel(func, n);
+	    for(i=0, num_labels=0; i<num; i+=1){
+		num_labels += assignBucketsWith64(func, randomKMer(n), n, labels, num_labels);
+	    }
+	    shift = shardHistShift(max_label);
+	    hist = calloc_harder((max_label >> shift) + 1, sizeof *hist);
+	    for(i=0; i<num_labels; i+=1){
+		hist[labels[i] >> shift] += 1;
+	    }
+
+	    for(shards=1, same=1; shards<=max_shards && same; shards+=1){
+		ShardMapBalance(&m, "bench-shardMap.map", n, func, max_label,
+				hist, shift, shards);
+		same = checkMap(&m, max_label, labels, num_labels, counts);
+		if(shards < max_shards || !same) ShardMapFree(&m);
+	    }
+	    free(hist);
+	    if(!same){
+		fprintf(stderr, "func %d, n=%d: the map of %d shards is wrong\n",
+			func, n, shards-1);
+		failed = 1;
+		printf("%d\t%d\t%zu\t-\t-\tno\n", func, n, max_label);
+		continue;
+	    }
+
+	    for(i=0, max_count=0; i<(size_t) max_shards; i+=1){
+		if(counts[i] > max_count) max_count = counts[i];
+	    }
+	    t = benchSeconds();
+	    for(i=0; i<num_labels; i+=1){
+		benchSink(ShardMapFind(&m, labels[i]));
+	    }
+	    t = benchSeconds() - t;
+	    printf("%d\t%d\t%zu\t%.3f\t%.3g\tyes\n", func, n, max_label,
+		   (double) max_count / num_labels, num_labels / t);
+	    ShardMapFree(&m);
+	}
+    }
+
+    free(labels);
+    free(counts);
+    return failed;
+}
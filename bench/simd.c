@@ -0,0 +1,107 @@
+/*
+  Input: [num_kmers]
+
+  Check that every level of simd.h supported by the CPU gives the same
+  results as the scalar one and compare their throughput. For each level,
+  isInSampleD1 and assignBucketsBatch are run on num_kmers (default 2^20)
+  random n-mers for n = 4, 5, ..., 32;
+  any output that differs from the scalar level is reported and the
+  exit status is 1. The throughput of isInSampleD1 (31-mers per second)
+  and of assignBucketsBatch (labels per second, for n = 10, 20, 31), the
+  best of 3 runs, is printed per level.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "simd.h"
+#include "bench.h"
+
+#define MIN_N ASSIGN_FIXED_MIN_N
+#define MAX_N ASSIGN_FIXED_MAX_N
+#define REPS 3
+
+int main(int argc, char* argv[]){
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 1lu<<20;
+    if(num < 1){
+	printf("usage: bench-simd.out [num_kmers]\n");
+	return 1;
+    }
+    srand(time(0));
+
+    kmer* xs[MAX_N+1];
+    blabel* expected[MAX_N+1];
+    char* in_sample[MAX_N+1];
+    blabel* buckets = malloc_harder(sizeof *buckets * num * MAX_N);
+    size_t i;
+    int n, level, rep, best = simdDetect(), bound, failed = 0, same;
+    SimdLevel startup = simdLevel();
+    double t, best_t;
+
+    //the scalar results, untimed
+    simdSetLevel(SIMD_SCALAR);
+    memset(buckets, 0, sizeof *buckets * num * MAX_N);
+    for(n=MIN_N; n<=MAX_N; n+=1){
+	xs[n] = malloc_harder(sizeof *xs[n] * num);
+	expected[n] = malloc_harder(sizeof *expected[n] * num * n);
+	in_sample[n] = malloc_harder(num);
+	for(i=0; i<num; i+=1){
+	    xs[n][i] = randomKMer(n);
+	    in_sample[n][i] = isInSampleD1(xs[n][i], n);
+	}
+	assignBucketsBatch(xs[n], num, n, expected[n]);
+    }
+
+    printf("CPU level: %s, bound at startup: %s\n",
+	   simdLevelName(best), simdLevelName(startup));
+    printf("level\tisInSampleD1(31-mers/s)\tbatch_n10(labels/s)"
+	   "\tbatch_n20(labels/s)\tbatch_n31(labels/s)\tidentical\n");
+    for(level=SIMD_SCALAR; level<=best; level+=1){
+	bound = simdSetLevel(level);
+	same = 1;
+
+	best_t = 1e100;
+	for(rep=0; rep<REPS; rep+=1){
+	    t = benchSeconds();
+	    for(i=0; i<num; i+=1){
+		benchSink(isInSampleD1(xs[31][i], 31));
+	    }
+	    t = benchSeconds() - t;
+	    if(t < best_t) best_t = t;
+	}
+	printf("%s\t%.3e", simdLevelName(bound), num / best_t);
+	for(n=MIN_N; n<=MAX_N; n+=1){
+	    for(i=0; i<num && in_sample[n][i] == isInSampleD1(xs[n][i], n); i+=1);
+	    if(i < num){
+		fprintf(stderr, "%s: isInSampleD1 differs for n=%d\n", simdLevelName(bound), n);
+		same = 0;
+	    }
+	}
+
+	for(n=MIN_N; n<=MAX_N; n+=1){
+	    best_t = 1e100;
+	    for(rep=0; rep<REPS; rep+=1){
+		t = benchSeconds();
+		assignBucketsBatch(xs[n], num, n, buckets);
+		t = benchSeconds() - t;
+		if(t < best_t) best_t = t;
+	    }
+	    if(n == 10 || n == 20 || n == 31) printf("\t%.3e", (double) num * n / best_t);
+	    if(memcmp(buckets, expected[n], sizeof *buckets * num * n)){
+		fprintf(stderr, "%s: assignBucketsBatch differs for n=%d\n",
+			simdLevelName(bound), n);
+		same = 0;
+	    }
+	}
+	printf("\t%s\n", same ? "yes" : "no");
+	failed |= !same;
+    }
+    simdSetLevel(startup);
+
+    for(n=MIN_N; n<=MAX_N; n+=1){
+	free(xs[n]);
+	free(expected[n]);
+	free(in_sample[n]);
+    }
+    free(buckets);
+    return failed;
+}
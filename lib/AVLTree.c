@@ -1,4 +1,5 @@
 #include "AVLTree.h"
+#include "metrics.h"
 
 static AVLNode* rotateLeft(AVLNode* root){
 	AVLNode* x = root->right;
@@ -49,6 +50,7 @@ void AVLFreeTree(AVLNode *n, void (*freeData)(void*)){
 
 AVLNode* AVLAdd(AVLNode* root, void* d, int (*cmp)(const void*, const void*)){
 	AVLNode* x = malloc(sizeof(AVLNode));
+	METRIC_INC(METRIC_AVL_NODES);
 	x->left = x->right = NULL;
 	x->data = d;
 	x->height = 1;
@@ -239,3 +241,158 @@ void AVLPrint(const AVLNode* root, int depth, int (*getKey)(const void*)){
 	AVLPrint(root->left, depth+1, getKey);
 	AVLPrint(root->right, depth+1, getKey);
 }
+
+void AVLArenaInit(AVLArena* a){
+	a->blocks = NULL;
+	a->num_blocks = 0;
+	a->cur_block = 0;
+	a->used = 0;
+}
+
+void AVLArenaReset(AVLArena* a){
+	a->cur_block = 0;
+	a->used = 0;
+}
+
+void AVLArenaFree(AVLArena* a){
+	size_t i;
+	for(i=0; i<a->num_blocks; i++) free(a->blocks[i]);
+	free(a->blocks);
+	AVLArenaInit(a);
+}
+
+static inline AVLKmerNode* AVLArenaNode(AVLArena* a){
+	METRIC_INC(METRIC_AVL_NODES);
+	if(a->used == AVL_ARENA_BLOCK){
+		a->cur_block++;
+		a->used = 0;
+	}
+	if(a->cur_block == a->num_blocks){
+		a->blocks = realloc_harder(a->blocks, sizeof *a->blocks * (a->num_blocks+1));
+		a->blocks[a->num_blocks++] = malloc_harder(sizeof(AVLKmerNode) * AVL_ARENA_BLOCK);
+	}
+	return a->blocks[a->cur_block] + a->used++;
+}
+
+static AVLKmerNode* rotateKmerLeft(AVLKmerNode* root){
+	AVLKmerNode* x = root->right;
+	root->right = x->left;
+	x->left = root;
+	int l = AVLKMERHEIGHT(root->left);
+	int r = AVLKMERHEIGHT(root->right);
+	l = root->height = (l>r?l:r)+1;
+	r = AVLKMERHEIGHT(x->right);
+	x->height = (l>r?l:r)+1;
+
+	root->size = AVLKMERSIZE(root->left)+AVLKMERSIZE(root->right)+1;
+	x->size = AVLKMERSIZE(x->right)+root->size+1;
+	return x;
+}
+
+static AVLKmerNode* rotateKmerRight(AVLKmerNode* root){
+	AVLKmerNode* x = root->left;
+	root->left = x->right;
+	x->right = root;
+	int l = AVLKMERHEIGHT(root->left);
+	int r = AVLKMERHEIGHT(root->right);
+	r = root->height = (l>r?l:r)+1;
+	l = AVLKMERHEIGHT(x->left);
+	x->height = (l>r?l:r)+1;
+
+	root->size = AVLKMERSIZE(root->left)+AVLKMERSIZE(root->right)+1;
+	x->size = AVLKMERSIZE(x->left)+root->size+1;
+	return x;
+}
+
+AVLKmerNode* AVLKmerAdd(AVLArena* a, AVLKmerNode* root, const kmer key){
+	if(root == NULL){
+		AVLKmerNode* x = AVLArenaNode(a);
+		x->left = x->right = NULL;
+		x->key = key;
+		x->height = 1;
+		x->size = 1;
+		return x;
+	}
+
+	AVLKmerNode* path[root->height+1];
+	int current=0;
+	path[current]=root;
+
+	while(path[current]!=NULL){
+		if(path[current]->key == key) return root;
+		if(path[current]->key > key){
+			path[current+1] = path[current]->left;
+		}else{
+			path[current+1] = path[current]->right;
+		}
+		current++;
+	}
+
+	AVLKmerNode* x = AVLArenaNode(a);
+	x->left = x->right = NULL;
+	x->key = key;
+	x->height = 1;
+	x->size = 1;
+	if(path[--current]->key > key) path[current]->left = x;
+	else path[current]->right = x;
+	path[current+1] = x;
+
+	while(current>=0){
+		AVLKmerNode* c = path[current];
+		int lh = AVLKMERHEIGHT(c->left);
+		int rh = AVLKMERHEIGHT(c->right);
+
+		if(lh-rh>1){//L, inserted in left
+			if(path[current+1]->right==path[current+2]){//LR
+				c->left = rotateKmerLeft(path[current+1]);
+			}
+			c = rotateKmerRight(c);
+			if(current>0){
+				if(path[current-1]->left==path[current]) path[current-1]->left = c;
+				else path[current-1]->right = c;
+			}else{
+				return c;
+			}
+		}else if(lh-rh<-1){//R
+			if(path[current+1]->left==path[current+2]){//RL
+				c->right = rotateKmerRight(path[current+1]);
+			}
+			c = rotateKmerLeft(c);
+			if(current>0){
+				if(path[current-1]->left==path[current]) path[current-1]->left = c;
+				else path[current-1]->right = c;
+			}else{
+				return c;
+			}
+		}else{
+			c->height = (lh>rh?lh:rh)+1;
+			c->size = AVLKMERSIZE(c->left)+AVLKMERSIZE(c->right)+1;
+		}
+		current--;
+	}
+	return path[0];
+}
+
+AVLKmerNode* AVLKmerBuild(AVLArena* a, const kmer* keys, const size_t num){
+	if(num == 0) return NULL;
+	size_t mid = num >> 1;
+	AVLKmerNode* x = AVLArenaNode(a);
+	x->key = keys[mid];
+	x->left = AVLKmerBuild(a, keys, mid);
+	x->right = AVLKmerBuild(a, keys+mid+1, num-mid-1);
+	int l = AVLKMERHEIGHT(x->left);
+	int r = AVLKMERHEIGHT(x->right);
+	x->height = (l>r?l:r)+1;
+	x->size = num;
+	return x;
+}
+
+AVLKmerNode* AVLKmerSearch(AVLKmerNode* root, const kmer key){
+	while(root!=NULL){
+		if(root->key==key) return root;
+		else if(root->key<key) root = root->right;
+		else root=root->left;
+	}
+
+	return NULL;
+}
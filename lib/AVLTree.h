@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "util.h" //for kmer
 //#include <sqlite3.h>
 //#include <string.h>
 //#include <math.h>
@@ -48,4 +49,48 @@ AVLNode* AVLDeleteValue(AVLNode* root, void* d, int (*cmp)(const void*, const vo
 //print the tree
 void AVLPrint(const AVLNode* root, int depth, int (*getKey)(const void*));
 
+/*
+  AVL tree of k-mers with the key stored in the node, the nodes are taken
+  from an arena of fixed size blocks instead of one malloc each. All the
+  trees of an arena are released at once by AVLArenaReset, which keeps
+  the blocks for the next trees.
+*/
+typedef struct AVLKmerNode{
+	struct AVLKmerNode* left;
+	struct AVLKmerNode* right;
+	kmer key;
+	int size;
+	int height;
+} AVLKmerNode;
+
+#define AVLKMERHEIGHT(node) (node==NULL?0:node->height)
+#define AVLKMERSIZE(node) (node==NULL?0:node->size)
+
+//number of nodes in a block of the arena
+#define AVL_ARENA_BLOCK 4096
+
+typedef struct {
+	AVLKmerNode** blocks;
+	size_t num_blocks;
+	size_t cur_block; //the block nodes are taken from
+	size_t used; //nodes taken from the current block
+} AVLArena;
+
+void AVLArenaInit(AVLArena* a);
+
+//release all the trees of the arena, keeping its memory
+void AVLArenaReset(AVLArena* a);
+
+//free the memory of the arena
+void AVLArenaFree(AVLArena* a);
+
+//add key to the tree rooted at root (if not already in it) with a node from a
+AVLKmerNode* AVLKmerAdd(AVLArena* a, AVLKmerNode* root, const kmer key);
+
+//a balanced tree of the num sorted distinct keys with nodes from a, in O(num)
+AVLKmerNode* AVLKmerBuild(AVLArena* a, const kmer* keys, const size_t num);
+
+//search in tree rooted at root for key
+AVLKmerNode* AVLKmerSearch(AVLKmerNode* root, const kmer key);
+
 #endif //AVLTree.h
@@ -0,0 +1,406 @@
+#include "BucketIndex.h"
+#include "bucketing.h"
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline void reportIndexError(const char* path, const char* msg){
+    fprintf(stderr, "error with index %s: %s\n", path, msg);
+    exit(1);
+}
+
+static FILE* tmpfile_harder(const char* path){
+    FILE* f = tmpfile();
+    if(f == NULL) reportIndexError(path, "cannot create temporary file");
+    return f;
+}
+
+//the fields common to both kinds of builders
+static void builderInit(BIndexBuilder* b, const char* path, const int n,
+			const int func, const size_t max_label){
+    if(n < 1 || n > BUCKET_MAX_N(func)){
+	reportIndexError(path, "n out of the range of the bucketing function");
+    }
+    memset(&b->hdr, 0, sizeof b->hdr);
+    memcpy(b->hdr.magic, BINDEX_MAGIC, sizeof b->hdr.magic);
+    b->hdr.n = n;
+    b->hdr.func = func;
+    b->hdr.kmer_bits = sizeof(kmer) * 8;
+    b->hdr.max_label = max_label;
+
+    b->path = strdup(path);
+    b->buf = b->tmp = NULL;
+    b->buf_size = b->buf_used = 0;
+    b->runs = NULL;
+    b->num_runs = 0;
+    b->kmers = NULL;
+    b->sorted = 0;
+    b->out = b->labels = b->offsets = NULL;
+}
+
+void BIndexBuilderInit(BIndexBuilder* b, const char* path, const int n,
+		       const int func, const size_t max_label,
+		       const size_t mem_bytes){
+    builderInit(b, path, n, func, max_label);
+    //half of the memory is the scratch space of the radix sort
+    b->buf_size = mem_bytes / (2 * sizeof *b->buf);
+    if(b->buf_size < 1024) b->buf_size = 1024;
+    b->buf = malloc_harder(sizeof *b->buf * b->buf_size);
+    b->tmp = malloc_harder(sizeof *b->tmp * b->buf_size);
+}
+
+static void writerOpen(BIndexBuilder* b);
+static void writerPut(BIndexBuilder* b, const Posting* cur);
+
+void BIndexBuilderInitSorted(BIndexBuilder* b, const char* path, const int n,
+			     const int func, const size_t max_label){
+    builderInit(b, path, n, func, max_label);
+    b->sorted = 1;
+    writerOpen(b);
+}
+
+//sort the buffer and write it to a new run
+static void BIndexBuilderSpill(BIndexBuilder* b){
+    radixSortPostings(b->buf, b->tmp, b->buf_used);
+    FILE* run = tmpfile_harder(b->path);
+    if(fwrite(b->buf, sizeof *b->buf, b->buf_used, run) != b->buf_used){
+	reportIndexError(b->path, "cannot write sorted run");
+    }
+    rewind(run);
+    b->runs = realloc_harder(b->runs, sizeof *b->runs * (b->num_runs+1));
+    b->runs[b->num_runs++] = run;
+    b->buf_used = 0;
+}
+
+static inline int postingLess(const Posting* a, const Posting* b){
+    return a->label < b->label || (a->label == b->label && a->id < b->id);
+}
+
+void BIndexBuilderAdd(BIndexBuilder* b, const size_t label, const size_t id){
+    if(label > b->hdr.max_label){
+	reportIndexError(b->path, "label larger than max_label");
+    }
+    if(b->sorted){
+	Posting cur = {label, id};
+	if(b->hdr.num_postings && postingLess(&cur, &b->last)){
+	    reportIndexError(b->path, "postings added out of order");
+	}
+	writerPut(b, &cur);
+	return;
+    }
+    if(b->buf_used == b->buf_size){
+	BIndexBuilderSpill(b);
+    }
+    b->buf[b->buf_used].label = label;
+    b->buf[b->buf_used].id = id;
+    b->buf_used += 1;
+}
+
+void BIndexBuilderAddKMer(BIndexBuilder* b, const kmer x){
+    if(b->kmers == NULL){
+	b->kmers = tmpfile_harder(b->path);
+    }
+    fwrite(&x, sizeof x, 1, b->kmers);
+    b->hdr.num_kmers += 1;
+}
+
+//a sorted run, either in memory (f == NULL) or in a file
+typedef struct {
+    FILE* f;
+    const Posting* arr;
+    size_t left;
+    Posting cur;
+} RunCursor;
+
+static inline int cursorNext(RunCursor* c){
+    if(c->f){
+	return fread(&c->cur, sizeof c->cur, 1, c->f) == 1;
+    }
+    if(c->left == 0) return 0;
+    c->cur = *(c->arr++);
+    c->left -= 1;
+    return 1;
+}
+
+static void heapDown(RunCursor** heap, size_t size, size_t i){
+    size_t c;
+    RunCursor* x = heap[i];
+    while((c = (i<<1)+1) < size){
+	if(c+1 < size && postingLess(&heap[c+1]->cur, &heap[c]->cur)) c += 1;
+	if(!postingLess(&heap[c]->cur, &x->cur)) break;
+	heap[i] = heap[c];
+	i = c;
+    }
+    heap[i] = x;
+}
+
+static inline void writeVarint(size_t x, FILE* f){
+    while(x >= 0x80){
+	putc_unlocked((x & 0x7f) | 0x80, f);
+	x >>= 7;
+    }
+    putc_unlocked(x, f);
+}
+
+static void copyFile(FILE* src, FILE* dest, const char* path){
+    char buf[1<<16];
+    size_t len;
+    rewind(src);
+    while((len = fread(buf, 1, sizeof buf, src)) > 0){
+	if(fwrite(buf, 1, len, dest) != len){
+	    reportIndexError(path, "cannot write index");
+	}
+    }
+}
+
+//align is a power of 2
+static uint64_t padTo(FILE* f, const uint64_t align){
+    uint64_t pos = ftell(f);
+    while(pos & (align-1)){
+	putc(0, f);
+	pos += 1;
+    }
+    return pos;
+}
+
+//start the index file, its postings are then written by writerPut
+static void writerOpen(BIndexBuilder* b){
+    b->out = fopen(b->path, "wb");
+    if(b->out == NULL) reportIndexError(b->path, "cannot open for writing");
+    fwrite(&b->hdr, sizeof b->hdr, 1, b->out);
+    b->hdr.postings_off = sizeof b->hdr;
+    b->labels = tmpfile_harder(b->path);
+    b->offsets = tmpfile_harder(b->path);
+}
+
+//write cur, not smaller than the previous posting, unless it equals it
+static void writerPut(BIndexBuilder* b, const Posting* cur){
+    BIndexHeader* hdr = &b->hdr;
+    uint64_t bytes, x;
+    int first = hdr->num_postings == 0;
+    if(!first && cur->label == b->last.label && cur->id == b->last.id) return;
+    if(first || cur->label != b->last.label){
+	//start the posting list of a new label
+	bytes = ftell(b->out) - hdr->postings_off;
+	x = cur->label;
+	fwrite(&x, sizeof x, 1, b->labels);
+	fwrite(&bytes, sizeof bytes, 1, b->offsets);
+	hdr->num_labels += 1;
+	b->last.id = 0;
+    }
+    writeVarint(cur->id - b->last.id, b->out);
+    hdr->num_postings += 1;
+    b->last = *cur;
+}
+
+//fence_shift for at most 2*num_labels+1 and 2^BINDEX_FENCE_BITS+1 entries
+static int fenceShift(const size_t max_label, const size_t num_labels){
+    int bits = max_label ? 64 - __builtin_clzl(max_label) : 1;
+    int fence_bits = num_labels ? 64 - __builtin_clzl(num_labels) : 0;
+    if(fence_bits > BINDEX_FENCE_BITS) fence_bits = BINDEX_FENCE_BITS;
+    return bits > fence_bits ? bits - fence_bits : 0;
+}
+
+//write the fence from the labels and the other sections after the postings
+static void writerClose(BIndexBuilder* b){
+    BIndexHeader* hdr = &b->hdr;
+    FILE* fout = b->out;
+    uint64_t bytes = ftell(fout) - hdr->postings_off;
+    fwrite(&bytes, sizeof bytes, 1, b->offsets);
+
+    hdr->fence_shift = fenceShift(hdr->max_label, hdr->num_labels);
+    size_t fence_size = (hdr->max_label >> hdr->fence_shift) + 2, next_fence = 0, i;
+    uint64_t* fence = malloc_harder(sizeof *fence * fence_size);
+    uint64_t label;
+    rewind(b->labels);
+    for(i=0; i<hdr->num_labels; i+=1){
+	if(fread(&label, sizeof label, 1, b->labels) != 1){
+	    reportIndexError(b->path, "cannot read labels");
+	}
+	for(; next_fence <= (label >> hdr->fence_shift); next_fence+=1){
+	    fence[next_fence] = i;
+	}
+    }
+    for(; next_fence < fence_size; next_fence+=1){
+	fence[next_fence] = hdr->num_labels;
+    }
+
+    hdr->labels_off = padTo(fout, 8);
+    copyFile(b->labels, fout, b->path);
+    hdr->offsets_off = ftell(fout);
+    copyFile(b->offsets, fout, b->path);
+    hdr->fence_off = ftell(fout);
+    fwrite(fence, sizeof *fence, fence_size, fout);
+    hdr->kmers_off = padTo(fout, BINDEX_KMERS_ALIGN);
+    if(b->kmers) copyFile(b->kmers, fout, b->path);
+    hdr->file_size = ftell(fout);
+
+    rewind(fout);
+    fwrite(hdr, sizeof *hdr, 1, fout);
+    if(fclose(fout)) reportIndexError(b->path, "cannot write index");
+
+    fclose(b->labels);
+    fclose(b->offsets);
+    b->out = b->labels = b->offsets = NULL;
+    free(fence);
+}
+
+//merge the cursors into the index file
+static void BIndexWrite(BIndexBuilder* b, RunCursor* cursors, size_t num){
+    writerOpen(b);
+    RunCursor* heap[num];
+    size_t size = 0, i;
+    for(i=0; i<num; i+=1){
+	if(cursorNext(cursors+i)) heap[size++] = cursors+i;
+    }
+    for(i=size; i>0; i-=1){
+	heapDown(heap, size, i-1);
+    }
+
+    while(size > 0){
+	Posting cur = heap[0]->cur;
+	if(cursorNext(heap[0])) heapDown(heap, size, 0);
+	else if(--size > 0){
+	    heap[0] = heap[size];
+	    heapDown(heap, size, 0);
+	}
+	writerPut(b, &cur);
+    }
+    writerClose(b);
+}
+
+void BIndexBuilderFinish(BIndexBuilder* b){
+    size_t i, num;
+    RunCursor* cursors;
+    if(b->sorted){
+	writerClose(b);
+	if(b->kmers) fclose(b->kmers);
+	free(b->path);
+	return;
+    }
+    if(b->num_runs == 0){
+	radixSortPostings(b->buf, b->tmp, b->buf_used);
+	num = 1;
+	cursors = malloc_harder(sizeof *cursors);
+	cursors[0].f = NULL;
+	cursors[0].arr = b->buf;
+	cursors[0].left = b->buf_used;
+    }else{
+	if(b->buf_used) BIndexBuilderSpill(b);
+	free(b->buf);
+	free(b->tmp);
+	b->buf = b->tmp = NULL;
+	num = b->num_runs;
+	cursors = malloc_harder(sizeof *cursors * num);
+	for(i=0; i<num; i+=1){
+	    cursors[i].f = b->runs[i];
+	    setvbuf(b->runs[i], NULL, _IOFBF, 1<<20);
+	}
+    }
+
+    BIndexWrite(b, cursors, num);
+
+    for(i=0; i<b->num_runs; i+=1){
+	fclose(b->runs[i]);
+    }
+    if(b->kmers) fclose(b->kmers);
+    free(cursors);
+    free(b->runs);
+    free(b->buf);
+    free(b->tmp);
+    free(b->path);
+}
+
+void BIndexOpen(BucketIndex* idx, const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) reportIndexError(path, "cannot open");
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size < sizeof(BIndexHeader)){
+	reportIndexError(path, "file too small");
+    }
+    idx->map_size = st.st_size;
+    idx->map = mmap(NULL, idx->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(idx->map == MAP_FAILED) reportIndexError(path, "cannot mmap");
+
+    const char* base = idx->map;
+    idx->hdr = idx->map;
+    if(memcmp(idx->hdr->magic, BINDEX_MAGIC, sizeof idx->hdr->magic)
+       || idx->hdr->file_size != idx->map_size){
+	reportIndexError(path, "not a valid index");
+    }
+    if(idx->hdr->kmer_bits != sizeof(kmer) * 8){
+	reportIndexError(path, "built with another KMER_BITS");
+    }
+    idx->postings = (const unsigned char*) base + idx->hdr->postings_off;
+    idx->labels = (const uint64_t*) (base + idx->hdr->labels_off);
+    idx->offsets = (const uint64_t*) (base + idx->hdr->offsets_off);
+    idx->fence = (const uint64_t*) (base + idx->hdr->fence_off);
+    idx->kmers = (const kmer*) (base + idx->hdr->kmers_off);
+}
+
+void BIndexClose(BucketIndex* idx){
+    munmap(idx->map, idx->map_size);
+    idx->map = NULL;
+}
+
+//index of label in idx->labels, or -1 if the bucket is empty
+static inline long BIndexFind(const BucketIndex* idx, const size_t label){
+    if(label > idx->hdr->max_label) return -1;
+    size_t p = label >> idx->hdr->fence_shift;
+    size_t lo = idx->fence[p], hi = idx->fence[p+1], mid;
+    while(lo < hi){
+	mid = (lo + hi) >> 1;
+	if(idx->labels[mid] < label) lo = mid + 1;
+	else hi = mid;
+    }
+    if(lo < idx->fence[p+1] && idx->labels[lo] == label) return lo;
+    return -1;
+}
+
+size_t BIndexLookup(const BucketIndex* idx, const size_t label,
+		    size_t** ids, size_t* ids_size){
+    long i = BIndexFind(idx, label);
+    if(i < 0) return 0;
+    return BIndexDecode(idx, i, ids, ids_size);
+}
+
+size_t BIndexDecode(const BucketIndex* idx, const size_t i,
+		    size_t** ids, size_t* ids_size){
+    const unsigned char* p = idx->postings + idx->offsets[i];
+    const unsigned char* end = idx->postings + idx->offsets[i+1];
+    size_t num = 0, id = 0, gap;
+    int shift;
+    while(p < end){
+	if(num == *ids_size){
+	    *ids_size = *ids_size ? *ids_size << 1 : 16;
+	    *ids = realloc_harder(*ids, sizeof **ids * (*ids_size));
+	}
+	gap = 0;
+	shift = 0;
+	while(*p & 0x80){
+	    gap |= (size_t) (*p & 0x7f) << shift;
+	    shift += 7;
+	    p += 1;
+	}
+	gap |= (size_t) *p << shift;
+	p += 1;
+	id += gap;
+	(*ids)[num++] = id;
+    }
+    return num;
+}
+
+size_t BIndexCount(const BucketIndex* idx, const size_t label){
+    long i = BIndexFind(idx, label);
+    if(i < 0) return 0;
+
+    const unsigned char* p = idx->postings + idx->offsets[i];
+    const unsigned char* end = idx->postings + idx->offsets[i+1];
+    size_t num = 0;
+    for(; p<end; p+=1){
+	if(!(*p & 0x80)) num += 1;
+    }
+    return num;
+}
@@ -0,0 +1,144 @@
+/*
+  An on-disk inverted index from bucket labels to the ids (of k-mers or
+  reads) assigned to them.
+
+  File layout (all integers are 64-bit, sections are 8-byte aligned and
+  the kmers 16-byte aligned for the unsigned __int128 of KMER_BITS=128):
+  - header (BIndexHeader);
+  - postings: for each non-empty bucket in increasing label order, its
+    sorted ids as varint-encoded gaps (the first gap is from 0);
+  - labels[num_labels]: the non-empty labels in increasing order;
+  - offsets[num_labels+1]: byte offset of each posting list in postings;
+  - fence[(max_label >> fence_shift) + 2]: fence[p] is the index of the
+    first label with (label >> fence_shift) >= p, narrowing the search of
+    labels; fence_shift is chosen when the index is finished so that the
+    fence has at most 2*num_labels+1 and 2^BINDEX_FENCE_BITS+1 entries;
+  - kmers[num_kmers]: optional, the k-mer with id i, used for verification.
+
+  The builder keeps at most mem_bytes of postings in memory, each full
+  buffer is radix sorted and spilled to a temporary run file, and all
+  runs are merged when the index is finished. A builder started by
+  BIndexBuilderInitSorted instead takes the postings already sorted and
+  writes them as they come, e.g. to merge indexes.
+*/
+
+#ifndef _BUCKETINDEX_H
+#define _BUCKETINDEX_H 1
+
+#include "util.h"
+#include "RadixSort.h"
+#include <stdint.h>
+
+#define BINDEX_MAGIC "LSBINDX2"
+#define BINDEX_KMERS_ALIGN 16
+#define BINDEX_FENCE_BITS 16
+
+typedef struct {
+    char magic[8];
+    uint64_t n; //length of the k-mers
+    uint64_t func; //BUCKET_FUNC_* in bucketing.h
+    uint64_t kmer_bits; //width of a stored k-mer, the build must match
+    uint64_t max_label;
+    uint64_t fence_shift;
+    uint64_t num_labels;
+    uint64_t num_postings;
+    uint64_t num_kmers;
+    uint64_t postings_off;
+    uint64_t labels_off;
+    uint64_t offsets_off;
+    uint64_t fence_off;
+    uint64_t kmers_off;
+    uint64_t file_size;
+} BIndexHeader;
+
+typedef struct {
+    char* path;
+    BIndexHeader hdr;
+    Posting* buf;
+    Posting* tmp;
+    size_t buf_size;
+    size_t buf_used;
+    FILE** runs;
+    size_t num_runs;
+    FILE* kmers;
+    int sorted; //postings are written as added
+    //the index file being written and its sections
+    FILE* out;
+    FILE* labels;
+    FILE* offsets;
+    Posting last; //the last posting written
+} BIndexBuilder;
+
+typedef struct {
+    void* map;
+    size_t map_size;
+    const BIndexHeader* hdr;
+    const unsigned char* postings;
+    const uint64_t* labels;
+    const uint64_t* offsets;
+    const uint64_t* fence;
+    const kmer* kmers;
+} BucketIndex;
+
+/*
+  Start building an index at path for buckets in [0, max_label]
+  computed by the bucketing function func on n-mers. Exit with an error
+  message if n is not in [1, BUCKET_MAX_N(func)] (see bucketing.h).
+*/
+void BIndexBuilderInit(BIndexBuilder* b, const char* path, const int n,
+		       const int func, const size_t max_label,
+		       const size_t mem_bytes);
+
+/*
+  Same as BIndexBuilderInit for postings added in increasing order of
+  (label, id), which are written without being buffered or sorted.
+*/
+void BIndexBuilderInitSorted(BIndexBuilder* b, const char* path, const int n,
+			     const int func, const size_t max_label);
+
+/*
+  Add the posting (label, id). Duplicated postings are stored once.
+  Exit with an error message if label > max_label, or if the builder
+  was started by BIndexBuilderInitSorted and (label, id) is smaller
+  than the previous posting.
+*/
+void BIndexBuilderAdd(BIndexBuilder* b, const size_t label, const size_t id);
+
+/*
+  Record x as the k-mer with the next id (0, 1, 2, ...).
+*/
+void BIndexBuilderAddKMer(BIndexBuilder* b, const kmer x);
+
+/*
+  Merge all postings into the index file and free the builder.
+*/
+void BIndexBuilderFinish(BIndexBuilder* b);
+
+/*
+  Memory-map the index at path. Exit with an error message if the file
+  is not a valid index.
+*/
+void BIndexOpen(BucketIndex* idx, const char* path);
+
+void BIndexClose(BucketIndex* idx);
+
+/*
+  Decode the ids in the bucket with the given label into *ids, which is
+  (re)allocated if *ids_size is too small. Return the number of ids.
+*/
+size_t BIndexLookup(const BucketIndex* idx, const size_t label,
+		    size_t** ids, size_t* ids_size);
+
+/*
+  Same as BIndexLookup for the i-th non-empty bucket, whose label is
+  idx->labels[i].
+*/
+size_t BIndexDecode(const BucketIndex* idx, const size_t i,
+		    size_t** ids, size_t* ids_size);
+
+/*
+  Return the number of ids in the bucket with the given label.
+*/
+size_t BIndexCount(const BucketIndex* idx, const size_t label);
+
+#endif // BucketIndex.h
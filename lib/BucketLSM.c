@@ -0,0 +1,588 @@
+#include "BucketLSM.h"
+#include "bucketing.h"
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline void reportLSMError(const char* dir, const char* msg){
+    fprintf(stderr, "error with index directory %s: %s\n", dir, msg);
+    exit(1);
+}
+
+static char* lsmPath(const BucketLSM* lsm, const char* prefix,
+		     const size_t file_no, const char* suffix){
+    size_t len = strlen(lsm->dir) + 64;
+    char* path = malloc_harder(len);
+    snprintf(path, len, "%s/%s%06zu%s", lsm->dir, prefix, file_no, suffix);
+    return path;
+}
+
+static void openSegment(BucketLSM* lsm, LSMSegment* seg){
+    char* path = lsmPath(lsm, "seg-", seg->file_no, ".lsbi");
+    BIndexOpen(&seg->idx, path);
+    free(path);
+}
+
+static void loadTombstones(BucketLSM* lsm, LSMTombstones* del){
+    char* path = lsmPath(lsm, "del-", del->file_no, ".ids");
+    FILE* fin = fopen(path, "rb");
+    del->ids = malloc_harder(sizeof *del->ids * (del->num ? del->num : 1));
+    if(fin == NULL || fread(del->ids, sizeof *del->ids, del->num, fin) != del->num){
+	reportLSMError(lsm->dir, "cannot read tombstones");
+    }
+    fclose(fin);
+    free(path);
+}
+
+//rewrite the manifest, the caller holds the write lock
+static void writeManifest(BucketLSM* lsm){
+    size_t len = strlen(lsm->dir) + 32;
+    char path[len], tmp[len];
+    snprintf(path, len, "%s/%s", lsm->dir, LSM_MANIFEST);
+    snprintf(tmp, len, "%s/%s.tmp", lsm->dir, LSM_MANIFEST);
+    FILE* fout = fopen(tmp, "w");
+    if(fout == NULL) reportLSMError(lsm->dir, "cannot write manifest");
+
+    fprintf(fout, "LSBLSM1 %d %d\nnext %zu %zu\n", lsm->n, lsm->func,
+	    lsm->next_seq, lsm->next_file);
+    size_t i;
+    for(i=0; i<lsm->num_segs; i+=1){
+	fprintf(fout, "seg %zu %zu %zu\n", lsm->segs[i].seq,
+		lsm->segs[i].file_no, lsm->segs[i].num_postings);
+    }
+    for(i=0; i<lsm->num_dels; i+=1){
+	fprintf(fout, "del %zu %zu %zu\n", lsm->dels[i].seq,
+		lsm->dels[i].file_no, lsm->dels[i].num);
+    }
+    if(fclose(fout) || rename(tmp, path)){
+	reportLSMError(lsm->dir, "cannot write manifest");
+    }
+}
+
+static void readManifest(BucketLSM* lsm, FILE* fin){
+    char type[8];
+    size_t seq, file_no, num;
+    if(fscanf(fin, "LSBLSM1 %d %d\nnext %zu %zu\n", &lsm->n, &lsm->func,
+	      &lsm->next_seq, &lsm->next_file) != 4){
+	reportLSMError(lsm->dir, "invalid manifest");
+    }
+    while(fscanf(fin, "%7s %zu %zu %zu\n", type, &seq, &file_no, &num) == 4){
+	if(strcmp(type, "seg") == 0){
+	    lsm->segs = realloc_harder(lsm->segs, sizeof *lsm->segs * (lsm->num_segs+1));
+	    LSMSegment* seg = lsm->segs + lsm->num_segs++;
+	    seg->seq = seq;
+	    seg->file_no = file_no;
+	    seg->num_postings = num;
+	    openSegment(lsm, seg);
+	}else{
+	    lsm->dels = realloc_harder(lsm->dels, sizeof *lsm->dels * (lsm->num_dels+1));
+	    LSMTombstones* del = lsm->dels + lsm->num_dels++;
+	    del->seq = seq;
+	    del->file_no = file_no;
+	    del->num = num;
+	    loadTombstones(lsm, del);
+	}
+    }
+}
+
+static void* mergeLoop(void* arg);
+
+void LSMOpen(BucketLSM* lsm, const char* dir, const int n, const int func,
+	     const int background){
+    lsm->dir = strdup(dir);
+    lsm->n = n;
+    lsm->func = func;
+    lsm->next_seq = 1;
+    lsm->next_file = 1;
+    lsm->segs = NULL;
+    lsm->num_segs = 0;
+    lsm->dels = NULL;
+    lsm->num_dels = 0;
+    lsm->max_segments = LSM_MAX_SEGMENTS;
+
+    size_t len = strlen(dir) + 32;
+    char path[len];
+    snprintf(path, len, "%s/%s", dir, LSM_MANIFEST);
+    FILE* fin = fopen(path, "r");
+    if(fin){
+	readManifest(lsm, fin);
+	fclose(fin);
+    }else{
+	if(n <= 0) reportLSMError(dir, "no index, n is needed to create one");
+	mkdir(dir, 0755);
+	writeManifest(lsm);
+    }
+
+    pthread_rwlock_init(&lsm->lock, NULL);
+    pthread_mutex_init(&lsm->update_lock, NULL);
+    pthread_mutex_init(&lsm->merge_serial, NULL);
+    pthread_mutex_init(&lsm->merge_lock, NULL);
+    pthread_cond_init(&lsm->merge_cond, NULL);
+    lsm->merge_pending = 0;
+    lsm->stop = 0;
+    lsm->background = background;
+    if(background){
+	pthread_create(&lsm->merger, NULL, mergeLoop, lsm);
+    }
+}
+
+void LSMClose(BucketLSM* lsm){
+    if(lsm->background){
+	pthread_mutex_lock(&lsm->merge_lock);
+	lsm->stop = 1;
+	pthread_cond_signal(&lsm->merge_cond);
+	pthread_mutex_unlock(&lsm->merge_lock);
+	pthread_join(lsm->merger, NULL);
+    }
+
+    size_t i;
+    for(i=0; i<lsm->num_segs; i+=1){
+	BIndexClose(&lsm->segs[i].idx);
+    }
+    for(i=0; i<lsm->num_dels; i+=1){
+	free(lsm->dels[i].ids);
+    }
+    free(lsm->segs);
+    free(lsm->dels);
+    free(lsm->dir);
+    pthread_rwlock_destroy(&lsm->lock);
+    pthread_mutex_destroy(&lsm->update_lock);
+    pthread_mutex_destroy(&lsm->merge_serial);
+    pthread_mutex_destroy(&lsm->merge_lock);
+    pthread_cond_destroy(&lsm->merge_cond);
+}
+
+//reserve a file number for a new file
+static size_t newFile(BucketLSM* lsm){
+    pthread_mutex_lock(&lsm->update_lock);
+    size_t file_no = lsm->next_file++;
+    pthread_mutex_unlock(&lsm->update_lock);
+    return file_no;
+}
+
+/*
+  The sequence number of a file being published, the caller holds the
+  write lock. Taking it only then (not when the file is started) keeps
+  the published seqs increasing: a merge, which reads the lists under
+  the lock, sees every tombstone older than the segments it merges.
+*/
+static inline size_t publishSeq(BucketLSM* lsm){
+    return lsm->next_seq++;
+}
+
+//insert seg into the list keeping it sorted by seq, the caller holds
+//the write lock
+static void insertSegment(BucketLSM* lsm, const LSMSegment* seg){
+    lsm->segs = realloc_harder(lsm->segs, sizeof *lsm->segs * (lsm->num_segs+1));
+    size_t i = lsm->num_segs++;
+    for(; i>0 && lsm->segs[i-1].seq > seg->seq; i-=1){
+	lsm->segs[i] = lsm->segs[i-1];
+    }
+    lsm->segs[i] = *seg;
+}
+
+static void requestMerge(BucketLSM* lsm);
+
+void LSMAdd(BucketLSM* lsm, const Posting* postings, const size_t num){
+    LSMSegment seg;
+    seg.file_no = newFile(lsm);
+
+    char* path = lsmPath(lsm, "seg-", seg.file_no, ".lsbi");
+    BIndexBuilder b;
+    BIndexBuilderInit(&b, path, lsm->n, lsm->func,
+		      maxBucketLabel(lsm->func, lsm->n),
+		      sizeof *postings * 2 * (num+1));
+    size_t i;
+    for(i=0; i<num; i+=1){
+	BIndexBuilderAdd(&b, postings[i].label, postings[i].id);
+    }
+    BIndexBuilderFinish(&b);
+    BIndexOpen(&seg.idx, path);
+    seg.num_postings = seg.idx.hdr->num_postings;
+    free(path);
+
+    pthread_rwlock_wrlock(&lsm->lock);
+    seg.seq = publishSeq(lsm);
+    insertSegment(lsm, &seg);
+    writeManifest(lsm);
+    pthread_rwlock_unlock(&lsm->lock);
+
+    requestMerge(lsm);
+}
+
+static int cmpSizeT(const void* a, const void* b){
+    size_t x = *(const size_t*) a, y = *(const size_t*) b;
+    return x < y ? -1 : (x > y);
+}
+
+void LSMDelete(BucketLSM* lsm, const size_t* ids, const size_t num){
+    LSMTombstones del;
+    del.file_no = newFile(lsm);
+    del.ids = malloc_harder(sizeof *del.ids * (num ? num : 1));
+    memcpy(del.ids, ids, sizeof *ids * num);
+    qsort(del.ids, num, sizeof *del.ids, cmpSizeT);
+    size_t i, j;
+    for(i=0, j=0; i<num; i+=1){
+	if(j == 0 || del.ids[i] != del.ids[j-1]) del.ids[j++] = del.ids[i];
+    }
+    del.num = j;
+
+    char* path = lsmPath(lsm, "del-", del.file_no, ".ids");
+    FILE* fout = fopen(path, "wb");
+    if(fout == NULL || fwrite(del.ids, sizeof *del.ids, del.num, fout) != del.num
+       || fclose(fout)){
+	reportLSMError(lsm->dir, "cannot write tombstones");
+    }
+    free(path);
+
+    pthread_rwlock_wrlock(&lsm->lock);
+    del.seq = publishSeq(lsm);
+    lsm->dels = realloc_harder(lsm->dels, sizeof *lsm->dels * (lsm->num_dels+1));
+    lsm->dels[lsm->num_dels++] = del;
+    writeManifest(lsm);
+    pthread_rwlock_unlock(&lsm->lock);
+
+    requestMerge(lsm);
+}
+
+static inline int isDeleted(const LSMTombstones* dels, const size_t num_dels,
+			    const size_t seq, const size_t max_seq,
+			    const size_t id){
+    size_t i;
+    for(i=0; i<num_dels; i+=1){
+	if(dels[i].seq <= seq || dels[i].seq > max_seq) continue;
+	if(bsearch(&id, dels[i].ids, dels[i].num, sizeof id, cmpSizeT)) return 1;
+    }
+    return 0;
+}
+
+size_t LSMLookup(BucketLSM* lsm, const size_t label,
+		 size_t** ids, size_t* ids_size){
+    size_t *seg_ids = NULL, seg_size = 0, num, used = 0, i, j;
+    pthread_rwlock_rdlock(&lsm->lock);
+    for(i=0; i<lsm->num_segs; i+=1){
+	num = BIndexLookup(&lsm->segs[i].idx, label, &seg_ids, &seg_size);
+	for(j=0; j<num; j+=1){
+	    if(isDeleted(lsm->dels, lsm->num_dels, lsm->segs[i].seq,
+			 (size_t) -1, seg_ids[j])) continue;
+	    if(used == *ids_size){
+		*ids_size = *ids_size ? *ids_size << 1 : 16;
+		*ids = realloc_harder(*ids, sizeof **ids * (*ids_size));
+	    }
+	    (*ids)[used++] = seg_ids[j];
+	}
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+    free(seg_ids);
+
+    qsort(*ids, used, sizeof **ids, cmpSizeT);
+    for(i=0, j=0; i<used; i+=1){
+	if(j == 0 || (*ids)[i] != (*ids)[j-1]) (*ids)[j++] = (*ids)[i];
+    }
+    return j;
+}
+
+/*
+  Write the union of the tombstones dels[0..num) as one file whose seq
+  is the newest of theirs, and return it in *del.
+*/
+static void unionTombstones(BucketLSM* lsm, const LSMTombstones* dels,
+			    const size_t num, LSMTombstones* del){
+    size_t total = 0, i, j;
+    for(i=0; i<num; i+=1){
+	total += dels[i].num;
+    }
+    del->seq = dels[num-1].seq;
+    del->file_no = newFile(lsm);
+    del->ids = malloc_harder(sizeof *del->ids * (total ? total : 1));
+    for(i=0, total=0; i<num; i+=1){
+	memcpy(del->ids + total, dels[i].ids, sizeof *del->ids * dels[i].num);
+	total += dels[i].num;
+    }
+    qsort(del->ids, total, sizeof *del->ids, cmpSizeT);
+    for(i=0, j=0; i<total; i+=1){
+	if(j == 0 || del->ids[i] != del->ids[j-1]) del->ids[j++] = del->ids[i];
+    }
+    del->num = j;
+
+    char* path = lsmPath(lsm, "del-", del->file_no, ".ids");
+    FILE* fout = fopen(path, "wb");
+    if(fout == NULL || fwrite(del->ids, sizeof *del->ids, del->num, fout) != del->num
+       || fclose(fout)){
+	reportLSMError(lsm->dir, "cannot write tombstones");
+    }
+    free(path);
+}
+
+/*
+  Replace the tombstones of the list with the file numbers of old[0..num)
+  by del (unless it is NULL), the caller holds the write lock.
+*/
+static void replaceTombstones(BucketLSM* lsm, const LSMTombstones* old,
+			      const size_t num, const LSMTombstones* del){
+    size_t i, j, k;
+    for(i=0, j=0; i<lsm->num_dels; i+=1){
+	for(k=0; k<num && lsm->dels[i].file_no != old[k].file_no; k+=1);
+	if(k == num) lsm->dels[j++] = lsm->dels[i];
+    }
+    lsm->num_dels = j;
+    if(del == NULL) return;
+    lsm->dels = realloc_harder(lsm->dels, sizeof *lsm->dels * (lsm->num_dels+1));
+    for(i=lsm->num_dels++; i>0 && lsm->dels[i-1].seq > del->seq; i-=1){
+	lsm->dels[i] = lsm->dels[i-1];
+    }
+    lsm->dels[i] = *del;
+}
+
+//free and remove the files of the tombstones dels[0..num)
+static void removeTombstones(BucketLSM* lsm, LSMTombstones* dels, const size_t num){
+    size_t i;
+    char* path;
+    for(i=0; i<num; i+=1){
+	free(dels[i].ids);
+	path = lsmPath(lsm, "del-", dels[i].file_no, ".ids");
+	unlink(path);
+	free(path);
+    }
+}
+
+//the postings of a segment in increasing order, without the deleted ones
+typedef struct {
+    const BucketIndex* idx;
+    size_t seq;
+    size_t l; //index of the current label
+    size_t* ids; //decoded ids of label l
+    size_t ids_size;
+    size_t num;
+    size_t j; //index of the current id
+    Posting cur;
+} SegCursor;
+
+static int segCursorNext(SegCursor* c, const LSMTombstones* dels,
+			 const size_t num_dels, const size_t max_seq){
+    while(1){
+	c->j += 1;
+	while(c->j >= c->num){
+	    c->l += 1;
+	    if(c->l >= c->idx->hdr->num_labels) return 0;
+	    c->num = BIndexDecode(c->idx, c->l, &c->ids, &c->ids_size);
+	    c->j = 0;
+	}
+	if(!isDeleted(dels, num_dels, c->seq, max_seq, c->ids[c->j])) break;
+    }
+    c->cur.label = c->idx->labels[c->l];
+    c->cur.id = c->ids[c->j];
+    return 1;
+}
+
+static inline int segCursorLess(const SegCursor* a, const SegCursor* b){
+    return a->cur.label < b->cur.label
+	|| (a->cur.label == b->cur.label && a->cur.id < b->cur.id);
+}
+
+static void segHeapDown(SegCursor** heap, const size_t size, size_t i){
+    size_t c;
+    SegCursor* x = heap[i];
+    while((c = (i<<1)+1) < size){
+	if(c+1 < size && segCursorLess(heap[c+1], heap[c])) c += 1;
+	if(!segCursorLess(heap[c], x)) break;
+	heap[i] = heap[c];
+	i = c;
+    }
+    heap[i] = x;
+}
+
+/*
+  Merge the segments from index st to the newest one. The caller holds
+  merge_serial; as merges are the only operation removing segments or
+  tombstones, the chosen ones stay valid without holding the lock while
+  the merged segment is written.
+
+  The segments are sorted by label, so they are merged as a stream
+  through a heap of cursors. The merged segment takes the newest seq of
+  the listed files: the files published meanwhile are newer, so their
+  tombstones still apply to it. Every listed tombstone newer than the
+  merged segments is applied to them, and then applies to exactly the
+  older segments, so they are replaced by their union, or dropped if no
+  segment is older.
+*/
+static void mergeSegments(BucketLSM* lsm, size_t st){
+    pthread_rwlock_rdlock(&lsm->lock);
+    size_t num = lsm->num_segs - st, num_dels = lsm->num_dels, i, size;
+    LSMSegment segs[num];
+    memcpy(segs, lsm->segs + st, sizeof *segs * num);
+    LSMTombstones* dels = malloc_harder(sizeof *dels * (num_dels+1));
+    memcpy(dels, lsm->dels, sizeof *dels * num_dels);
+    size_t older_seq = st ? lsm->segs[st-1].seq : 0;
+    pthread_rwlock_unlock(&lsm->lock);
+
+    LSMSegment merged;
+    merged.seq = segs[num-1].seq;
+    if(num_dels && dels[num_dels-1].seq > merged.seq) merged.seq = dels[num_dels-1].seq;
+    merged.file_no = newFile(lsm);
+
+    char* path = lsmPath(lsm, "seg-", merged.file_no, ".lsbi");
+    BIndexBuilder b;
+    BIndexBuilderInitSorted(&b, path, lsm->n, lsm->func,
+			    maxBucketLabel(lsm->func, lsm->n));
+    SegCursor cursors[num];
+    SegCursor* heap[num];
+    for(i=0, size=0; i<num; i+=1){
+	cursors[i].idx = &segs[i].idx;
+	cursors[i].seq = segs[i].seq;
+	cursors[i].l = (size_t) -1;
+	cursors[i].ids = NULL;
+	cursors[i].ids_size = cursors[i].num = cursors[i].j = 0;
+	if(segCursorNext(cursors+i, dels, num_dels, merged.seq)) heap[size++] = cursors+i;
+    }
+    for(i=size; i>0; i-=1){
+	segHeapDown(heap, size, i-1);
+    }
+    while(size > 0){
+	BIndexBuilderAdd(&b, heap[0]->cur.label, heap[0]->cur.id);
+	if(!segCursorNext(heap[0], dels, num_dels, merged.seq)) heap[0] = heap[--size];
+	if(size > 0) segHeapDown(heap, size, 0);
+    }
+    for(i=0; i<num; i+=1){
+	free(cursors[i].ids);
+    }
+    BIndexBuilderFinish(&b);
+    BIndexOpen(&merged.idx, path);
+    merged.num_postings = merged.idx.hdr->num_postings;
+    free(path);
+
+    //the tombstones applied to the merged segments
+    size_t first_del = 0;
+    while(first_del < num_dels && dels[first_del].seq <= older_seq) first_del += 1;
+    size_t num_applied = num_dels - first_del;
+    LSMTombstones* applied = dels + first_del;
+    LSMTombstones del;
+    if(st > 0 && num_applied > 1) unionTombstones(lsm, applied, num_applied, &del);
+
+    //replace the merged segments and the applied tombstones
+    pthread_rwlock_wrlock(&lsm->lock);
+    size_t j, k;
+    for(i=0, j=0; i<lsm->num_segs; i+=1){
+	for(k=0; k<num && lsm->segs[i].file_no != segs[k].file_no; k+=1);
+	if(k == num) lsm->segs[j++] = lsm->segs[i];
+    }
+    lsm->num_segs = j;
+    insertSegment(lsm, &merged);
+    if(st == 0) replaceTombstones(lsm, applied, num_applied, NULL);
+    else if(num_applied > 1) replaceTombstones(lsm, applied, num_applied, &del);
+    writeManifest(lsm);
+    pthread_rwlock_unlock(&lsm->lock);
+
+    for(i=0; i<num; i+=1){
+	BIndexClose(&segs[i].idx);
+	path = lsmPath(lsm, "seg-", segs[i].file_no, ".lsbi");
+	unlink(path);
+	free(path);
+    }
+    if(st == 0 || num_applied > 1) removeTombstones(lsm, applied, num_applied);
+    free(dels);
+}
+
+/*
+  Replace each run of tombstones between two segments (or newer than all
+  of them) by their union, as they apply to the same older segments. The
+  caller holds merge_serial.
+*/
+static void collapseTombstones(BucketLSM* lsm){
+    pthread_rwlock_rdlock(&lsm->lock);
+    size_t num_segs = lsm->num_segs, num_dels = lsm->num_dels, i, st, s;
+    size_t seqs[num_segs+1];
+    for(i=0; i<num_segs; i+=1){
+	seqs[i] = lsm->segs[i].seq;
+    }
+    seqs[num_segs] = (size_t) -1;
+    LSMTombstones* dels = malloc_harder(sizeof *dels * (num_dels+1));
+    memcpy(dels, lsm->dels, sizeof *dels * num_dels);
+    pthread_rwlock_unlock(&lsm->lock);
+
+    LSMTombstones del;
+    for(st=0, s=0; st<num_dels; st=i){
+	while(seqs[s] < dels[st].seq) s += 1;
+	for(i=st+1; i<num_dels && dels[i].seq <= seqs[s]; i+=1);
+	if(i - st < 2) continue;
+
+	unionTombstones(lsm, dels+st, i-st, &del);
+	pthread_rwlock_wrlock(&lsm->lock);
+	replaceTombstones(lsm, dels+st, i-st, &del);
+	writeManifest(lsm);
+	pthread_rwlock_unlock(&lsm->lock);
+	removeTombstones(lsm, dels+st, i-st);
+    }
+    free(dels);
+}
+
+/*
+  Size-tiered policy: if there are too many segments, merge the newest
+  ones going back while each older segment is at most LSM_FANOUT times
+  the total size of the newer ones (at least the newest two). Otherwise,
+  if there are more than max_segments tombstone files beyond one per
+  segment, collapse them. Return 1 if a merge was done.
+*/
+static int maybeMerge(BucketLSM* lsm){
+    pthread_rwlock_rdlock(&lsm->lock);
+    size_t num = lsm->num_segs, st = num, acc = 0;
+    int collapse = lsm->num_dels > num + lsm->max_segments;
+    if(num > lsm->max_segments){
+	st = num - 1;
+	acc = lsm->segs[st].num_postings;
+	while(st > 0 && lsm->segs[st-1].num_postings <= acc * LSM_FANOUT){
+	    st -= 1;
+	    acc += lsm->segs[st].num_postings;
+	}
+	if(st == num - 1) st = num - 2;
+    }
+    pthread_rwlock_unlock(&lsm->lock);
+
+    if(st >= num){
+	if(collapse) collapseTombstones(lsm);
+	return 0;
+    }
+    mergeSegments(lsm, st);
+    return 1;
+}
+
+static void* mergeLoop(void* arg){
+    BucketLSM* lsm = arg;
+    pthread_mutex_lock(&lsm->merge_lock);
+    while(1){
+	while(!lsm->merge_pending && !lsm->stop){
+	    pthread_cond_wait(&lsm->merge_cond, &lsm->merge_lock);
+	}
+	if(!lsm->merge_pending) break;
+	lsm->merge_pending = 0;
+	pthread_mutex_unlock(&lsm->merge_lock);
+	pthread_mutex_lock(&lsm->merge_serial);
+	while(maybeMerge(lsm));
+	pthread_mutex_unlock(&lsm->merge_serial);
+	pthread_mutex_lock(&lsm->merge_lock);
+    }
+    pthread_mutex_unlock(&lsm->merge_lock);
+    return NULL;
+}
+
+static void requestMerge(BucketLSM* lsm){
+    if(lsm->background){
+	pthread_mutex_lock(&lsm->merge_lock);
+	lsm->merge_pending = 1;
+	pthread_cond_signal(&lsm->merge_cond);
+	pthread_mutex_unlock(&lsm->merge_lock);
+    }else{
+	pthread_mutex_lock(&lsm->merge_serial);
+	while(maybeMerge(lsm));
+	pthread_mutex_unlock(&lsm->merge_serial);
+    }
+}
+
+void LSMCompact(BucketLSM* lsm){
+    pthread_mutex_lock(&lsm->merge_serial);
+    pthread_rwlock_rdlock(&lsm->lock);
+    int todo = lsm->num_segs > 1 || (lsm->num_segs == 1 && lsm->num_dels > 0);
+    pthread_rwlock_unlock(&lsm->lock);
+    if(todo) mergeSegments(lsm, 0);
+    pthread_mutex_unlock(&lsm->merge_serial);
+}
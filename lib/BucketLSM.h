@@ -0,0 +1,108 @@
+/*
+  An incrementally updated bucket index, in the style of a log-structured
+  merge tree, stored in a directory:
+  - MANIFEST lists the live files, it is replaced atomically by rename;
+  - seg-<file>.lsbi are immutable segments in the BucketIndex format, each
+    holding the postings added by one update (or by a merge of several);
+  - del-<file>.ids are tombstones, sorted ids removed by one update.
+  Every segment and tombstone file has a sequence number, given in the
+  order the files are published. A tombstone removes its ids from all
+  segments with smaller sequence numbers, so an id can be added back
+  later. An update only writes a file for its delta.
+
+  Queries merge the postings of all segments minus their tombstones.
+  When there are more than max_segments segments, the newest segments
+  of similar sizes are merged into one, in a background thread if
+  requested. The merge streams the sorted segments through a heap and
+  applies every tombstone newer than them, which then only apply to the
+  older segments and are replaced by their union. The tombstones between
+  two segments are likewise collapsed into one file once there are more
+  than max_segments extra ones, so a query checks at most about one
+  tombstone file per segment.
+*/
+
+#ifndef _BUCKETLSM_H
+#define _BUCKETLSM_H 1
+
+#include "util.h"
+#include "BucketIndex.h"
+#include <pthread.h>
+
+#define LSM_MANIFEST "MANIFEST"
+#define LSM_MAX_SEGMENTS 4
+//merged segments are at most this many times larger than the next newer one
+#define LSM_FANOUT 4
+
+typedef struct {
+    size_t seq;
+    size_t file_no;
+    size_t num_postings;
+    BucketIndex idx;
+} LSMSegment;
+
+typedef struct {
+    size_t seq;
+    size_t file_no;
+    size_t num;
+    size_t* ids;
+} LSMTombstones;
+
+typedef struct {
+    char* dir;
+    int n;
+    int func;
+    size_t next_seq;
+    size_t next_file;
+    LSMSegment* segs; //in increasing order of seq
+    size_t num_segs;
+    LSMTombstones* dels; //in increasing order of seq
+    size_t num_dels;
+    size_t max_segments;
+
+    pthread_rwlock_t lock; //readers: queries; writer: updating the lists and next_seq
+    pthread_mutex_t update_lock; //for next_file
+    pthread_mutex_t merge_serial; //one merge at a time
+    int background;
+    pthread_t merger;
+    pthread_mutex_t merge_lock; //for merge_pending and stop
+    pthread_cond_t merge_cond;
+    int merge_pending;
+    int stop;
+} BucketLSM;
+
+/*
+  Open the index in directory dir, creating it for n-mers bucketed by
+  func (BUCKET_FUNC_*) if it does not exist. If background is nonzero,
+  merges run in a separate thread.
+*/
+void LSMOpen(BucketLSM* lsm, const char* dir, const int n, const int func,
+	     const int background);
+
+/*
+  Wait for a running merge and close the index.
+*/
+void LSMClose(BucketLSM* lsm);
+
+/*
+  Add the postings as a new segment.
+*/
+void LSMAdd(BucketLSM* lsm, const Posting* postings, const size_t num);
+
+/*
+  Remove all the postings of the given ids added so far.
+*/
+void LSMDelete(BucketLSM* lsm, const size_t* ids, const size_t num);
+
+/*
+  The sorted distinct live ids in the bucket with the given label, see
+  BIndexLookup for the arguments.
+*/
+size_t LSMLookup(BucketLSM* lsm, const size_t label,
+		 size_t** ids, size_t* ids_size);
+
+/*
+  Merge all segments into one and drop all tombstones.
+*/
+void LSMCompact(BucketLSM* lsm);
+
+#endif // BucketLSM.h
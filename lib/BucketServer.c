@@ -0,0 +1,411 @@
+#include "BucketServer.h"
+#include "bucketing.h"
+#include "codec.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct {
+    int out_fd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_write; //seq of the next batch to be written
+} BServerConn;
+
+struct BServerBatch {
+    BServerConn* conn;
+    size_t seq;
+    char* text; //the requests, each terminated by '\0'
+    size_t text_size, text_used;
+    size_t num;
+    double start;
+    BServerBatch* next;
+};
+
+typedef struct {
+    int fd;
+    char buf[1<<16];
+    size_t st, ed;
+} LineReader;
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//append the next line (without '\n') and a '\0' to the batch,
+//return its length, or -1 at the end of input
+static ssize_t readLine(LineReader* r, BServerBatch* b){
+    size_t st = b->text_used;
+    ssize_t got;
+    char c;
+    while(1){
+	if(r->st == r->ed){
+	    got = read(r->fd, r->buf, sizeof r->buf);
+	    if(got <= 0){
+		if(b->text_used == st) return -1;
+		break; //last line without '\n'
+	    }
+	    r->st = 0;
+	    r->ed = got;
+	}
+	c = r->buf[r->st++];
+	if(c == '\n') break;
+	if(c == '\r') continue;
+	if(b->text_used + 1 >= b->text_size){
+	    b->text_size = b->text_size ? b->text_size << 1 : 4096;
+	    b->text = realloc_harder(b->text, b->text_size);
+	}
+	b->text[b->text_used++] = c;
+    }
+    if(b->text_used + 1 >= b->text_size){
+	b->text_size = b->text_size ? b->text_size << 1 : 4096;
+	b->text = realloc_harder(b->text, b->text_size);
+    }
+    b->text[b->text_used++] = '\0';
+    return b->text_used - st - 1;
+}
+
+static int inputReady(LineReader* r){
+    if(r->st < r->ed) return 1;
+    struct pollfd p = {r->fd, POLLIN, 0};
+    return poll(&p, 1, 0) > 0;
+}
+
+static void writeAll(int fd, const char* buf, size_t len){
+    ssize_t done;
+    while(len > 0){
+	done = write(fd, buf, len);
+	if(done <= 0) return; //the client is gone
+	buf += done;
+	len -= done;
+    }
+}
+
+static int cmpSizeT(const void* a, const void* b){
+    size_t x = *(const size_t*) a, y = *(const size_t*) b;
+    return x < y ? -1 : (x > y);
+}
+
+//per worker buffers
+typedef struct {
+    size_t* ids;
+    size_t ids_size;
+    size_t* all;
+    size_t all_size;
+    kmer* xs; //the n-mers of a sequence
+    size_t xs_size;
+} BServerScratch;
+
+//the field of the response for the n-mer x
+static void answerNMer(BucketServer* s, BServerScratch* w, const kmer x,
+		       FILE* out, size_t* postings){
+    const BucketIndex* idx = s->idx;
+    int n = idx->hdr->n;
+    int verify = s->max_d >= 0 && idx->hdr->num_kmers > 0;
+    size_t buckets[n], i, num, used = 0;
+    int j, num_buckets, d;
+    num_buckets = assignBucketsWith64(idx->hdr->func, x, n, buckets, 0);
+    for(j=0; j<num_buckets; j+=1){
+	num = BIndexLookup(idx, buckets[j], &w->ids, &w->ids_size);
+	if(used + num > w->all_size){
+	    w->all_size = (used + num) << 1;
+	    w->all = realloc_harder(w->all, sizeof *w->all * w->all_size);
+	}
+	memcpy(w->all + used, w->ids, sizeof *w->ids * num);
+	used += num;
+    }
+    *postings += used;
+    qsort(w->all, used, sizeof *w->all, cmpSizeT);
+
+    for(i=0, j=0; i<used; i+=1){
+	if(i > 0 && w->all[i] == w->all[i-1]) continue;
+	if(verify){
+	    if(w->all[i] >= idx->hdr->num_kmers) continue;
+	    d = editDist2(idx->kmers[w->all[i]], n, x, n, s->max_d+1);
+	    if(d > s->max_d) continue;
+	    fprintf(out, j++ ? ",%zu:%d" : "%zu:%d", w->all[i], d);
+	}else{
+	    fprintf(out, j++ ? ",%zu" : "%zu", w->all[i]);
+	}
+    }
+}
+
+//the fields of the n-mers with a non-base (see codec.h) are empty
+static void answerSequence(BucketServer* s, BServerScratch* w, const char* seq,
+			   FILE* out, size_t* postings){
+    size_t n = s->idx->hdr->n, len = strlen(seq), pos, st, ed;
+    if(w->xs_size < len){
+	w->xs_size = len;
+	w->xs = realloc_harder(w->xs, sizeof *w->xs * w->xs_size);
+    }
+    for(st=0; st+n<=len; st=ed+1){
+	ed = st + encodeKMers(seq+st, len-st, n, w->xs+st);
+	for(pos=st; pos+n<=len && pos<=ed; pos+=1){
+	    if(pos) putc('\t', out);
+	    if(pos+n <= ed) answerNMer(s, w, w->xs[pos], out, postings);
+	}
+    }
+    putc('\n', out);
+}
+
+/*
+  The bucket of a latency in seconds: 0 below 1us, then for 2^e <= us <
+  2^(e+1), 1 + e*BSERVER_LAT_SUB plus the sub-bucket of equal width.
+*/
+static int latencyBucket(const double latency){
+    double us = latency * 1e6;
+    if(us < 1) return 0;
+    int e;
+    double m = frexp(us, &e); //us = m*2^e, m in [0.5, 1)
+    int i = 1 + (e-1) * BSERVER_LAT_SUB + (int) ((2*m - 1) * BSERVER_LAT_SUB);
+    return i < BSERVER_LAT_BUCKETS ? i : BSERVER_LAT_BUCKETS - 1;
+}
+
+//the upper end of a bucket, in seconds
+static double latencyBucketEnd(const int i){
+    if(i == 0) return 1e-6;
+    int e = (i-1) / BSERVER_LAT_SUB, sub = (i-1) % BSERVER_LAT_SUB;
+    return ldexp(1 + (double) (sub+1) / BSERVER_LAT_SUB, e) * 1e-6;
+}
+
+static void processBatch(BucketServer* s, BServerScratch* w, BServerBatch* b){
+    char* res = NULL;
+    size_t res_len = 0, i, j, num, postings = 0;
+    FILE* out = open_memstream(&res, &res_len);
+    const char* line = b->text;
+    for(i=0; i<b->num; i+=1, line+=strlen(line)+1){
+	if(line[0] == '@'){
+	    num = BIndexLookup(s->idx, strtoul(line+1, NULL, 10),
+			       &w->ids, &w->ids_size);
+	    qsort(w->ids, num, sizeof *w->ids, cmpSizeT);
+	    postings += num;
+	    for(j=0; j<num; j+=1){
+		fprintf(out, j ? ",%zu" : "%zu", w->ids[j]);
+	    }
+	    putc('\n', out);
+	}else if(strcmp(line, "!stats") == 0){
+	    BServerPrintStats(s, out);
+	}else{
+	    answerSequence(s, w, line, out, &postings);
+	}
+    }
+    fclose(out);
+
+    //write the responses in the order of the batches
+    BServerConn* conn = b->conn;
+    pthread_mutex_lock(&conn->lock);
+    while(conn->next_write != b->seq){
+	pthread_cond_wait(&conn->cond, &conn->lock);
+    }
+    writeAll(conn->out_fd, res, res_len);
+    conn->next_write += 1;
+    pthread_cond_broadcast(&conn->cond);
+    pthread_mutex_unlock(&conn->lock);
+    free(res);
+
+    double latency = seconds() - b->start;
+    int bucket = latencyBucket(latency);
+    pthread_mutex_lock(&s->lock);
+    s->requests += b->num;
+    s->postings += postings;
+    s->batches += 1;
+    s->latency_counts[bucket] += 1;
+    if(latency > s->max_latency) s->max_latency = latency;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void* workerLoop(void* arg){
+    BucketServer* s = arg;
+    BServerScratch w = {NULL, 0, NULL, 0, NULL, 0};
+    BServerBatch* b;
+    while(1){
+	pthread_mutex_lock(&s->lock);
+	while(s->head == NULL && !s->stop){
+	    pthread_cond_wait(&s->cond, &s->lock);
+	}
+	if(s->head == NULL){
+	    pthread_mutex_unlock(&s->lock);
+	    break;
+	}
+	b = s->head;
+	s->head = b->next;
+	if(s->head == NULL) s->tail = NULL;
+	pthread_mutex_unlock(&s->lock);
+
+	processBatch(s, &w, b);
+	free(b->text);
+	free(b);
+    }
+    free(w.ids);
+    free(w.all);
+    free(w.xs);
+    return NULL;
+}
+
+void BServerInit(BucketServer* s, const BucketIndex* idx, int num_workers,
+		 size_t batch_size, int max_d){
+    s->idx = idx;
+    s->max_d = max_d;
+    s->batch_size = batch_size ? batch_size : 1;
+    s->head = s->tail = NULL;
+    s->stop = 0;
+    s->requests = s->batches = s->postings = 0;
+    memset(s->latency_counts, 0, sizeof s->latency_counts);
+    s->max_latency = 0;
+    s->start = seconds();
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    s->num_workers = num_workers > 0 ? num_workers : 1;
+    s->workers = malloc_harder(sizeof *s->workers * s->num_workers);
+    int i;
+    for(i=0; i<s->num_workers; i+=1){
+	pthread_create(s->workers+i, NULL, workerLoop, s);
+    }
+}
+
+void BServerFree(BucketServer* s){
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    int i;
+    for(i=0; i<s->num_workers; i+=1){
+	pthread_join(s->workers[i], NULL);
+    }
+    free(s->workers);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+}
+
+static void submitBatch(BucketServer* s, BServerBatch* b){
+    b->next = NULL;
+    pthread_mutex_lock(&s->lock);
+    if(s->tail) s->tail->next = b;
+    else s->head = b;
+    s->tail = b;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void BServerServe(BucketServer* s, int in_fd, int out_fd){
+    BServerConn conn;
+    conn.out_fd = out_fd;
+    conn.next_write = 0;
+    pthread_mutex_init(&conn.lock, NULL);
+    pthread_cond_init(&conn.cond, NULL);
+
+    LineReader* r = malloc_harder(sizeof *r);
+    r->fd = in_fd;
+    r->st = r->ed = 0;
+
+    size_t seq = 0;
+    ssize_t len = 0;
+    BServerBatch* b;
+    while(len >= 0){
+	b = calloc_harder(1, sizeof *b);
+	b->conn = &conn;
+	while(b->num < s->batch_size){
+	    len = readLine(r, b);
+	    if(len < 0) break;
+	    if(len == 0){
+		//an empty line cuts the batch
+		b->text_used -= 1;
+		break;
+	    }
+	    if(b->num == 0) b->start = seconds();
+	    b->num += 1;
+	    if(!inputReady(r)) break;
+	}
+	if(b->num == 0){
+	    free(b->text);
+	    free(b);
+	    continue;
+	}
+	b->seq = seq++;
+	submitBatch(s, b);
+    }
+
+    //wait for all the responses to be written
+    pthread_mutex_lock(&conn.lock);
+    while(conn.next_write != seq){
+	pthread_cond_wait(&conn.cond, &conn.lock);
+    }
+    pthread_mutex_unlock(&conn.lock);
+    pthread_mutex_destroy(&conn.lock);
+    pthread_cond_destroy(&conn.cond);
+    free(r);
+}
+
+typedef struct {
+    BucketServer* s;
+    int fd;
+} BServerClient;
+
+static void* clientLoop(void* arg){
+    BServerClient* c = arg;
+    BServerServe(c->s, c->fd, c->fd);
+    close(c->fd);
+    BServerPrintStats(c->s, stderr);
+    free(c);
+    return NULL;
+}
+
+int BServerListen(BucketServer* s, const char* path){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+    unlink(path);
+    if(fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof addr)
+       || listen(fd, 64)){
+	fprintf(stderr, "error listening on socket %s\n", path);
+	return 1;
+    }
+
+    pthread_t tid;
+    BServerClient* c;
+    int client;
+    while((client = accept(fd, NULL, NULL)) >= 0){
+	c = malloc_harder(sizeof *c);
+	c->s = s;
+	c->fd = client;
+	pthread_create(&tid, NULL, clientLoop, c);
+	pthread_detach(tid);
+    }
+    close(fd);
+    return 1;
+}
+
+void BServerPrintStats(BucketServer* s, FILE* f){
+    size_t counts[BSERVER_LAT_BUCKETS];
+    pthread_mutex_lock(&s->lock);
+    size_t num = s->batches;
+    memcpy(counts, s->latency_counts, sizeof counts);
+    double max_latency = s->max_latency;
+    size_t requests = s->requests, postings = s->postings;
+    double elapsed = seconds() - s->start;
+    pthread_mutex_unlock(&s->lock);
+
+    //the bucket of the k-th smallest latency, capped by the maximum
+    double p[4] = {0, 0, 0, 0}, q[3] = {0.5, 0.9, 0.99};
+    size_t k, cum;
+    int i, j;
+    for(i=0; i<3 && num; i+=1){
+	k = q[i] * (num - 1) + 0.5;
+	for(j=0, cum=counts[0]; cum <= k; cum+=counts[++j]);
+	p[i] = fmin(latencyBucketEnd(j), max_latency) * 1e3;
+    }
+    p[3] = max_latency * 1e3;
+    fprintf(f, "{\"requests\": %zu, \"batches\": %zu, \"postings\": %zu, "
+	    "\"requests_per_s\": %.1f, \"latency_ms\": {\"p50\": %.3f, "
+	    "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}\n",
+	    requests, num, postings, elapsed > 0 ? requests / elapsed : 0.0,
+	    p[0], p[1], p[2], p[3]);
+}
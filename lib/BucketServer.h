@@ -0,0 +1,88 @@
+/*
+  A long-running query server over a memory-mapped BucketIndex.
+
+  Requests are lines of text read from a stream (standard input, a pipe
+  or a Unix domain socket connection); each request gets exactly one
+  response line, in the same order:
+  - a sequence: every n-mer of it is bucketed with the function the index
+    was built with, and the response holds one tab-separated field per
+    n-mer, each a comma-separated list of the distinct ids sharing a
+    bucket with it (empty for an n-mer with a character other than A,
+    C, G, T). If max_d >= 0 and the index stores its k-mers, only
+    ids within edit distance max_d are kept, written as id:distance;
+  - @label: the ids in the bucket with that label, separated by commas;
+  - !stats: the statistics of the server so far (see BServerPrintStats).
+  Lines are grouped into batches of up to batch_size lines, a batch is
+  cut early when no more input is immediately available or at an empty
+  line (which gets no response). Batches are processed by a pool of
+  worker threads; the responses of each stream are written in order.
+*/
+
+#ifndef _BUCKETSERVER_H
+#define _BUCKETSERVER_H 1
+
+#include "util.h"
+#include "BucketIndex.h"
+#include <pthread.h>
+
+typedef struct BServerBatch BServerBatch;
+
+//the histogram of batch latencies has BSERVER_LAT_SUB buckets per power
+//of 2 of microseconds, from 1us to about 71 minutes
+#define BSERVER_LAT_SUB 8
+#define BSERVER_LAT_BUCKETS (1 + 32*BSERVER_LAT_SUB)
+
+typedef struct {
+    const BucketIndex* idx;
+    int max_d;
+    size_t batch_size;
+
+    int num_workers;
+    pthread_t* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    BServerBatch* head; //queue of batches to process
+    BServerBatch* tail;
+    int stop;
+
+    //statistics, protected by lock
+    size_t requests;
+    size_t batches;
+    size_t postings;
+    size_t latency_counts[BSERVER_LAT_BUCKETS]; //batches per latency bucket
+    double max_latency; //in seconds
+    double start;
+} BucketServer;
+
+/*
+  Start num_workers worker threads answering queries on idx.
+*/
+void BServerInit(BucketServer* s, const BucketIndex* idx, int num_workers,
+		 size_t batch_size, int max_d);
+
+/*
+  Stop the workers and free the server (the index is not closed).
+*/
+void BServerFree(BucketServer* s);
+
+/*
+  Answer the requests read from in_fd on out_fd until end of input.
+  Several streams can be served at the same time from different threads.
+*/
+void BServerServe(BucketServer* s, int in_fd, int out_fd);
+
+/*
+  Accept connections on a Unix domain socket at path, each served by
+  BServerServe in its own thread. Never returns unless an error occurs.
+*/
+int BServerListen(BucketServer* s, const char* path);
+
+/*
+  Print the number of requests and batches, the throughput and the
+  percentiles of the batch latencies as one line of JSON. The
+  percentiles are the upper ends of their histogram buckets, so they
+  are over by at most 1/BSERVER_LAT_SUB; the maximum is exact.
+*/
+void BServerPrintStats(BucketServer* s, FILE* f);
+
+#endif // BucketServer.h
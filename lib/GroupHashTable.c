@@ -0,0 +1,217 @@
+#include "GroupHashTable.h"
+#include "metrics.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//control bytes: a full slot holds the low 7 bits of the hash of its key
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+
+//the finalizer of MurmurHash3, every bit of enc affects every bit of the hash
+static inline uint64_t GHTableHash(kmer enc){
+    uint64_t h = enc;
+#if KMER_BITS == 128
+    h ^= (uint64_t) (enc >> 64) * 0x9e3779b97f4a7c15lu;
+#endif
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdlu;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53lu;
+    h ^= h >> 33;
+    return h;
+}
+
+//bit i is set if the i-th control byte of the group equals b
+static inline unsigned matchByte(const uint8_t* group, uint8_t b){
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b)));
+#else
+    unsigned mask = 0, i;
+    for(i=0; i<GHTABLE_GROUP; i+=1){
+	mask |= (unsigned) (group[i] == b) << i;
+    }
+    return mask;
+#endif
+}
+
+//bit i is set if the i-th slot of the group is empty or deleted
+static inline unsigned matchFree(const uint8_t* group){
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+    unsigned mask = 0, i;
+    for(i=0; i<GHTABLE_GROUP; i+=1){
+	mask |= (unsigned) (group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+//number of slots needed to hold num k-mers under the load factor
+static size_t slotsFor(size_t num){
+    size_t size = GHTABLE_GROUP;
+    while(size / GHTABLE_LOAD_DEN * GHTABLE_LOAD_NUM < num) size <<= 1;
+    return size;
+}
+
+static void allocSlots(GroupHashTable* table, size_t size){
+    table->ctrl = malloc_harder(size);
+    memset(table->ctrl, CTRL_EMPTY, size);
+    table->arr = malloc_harder(sizeof *table->arr * size);
+    table->size = size;
+    table->used = 0;
+    table->deleted = 0;
+}
+
+void GHTableInit(GroupHashTable* table){
+    allocSlots(table, 64);
+}
+
+void GHTableInitSize(GroupHashTable* table, size_t size){
+    allocSlots(table, slotsFor(size));
+}
+
+void GHTableFree(GroupHashTable* table){
+    free(table->ctrl);
+    free(table->arr);
+    table->ctrl = NULL;
+    table->arr = NULL;
+    table->size = 0;
+    table->used = 0;
+    table->deleted = 0;
+}
+
+void GHTableClear(GroupHashTable* table){
+    memset(table->ctrl, CTRL_EMPTY, table->size);
+    table->used = 0;
+    table->deleted = 0;
+}
+
+//count a lookup that checked probe groups
+static inline void countProbe(const size_t probe){
+    METRIC_INC(METRIC_HTABLE_LOOKUPS);
+    METRIC_ADD(METRIC_HTABLE_PROBES, probe);
+    METRIC_MAX(METRIC_HTABLE_MAX_PROBE, probe);
+}
+
+//the slot of enc, or table->size if it is not in the table
+static inline size_t GHTableFind(const GroupHashTable* table, kmer enc){
+    uint64_t h = GHTableHash(enc);
+    size_t mask = table->size / GHTABLE_GROUP - 1;
+    size_t g = (h >> 7) & mask, i, base;
+    unsigned match;
+    for(i=1; ; i+=1){
+	base = g * GHTABLE_GROUP;
+	match = matchByte(table->ctrl + base, h & 0x7f);
+	while(match){
+	    if(table->arr[base + __builtin_ctz(match)] == enc){
+		countProbe(i);
+		return base + __builtin_ctz(match);
+	    }
+	    match &= match - 1;
+	}
+	//a group with an empty slot ends every probe sequence through it
+	if(matchByte(table->ctrl + base, CTRL_EMPTY)){
+	    countProbe(i);
+	    return table->size;
+	}
+	g = (g + i) & mask;
+    }
+}
+
+//put enc (not in the table) into the first free slot of its probe sequence
+static inline void GHTablePlace(GroupHashTable* table, kmer enc){
+    uint64_t h = GHTableHash(enc);
+    size_t mask = table->size / GHTABLE_GROUP - 1;
+    size_t g = (h >> 7) & mask, i, pos;
+    unsigned match;
+    for(i=1; !(match = matchFree(table->ctrl + g * GHTABLE_GROUP)); i+=1){
+	g = (g + i) & mask;
+    }
+    pos = g * GHTABLE_GROUP + __builtin_ctz(match);
+    if(table->ctrl[pos] == CTRL_DELETED) table->deleted -= 1;
+    table->ctrl[pos] = h & 0x7f;
+    table->arr[pos] = enc;
+    table->used += 1;
+}
+
+static void GHTableRehash(GroupHashTable* table, size_t size){
+    uint8_t* old_ctrl = table->ctrl;
+    kmer* old_arr = table->arr;
+    size_t old_size = table->size, i;
+    METRIC_INC(METRIC_HTABLE_RESIZES);
+    allocSlots(table, size);
+    for(i=0; i<old_size; i+=1){
+	if(!(old_ctrl[i] & 0x80)) GHTablePlace(table, old_arr[i]);
+    }
+    free(old_ctrl);
+    free(old_arr);
+}
+
+void GHTableReserve(GroupHashTable* table, size_t num){
+    size_t size = slotsFor(num);
+    if(size > table->size) GHTableRehash(table, size);
+}
+
+int GHTableInsert(GroupHashTable* table, kmer enc){
+    if(GHTableFind(table, enc) < table->size) return 0;
+    if(table->used + table->deleted + 1 >
+       table->size / GHTABLE_LOAD_DEN * GHTABLE_LOAD_NUM){
+	//grow unless most of the load is tombstones
+	GHTableRehash(table, table->used + 1 > table->size / GHTABLE_LOAD_DEN *
+		      GHTABLE_LOAD_NUM / 2 ? table->size << 1 : table->size);
+    }
+    GHTablePlace(table, enc);
+    return 1;
+}
+
+int GHTableSearch(const GroupHashTable* table, kmer enc){
+    return GHTableFind(table, enc) < table->size;
+}
+
+int GHTableDelete(GroupHashTable* table, kmer enc){
+    size_t pos = GHTableFind(table, enc);
+    if(pos == table->size) return 0;
+    size_t base = pos / GHTABLE_GROUP * GHTABLE_GROUP;
+    //no probe sequence goes past a group with an empty slot, so the slot
+    //can be emptied instead of leaving a tombstone
+    if(matchByte(table->ctrl + base, CTRL_EMPTY)){
+	table->ctrl[pos] = CTRL_EMPTY;
+    }else{
+	table->ctrl[pos] = CTRL_DELETED;
+	table->deleted += 1;
+    }
+    table->used -= 1;
+    return 1;
+}
+
+kmer* GHTableToArray(const GroupHashTable* table, kmer* list){
+    if(list == NULL){
+	list = malloc_harder(sizeof *list * (table->used ? table->used : 1));
+    }
+
+    size_t i, j = 0;
+    for(i=0; i<table->size; i+=1){
+	if(!(table->ctrl[i] & 0x80)) list[j++] = table->arr[i];
+    }
+    return list;
+}
+
+void GHTableProbeStats(const GroupHashTable* table, double* avg, size_t* max){
+    size_t mask = table->size / GHTABLE_GROUP - 1;
+    size_t i, g, probes, total = 0;
+    *max = 0;
+    for(i=0; i<table->size; i+=1){
+	if(table->ctrl[i] & 0x80) continue;
+	g = (GHTableHash(table->arr[i]) >> 7) & mask;
+	for(probes=1; g != i / GHTABLE_GROUP; probes+=1){
+	    g = (g + probes) & mask;
+	}
+	total += probes;
+	if(probes > *max) *max = probes;
+    }
+    *avg = table->used ? (double) total / table->used : 0;
+}
@@ -0,0 +1,87 @@
+/*
+  An open addressing hashtable for k-mers (kmer) in the style
+  of Swiss tables, with the same interface as HashTable plus deletion.
+
+  Keys are hashed by a 64-bit mixing function (all bits of a k-mer affect
+  the slot, unlike enc % size), the high bits choose a group of
+  GHTABLE_GROUP slots and the low 7 bits are kept in a control byte per
+  slot. A lookup compares the control bytes of a whole group at once
+  (with SSE2 if available) and only checks the keys whose bytes match,
+  moving to the next group (by triangular probing) only if the group has
+  no empty slot. This keeps lookups short at a load factor of up to 7/8.
+*/
+
+#ifndef _GROUPHASHTABLE_H
+#define _GROUPHASHTABLE_H 1
+
+#include "util.h"
+#include <stdint.h>
+
+#define GHTABLE_GROUP 16
+//grow when (used + deleted) exceeds size * GHTABLE_LOAD_NUM / GHTABLE_LOAD_DEN
+#define GHTABLE_LOAD_NUM 7
+#define GHTABLE_LOAD_DEN 8
+
+typedef struct {
+    uint8_t* ctrl; //one control byte per slot
+    kmer* arr;
+    size_t size; //number of slots, a power of 2 and a multiple of GHTABLE_GROUP
+    size_t used;
+    size_t deleted; //slots with a tombstone
+} GroupHashTable;
+
+/*
+  Initialize a hashtable with size 64.
+*/
+void GHTableInit(GroupHashTable* table);
+
+/*
+  Initialize a hashtable that holds at least the given number of k-mers
+  without resizing.
+*/
+void GHTableInitSize(GroupHashTable* table, size_t size);
+
+/*
+  Free the entire table.
+*/
+void GHTableFree(GroupHashTable* table);
+
+/*
+  Make room for at least num k-mers in total without further resizing.
+*/
+void GHTableReserve(GroupHashTable* table, size_t num);
+
+/*
+  Remove all k-mers, keeping the allocated slots.
+*/
+void GHTableClear(GroupHashTable* table);
+
+/*
+  Insert a k-mer into the table, resizing it if the load factor would be
+  exceeded. Return 1 if it was added, 0 if it was already in the table.
+*/
+int GHTableInsert(GroupHashTable* table, kmer enc);
+
+/*
+  Search in the table for the given k-mer. Return 1 if found, 0 otherwise.
+*/
+int GHTableSearch(const GroupHashTable* table, kmer enc);
+
+/*
+  Delete the given k-mer. Return 1 if it was in the table, 0 otherwise.
+*/
+int GHTableDelete(GroupHashTable* table, kmer enc);
+
+/*
+  Dump everything in the table to an array, if list is NULL, a new
+  array will be allocated.
+*/
+kmer* GHTableToArray(const GroupHashTable* table, kmer* list);
+
+/*
+  Probe lengths of the k-mers in the table, i.e., the number of groups
+  checked by a successful search: their average and maximum.
+*/
+void GHTableProbeStats(const GroupHashTable* table, double* avg, size_t* max);
+
+#endif // GroupHashTable.h
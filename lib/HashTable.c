@@ -1,4 +1,5 @@
 #include "HashTable.h"
+#include "metrics.h"
 
 void HTableInit(HashTable* table){
     HTableInitSize(table, 64);
@@ -21,28 +22,35 @@ void HTableFree(HashTable* table){
 //existance of such a position is guaranteed by the load factor
 //if found value along the way, return that position
 static inline size_t HTableProbe(HashTable* table, size_t cur_index,
-				 long unsigned value){
-    while(table->arr[cur_index] != 0 && table->arr[cur_index] != value){
-	cur_index += 1;
-	if(cur_index >= table->size) cur_index = 0;
+				 kmer value){
+    size_t i = cur_index;
+    while(table->arr[i] != 0 && table->arr[i] != value){
+	i += 1;
+	if(i >= table->size) i = 0;
     }
-    return cur_index;
+#ifdef LSB_METRICS
+    size_t probe = (i + table->size - cur_index) % table->size + 1;
+    METRIC_INC(METRIC_HTABLE_LOOKUPS);
+    METRIC_ADD(METRIC_HTABLE_PROBES, probe);
+    METRIC_MAX(METRIC_HTABLE_MAX_PROBE, probe);
+#endif
+    return i;
 }
 
 //the hash function
-static inline void HTableHash(const size_t size, long unsigned enc, size_t* key, long unsigned* value){
+static inline void HTableHash(const size_t size, kmer enc, size_t* key, kmer* value){
     *key = enc % size;
     *value = enc + 1;
 }
-static inline void HTableUnhash(long unsigned value, long unsigned* enc){
+static inline void HTableUnhash(kmer value, kmer* enc){
     *enc = value - 1 ;
 }
 
 //add enc to table without checking load factor and incrementing used
 //return 1 if added, return 0 if (key, value) is already in table
-static inline int HTableAdd(HashTable* table, long unsigned enc){
+static inline int HTableAdd(HashTable* table, kmer enc){
     size_t key;
-    unsigned long value;
+    kmer value;
     HTableHash(table->size, enc, &key, &value);
     size_t pos = HTableProbe(table, key, value);
     if(table->arr[pos] == 0){
@@ -54,13 +62,14 @@ static inline int HTableAdd(HashTable* table, long unsigned enc){
 }
 
 void HTableResize(HashTable* table, size_t size){
-    long unsigned* old_arr = table -> arr;
+    kmer* old_arr = table -> arr;
     size_t old_size = table -> size;
+    METRIC_INC(METRIC_HTABLE_RESIZES);
     table->arr = calloc_harder(size, sizeof *table->arr);
     table->size = size;
 
     size_t i;
-    unsigned long enc;
+    kmer enc;
     for(i=0; i<old_size; i+=1){
 	if(old_arr[i]){
 	    HTableUnhash(old_arr[i], &enc);
@@ -72,28 +81,28 @@ void HTableResize(HashTable* table, size_t size){
 }
 
 
-void HTableInsert(HashTable* table, long unsigned enc){
+void HTableInsert(HashTable* table, kmer enc){
     if(table->size < (table->used << 1)){
-        HTableResize(table, table->size<<1);
+	HTableResize(table, table->size<<1);
     }
     if(HTableAdd(table, enc)) table->used += 1;
 }
 
-int HTableSearch(HashTable* table, long unsigned enc){
+int HTableSearch(HashTable* table, kmer enc){
     size_t key;
-    unsigned long value;
+    kmer value;
     HTableHash(table->size, enc, &key, &value);
     if(table->arr[HTableProbe(table, key, value)] == 0) return 0;
     else return 1;
 }
 
-long unsigned* HTableToArray(HashTable* table, long unsigned* list){
+kmer* HTableToArray(HashTable* table, kmer* list){
     if(list == NULL){
 	list = malloc_harder(sizeof *list *table->used);
     }
 
     int i, j=0;
-    long unsigned cur, enc;
+    kmer cur, enc;
     for(i=0; i<table->size; i+=1){
 	cur = table->arr[i];
 	if(cur != 0){
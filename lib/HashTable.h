@@ -1,5 +1,5 @@
 /*
-  A dynamic array based hashtable for k-mers (long unsigned int) with 
+  A dynamic array based hashtable for k-mers (kmer) with
   linear probing. Deletion is not implemented.
   By Ke@PSU
   Last modified: 10/16/2021
@@ -12,7 +12,7 @@
 //#include <stdlib.h>
 
 typedef struct {
-    long unsigned* arr;
+    kmer* arr;
     size_t size;
     size_t used;
 } HashTable;
@@ -33,7 +33,7 @@ void HTableInitSize(HashTable* table, size_t size);
 void HTableFree(HashTable* table);
 
 /*
-  Insert a new k-mer into the table. The k-mer itself (long unsigned int % size)
+  Insert a new k-mer into the table. The k-mer itself (enc % size)
   is used as the key, k-mer+1 is stored as the value (so 0 can be used to
   indicate an empty space). If position is taken, probe the next index in a circular
   manner. 
@@ -41,18 +41,18 @@ void HTableFree(HashTable* table);
   If size/used < 2, size of the table will be doubled (and all the entries
   rehashed) before the insertion.
 */
-void HTableInsert(HashTable* table, long unsigned enc);
+void HTableInsert(HashTable* table, kmer enc);
 
 /*
   Search in the table for the given k-mer. (See HTableInsert for hashing and
   probing details.) Return 1 if found, 0 otherwise.
  */
-int HTableSearch(HashTable* table, long unsigned enc);
+int HTableSearch(HashTable* table, kmer enc);
 
 /*
   Dump everything in the table to an ArrayList, if list is NULL, a new
   list will be allocated.
 */
-long unsigned* HTableToArray(HashTable* table, long unsigned* list);
+kmer* HTableToArray(HashTable* table, kmer* list);
 
 #endif // HashTable.h
@@ -0,0 +1,113 @@
+#include "KmerVec.h"
+#include <string.h>
+
+//buckets smaller than this are finished by insertion sort
+#define KVEC_SORT_CUTOFF 64
+
+void KVecInit(KmerVec* v){
+    KVecInitSize(v, 16);
+}
+
+void KVecInitSize(KmerVec* v, size_t size){
+    v->arr = malloc_harder(sizeof *v->arr * (size ? size : 1));
+    v->size = size ? size : 1;
+    v->used = 0;
+}
+
+void KVecFree(KmerVec* v){
+    free(v->arr);
+    v->arr = NULL;
+    v->size = 0;
+    v->used = 0;
+}
+
+void KVecReserve(KmerVec* v, size_t size){
+    if(size <= v->size) return;
+    v->arr = realloc_harder(v->arr, sizeof *v->arr * size);
+    v->size = size;
+}
+
+void KVecAppend(KmerVec* v, const kmer* xs, size_t num){
+    if(v->used + num > v->size){
+	size_t size = v->size ? v->size : 16;
+	while(size < v->used + num) size <<= 1;
+	KVecReserve(v, size);
+    }
+    memcpy(v->arr + v->used, xs, sizeof *xs * num);
+    v->used += num;
+}
+
+void KVecSwap(KmerVec* va, KmerVec* vb){
+    KmerVec tmp = *va;
+    *va = *vb;
+    *vb = tmp;
+}
+
+static void insertionSort(kmer* a, size_t num){
+    size_t i, j;
+    kmer x;
+    for(i=1; i<num; i+=1){
+	x = a[i];
+	for(j=i; j>0 && a[j-1]>x; j-=1) a[j] = a[j-1];
+	a[j] = x;
+    }
+}
+
+//sort a by the byte at shift and recurse on the lower bytes
+static void flagSort(kmer* a, size_t num, int shift){
+    if(num < KVEC_SORT_CUTOFF){
+	insertionSort(a, num);
+	return;
+    }
+
+    size_t count[256] = {0}, next[256], end[256], i;
+    int b, d;
+    for(i=0; i<num; i+=1){
+	count[(a[i] >> shift) & 0xff] += 1;
+    }
+    for(b=0, i=0; b<256; b+=1){
+	next[b] = i;
+	i += count[b];
+	end[b] = i;
+    }
+
+    //move each k-mer to its bucket by following cycles of swaps
+    kmer x, tmp;
+    for(b=0; b<256; b+=1){
+	while(next[b] < end[b]){
+	    x = a[next[b]];
+	    d = (x >> shift) & 0xff;
+	    while(d != b){
+		tmp = a[next[d]];
+		a[next[d]++] = x;
+		x = tmp;
+		d = (x >> shift) & 0xff;
+	    }
+	    a[next[b]++] = x;
+	}
+    }
+
+    if(shift == 0) return;
+    for(b=0, i=0; b<256; i+=count[b], b+=1){
+	if(count[b] > 1) flagSort(a+i, count[b], shift-8);
+    }
+}
+
+void KVecSort(KmerVec* v){
+    kmer all = 0;
+    size_t i;
+    for(i=0; i<v->used; i+=1) all |= v->arr[i];
+    //start from the highest byte that is not 0 in any k-mer
+    int shift = 0;
+    while(shift < (int) sizeof(kmer)*8 - 8 && (all >> (shift+8))) shift += 8;
+    flagSort(v->arr, v->used, shift);
+}
+
+size_t KVecUnique(KmerVec* v){
+    size_t i, j;
+    for(i=0, j=0; i<v->used; i+=1){
+	if(j == 0 || v->arr[i] != v->arr[j-1]) v->arr[j++] = v->arr[i];
+    }
+    v->used = j;
+    return j;
+}
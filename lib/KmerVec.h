@@ -0,0 +1,76 @@
+/*
+  A dynamic array of k-mers stored by value (unlike ArrayList, which
+  stores void*), with bulk append and in-place sorting.
+*/
+
+#ifndef _KMERVEC_H
+#define _KMERVEC_H 1
+
+#include "util.h" //use alloc_harder family
+
+typedef struct {
+    kmer* arr;
+    size_t size;
+    size_t used;
+} KmerVec;
+
+/*
+  Initialize an array to size 16.
+*/
+void KVecInit(KmerVec* v);
+
+/*
+  Initialize an array to the given size.
+*/
+void KVecInitSize(KmerVec* v, size_t size);
+
+/*
+  Free the entire array.
+*/
+void KVecFree(KmerVec* v);
+
+/*
+  Make room for at least size k-mers in total.
+*/
+void KVecReserve(KmerVec* v, size_t size);
+
+/*
+  Append a k-mer. If already full, the size of the array will be doubled
+  before the insertion. Inline as it is called in the inner loops.
+*/
+static inline void KVecPush(KmerVec* v, kmer x){
+    if(v->used == v->size) KVecReserve(v, v->size ? v->size << 1 : 16);
+    v->arr[v->used++] = x;
+}
+
+/*
+  Append num k-mers from xs.
+*/
+void KVecAppend(KmerVec* v, const kmer* xs, size_t num);
+
+/*
+  Clear used count so the array can be used as if a new one, the memory
+  is kept.
+*/
+static inline void KVecClear(KmerVec* v){
+    v->used = 0;
+}
+
+/*
+  Swap two arrays.
+*/
+void KVecSwap(KmerVec* va, KmerVec* vb);
+
+/*
+  Sort the k-mers in increasing order in place, by most significant
+  digit first radix sort on bytes (American flag sort).
+*/
+void KVecSort(KmerVec* v);
+
+/*
+  Remove consecutive duplicates (all duplicates if sorted).
+  Return the new number of k-mers.
+*/
+size_t KVecUnique(KmerVec* v);
+
+#endif // KmerVec.h
@@ -0,0 +1,454 @@
+#include "Neighborhood.h"
+#include "metrics.h"
+#include <string.h>
+
+size_t nbhdSizeBound(const int k, const int r){
+    size_t a = 1, b = 0, total = 1, na;
+    int d;
+    for(d=0; d<r; d+=1){
+	na = 3*k*a + 4*k*b;
+	b = k*a;
+	a = na;
+	total += a + b;
+	if(total > NBHD_MAX_PRESIZE) return NBHD_MAX_PRESIZE;
+    }
+    return total;
+}
+
+//largest a_d + b_d for d <= r, the size of a frontier
+static size_t nbhdLayerBound(const int k, const int r){
+    size_t a = 1, b = 0, max = 1, na;
+    int d;
+    for(d=0; d<r; d+=1){
+	na = 3*k*a + 4*k*b;
+	b = k*a;
+	a = na;
+	if(a + b > max) max = a + b;
+	if(max > NBHD_MAX_PRESIZE) return NBHD_MAX_PRESIZE;
+    }
+    return max;
+}
+
+static inline size_t nbhdHash(kmer x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdlu;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53lu;
+    x ^= x >> 33;
+    return x;
+}
+
+static void allocVisited(NbhdWorkspace* w, size_t size){
+    w->keys = malloc_harder(sizeof *w->keys * size);
+    w->stamps = calloc_harder(size, sizeof *w->stamps);
+    w->size = size;
+    w->used = 0;
+    w->epoch = 1;
+}
+
+void NbhdInit(NbhdWorkspace* w, const int k, const int r){
+    w->k = k;
+    w->r = r;
+    size_t size = 64;
+    while(size < (nbhdSizeBound(k, r) << 1)) size <<= 1;
+    allocVisited(w, size);
+    KVecInitSize(&w->cur, nbhdLayerBound(k, r));
+    KVecInitSize(&w->next, nbhdLayerBound(k, r));
+    KVecInitSize(&w->found, nbhdSizeBound(k, r));
+    w->num_threads = 1;
+    w->local_next = NULL;
+    w->local_found = NULL;
+    w->local_slots = NULL;
+    w->ckeys = NULL;
+    w->csize = 0;
+    w->workers = NULL;
+    w->threads = NULL;
+}
+
+typedef struct NbhdThread {
+    NbhdWorkspace* w;
+    int id;
+} NbhdThread;
+
+static void expandLayers(NbhdWorkspace* w, const int id);
+
+//a worker of the pool, expands its part of the layers of each search
+static void* poolWorker(void* arg){
+    NbhdThread* th = arg;
+    NbhdWorkspace* w = th->w;
+    while(1){
+	pthread_barrier_wait(&w->barrier);
+	if(w->stop) return NULL;
+	expandLayers(w, th->id);
+    }
+}
+
+void NbhdSetThreads(NbhdWorkspace* w, const int num_threads){
+    int t;
+    if(w->workers){
+	w->stop = 1;
+	pthread_barrier_wait(&w->barrier);
+	for(t=1; t<w->num_threads; t+=1) pthread_join(w->workers[t], NULL);
+	pthread_barrier_destroy(&w->barrier);
+	free(w->workers);
+	free(w->threads);
+	w->workers = NULL;
+	w->threads = NULL;
+    }
+    for(t=0; t<w->num_threads && w->local_next; t+=1){
+	KVecFree(w->local_next + t);
+	KVecFree(w->local_found + t);
+	KVecFree(w->local_slots + t);
+    }
+    free(w->local_next);
+    free(w->local_found);
+    free(w->local_slots);
+    w->local_next = w->local_found = w->local_slots = NULL;
+    w->num_threads = num_threads > 1 ? num_threads : 1;
+    if(w->num_threads == 1) return;
+
+    w->local_next = malloc_harder(sizeof *w->local_next * w->num_threads);
+    w->local_found = malloc_harder(sizeof *w->local_found * w->num_threads);
+    w->local_slots = malloc_harder(sizeof *w->local_slots * w->num_threads);
+    for(t=0; t<w->num_threads; t+=1){
+	KVecInit(w->local_next + t);
+	KVecInit(w->local_found + t);
+	KVecInit(w->local_slots + t);
+    }
+    w->stop = 0;
+    pthread_barrier_init(&w->barrier, NULL, w->num_threads);
+    w->workers = malloc_harder(sizeof *w->workers * w->num_threads);
+    w->threads = malloc_harder(sizeof *w->threads * w->num_threads);
+    for(t=1; t<w->num_threads; t+=1){
+	w->threads[t].w = w;
+	w->threads[t].id = t;
+	pthread_create(w->workers+t, NULL, poolWorker, w->threads+t);
+    }
+}
+
+void NbhdFree(NbhdWorkspace* w){
+    free(w->keys);
+    free(w->stamps);
+    NbhdSetThreads(w, 1);
+    KVecFree(&w->cur);
+    KVecFree(&w->next);
+    KVecFree(&w->found);
+    free(w->ckeys);
+    w->ckeys = NULL;
+    w->csize = 0;
+    w->keys = NULL;
+    w->stamps = NULL;
+}
+
+//forget all visited k-mers in O(1)
+static inline void clearVisited(NbhdWorkspace* w){
+    w->used = 0;
+    w->epoch += 1;
+    if(w->epoch == 0){
+	memset(w->stamps, 0, sizeof *w->stamps * w->size);
+	w->epoch = 1;
+    }
+}
+
+//add x to the visited set, return 1 if it was not visited
+static int visit(NbhdWorkspace* w, kmer x);
+
+static void growVisited(NbhdWorkspace* w){
+    kmer* old_keys = w->keys;
+    uint32_t* old_stamps = w->stamps;
+    size_t old_size = w->size, i;
+    uint32_t old_epoch = w->epoch;
+    allocVisited(w, old_size << 1);
+    for(i=0; i<old_size; i+=1){
+	if(old_stamps[i] == old_epoch) visit(w, old_keys[i]);
+    }
+    free(old_keys);
+    free(old_stamps);
+}
+
+static int visit(NbhdWorkspace* w, kmer x){
+    size_t mask = w->size - 1, i;
+    for(i=nbhdHash(x) & mask; w->stamps[i] == w->epoch; i=(i+1) & mask){
+	if(w->keys[i] == x) return 0;
+    }
+    w->keys[i] = x;
+    w->stamps[i] = w->epoch;
+    w->used += 1;
+    if((w->used << 1) > w->size) growVisited(w);
+    return 1;
+}
+
+//insert x into the shared table keys, return 1 if it was not there
+//and add the index of its slot to slots
+static inline int visitConcurrent(kmer* keys, const size_t mask, const kmer x,
+				  KmerVec* slots){
+    size_t i = nbhdHash(x) & mask;
+    kmer cur;
+    while(1){
+	cur = __atomic_load_n(keys+i, __ATOMIC_RELAXED);
+	if(cur == x) return 0;
+	if(cur == NBHD_EMPTY){
+	    if(__atomic_compare_exchange_n(keys+i, &cur, x, 0, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED)){
+		KVecPush(slots, i);
+		return 1;
+	    }
+	    //another thread took the slot, check what it put there
+	    if(cur == x) return 0;
+	}
+	i = (i+1) & mask;
+    }
+}
+
+static inline int isNew(NbhdWorkspace* w, const kmer x, const int concurrent,
+			KmerVec* slots){
+    if(concurrent) return visitConcurrent(w->ckeys, w->csize - 1, x, slots);
+    return visit(w, x);
+}
+
+/*
+  Add the unvisited neighbors of t at distance 1 to next and those of
+  them in the sample (or all k-mers if in_sample is NULL) to found.
+  x is marked as visited in the shared table (its slot added to slots)
+  if concurrent is 1, in the table of the workspace otherwise.
+*/
+static inline void expandNode(NbhdWorkspace* w, const kmer t,
+			      const SampleD1Fn in_sample, const int concurrent,
+			      KmerVec* next, KmerVec* found, KmerVec* slots){
+    const int k = w->k;
+    size_t j;
+    kmer head, body, tail, x, m;
+    //(k-1)-mer, no need to ^NBHD_KM1_FLAG as the head will shift MSB out
+    if(t>=NBHD_KM1_FLAG){
+	//insertion
+	for(j=0; j<k; j+=1){
+	    head = (t>>(j<<1))<<((j+1)<<1);
+	    tail = (((kmer) 1<<(j<<1))-1) & t;
+	    for(m=0; m<4; m+=1){
+		body = m<<(j<<1);
+		x = head|body|tail;
+		//x is a k-mer
+		if(isNew(w, x, concurrent, slots)){
+		    KVecPush(next, x);
+		    if(!in_sample || in_sample(x, k)) KVecPush(found, x);
+		}
+	    }
+	}
+    }
+    //k-mer
+    else{
+	//deletion
+	for(j=0; j<k; j+=1){
+	    head = (t>>((j+1)<<1))<<(j<<1);
+	    tail = (((kmer) 1<<(j<<1))-1) & t;
+	    x = head|tail|NBHD_KM1_FLAG;
+	    //x is a (k-1)-mer
+	    if(isNew(w, x, concurrent, slots)) KVecPush(next, x);
+	}
+	//substitution
+	for(j=1; j<=k; j+=1){
+	    head = (t>>(j<<1))<<(j<<1);
+	    tail = (((kmer) 1<<((j-1)<<1))-1) & t;
+	    for(m=0; m<4; m+=1){
+		body = m<<((j-1)<<1);
+		x = head|body|tail;
+		//x is a k-mer
+		if(isNew(w, x, concurrent, slots)){
+		    KVecPush(next, x);
+		    if(!in_sample || in_sample(x, k)) KVecPush(found, x);
+		}
+	    }
+	}
+    }//end k-mer
+}
+
+size_t nbhdStep(const kmer t, const int k, kmer* out){
+    size_t num = 0;
+    int j;
+    kmer head, tail, m;
+    if(t>=NBHD_KM1_FLAG){
+	//insertion
+	for(j=0; j<k; j+=1){
+	    head = (t>>(j<<1))<<((j+1)<<1);
+	    tail = (((kmer) 1<<(j<<1))-1) & t;
+	    for(m=0; m<4; m+=1) out[num++] = head|(m<<(j<<1))|tail;
+	}
+    }else{
+	//deletion
+	for(j=0; j<k; j+=1){
+	    head = (t>>((j+1)<<1))<<(j<<1);
+	    tail = (((kmer) 1<<(j<<1))-1) & t;
+	    out[num++] = head|tail|NBHD_KM1_FLAG;
+	}
+	//substitution
+	for(j=1; j<=k; j+=1){
+	    head = (t>>(j<<1))<<(j<<1);
+	    tail = (((kmer) 1<<((j-1)<<1))-1) & t;
+	    for(m=0; m<4; m+=1) out[num++] = head|(m<<((j-1)<<1))|tail;
+	}
+    }
+    return num;
+}
+
+static inline void countNeighborhood(size_t num){
+    METRIC_INC(METRIC_NBHD_CALLS);
+    METRIC_ADD(METRIC_NBHD_KMERS, num);
+    METRIC_MAX(METRIC_NBHD_MAX_KMERS, num);
+}
+
+/*
+  Make the shared table large enough for used + added k-mers at load 1/2.
+  The slots of the k-mers moved are then all in the list of thread 0.
+*/
+static void reserveConcurrent(NbhdWorkspace* w, size_t used, size_t added){
+    size_t size = w->csize ? w->csize : 64, i, j, mask;
+    int t;
+    while(size < ((used + added) << 1)) size <<= 1;
+    if(size == w->csize) return;
+
+    kmer* old = w->ckeys;
+    size_t old_size = w->csize;
+    w->ckeys = malloc_harder(sizeof *w->ckeys * size);
+    memset(w->ckeys, 0xff, sizeof *w->ckeys * size);
+    w->csize = size;
+    mask = size - 1;
+    for(t=0; t<w->num_threads; t+=1) KVecClear(w->local_slots + t);
+    for(i=0; i<old_size; i+=1){
+	if(old[i] == NBHD_EMPTY) continue;
+	for(j=nbhdHash(old[i]) & mask; w->ckeys[j] != NBHD_EMPTY; j=(j+1) & mask);
+	w->ckeys[j] = old[i];
+	KVecPush(w->local_slots, j);
+    }
+    free(old);
+}
+
+//bound on the number of new nodes found from the current layer
+static size_t nextLayerBound(const NbhdWorkspace* w){
+    size_t i, a = 0, b = 0;
+    for(i=0; i<w->cur.used; i+=1){
+	if(w->cur.arr[i] >= NBHD_KM1_FLAG) b += 1;
+	else a += 1;
+    }
+    return 3*w->k*a + 4*w->k*b + w->k*a;
+}
+
+//the part of thread id of each layer of the current search
+static void expandLayers(NbhdWorkspace* w, const int id){
+    KmerVec* next = w->local_next + id;
+    KmerVec* found = w->local_found + id;
+    KmerVec* slots = w->local_slots + id;
+    size_t i, st, ed, used = 1;
+    int depth, t;
+    for(depth=1; depth<=w->r; depth+=1){
+	st = w->cur.used * id / w->num_threads;
+	ed = w->cur.used * (id+1) / w->num_threads;
+	KVecClear(next);
+	for(i=st; i<ed; i+=1){
+	    expandNode(w, w->cur.arr[i], w->in_sample, 1, next, found, slots);
+	}
+	//each thread sorts its part of the result, merged by bfsParallel
+	if(depth == w->r) KVecSort(found);
+	pthread_barrier_wait(&w->barrier);
+
+	//the first thread concatenates the next layers
+	if(id == 0){
+	    KVecClear(&w->next);
+	    for(t=0; t<w->num_threads; t+=1){
+		KVecAppend(&w->next, w->local_next[t].arr, w->local_next[t].used);
+	    }
+	    KVecSwap(&w->cur, &w->next);
+	    used += w->cur.used;
+	    if(depth < w->r) reserveConcurrent(w, used, nextLayerBound(w));
+	}
+	pthread_barrier_wait(&w->barrier);
+    }
+}
+
+/*
+  Parallel version of bfsNeighborsInSampleRadius: the threads split each
+  layer and insert into a shared lock-free table, each writes its part
+  of the next layer to its own buffer. The table is empty between
+  searches.
+*/
+static AVLKmerNode* bfsParallel(NbhdWorkspace* w, AVLArena* arena,
+				kmer cur, int check_sample){
+    int t, num = w->num_threads;
+    size_t i, j;
+    //the shared table is sized for the first layer
+    reserveConcurrent(w, 1, 5*w->k);
+    visitConcurrent(w->ckeys, w->csize - 1, cur, w->local_slots);
+    KVecClear(&w->cur);
+    KVecPush(&w->cur, cur);
+    for(t=0; t<num; t+=1) KVecClear(w->local_found + t);
+
+    //start the workers, the last barrier of expandLayers ends the search
+    w->in_sample = check_sample ? sampleD1Kernel() : NULL;
+    pthread_barrier_wait(&w->barrier);
+    expandLayers(w, 0);
+
+    //merge the sorted parts (disjoint, and without cur) into the tree,
+    //whose shape then does not depend on timing
+    KVecClear(&w->found);
+    size_t heads[num], total = 0;
+    int best;
+    kmer x;
+    for(t=0; t<num; t+=1){
+	heads[t] = 0;
+	total += w->local_found[t].used;
+    }
+    int has_cur = !check_sample || isInSampleD1(cur, w->k);
+    KVecReserve(&w->found, total + has_cur);
+    for(i=0; i<total; i+=1){
+	for(t=0, best=-1; t<num; t+=1){
+	    if(heads[t] < w->local_found[t].used &&
+	       (best < 0 || w->local_found[t].arr[heads[t]] <
+		w->local_found[best].arr[heads[best]])) best = t;
+	}
+	x = w->local_found[best].arr[heads[best]++];
+	if(has_cur && cur < x){
+	    KVecPush(&w->found, cur);
+	    has_cur = 0;
+	}
+	KVecPush(&w->found, x);
+    }
+    if(has_cur) KVecPush(&w->found, cur);
+    countNeighborhood(w->found.used);
+    AVLKmerNode* hs = AVLKmerBuild(arena, w->found.arr, w->found.used);
+
+    //empty the slots filled by this search
+    for(t=0; t<num; t+=1){
+	for(j=0; j<w->local_slots[t].used; j+=1){
+	    w->ckeys[w->local_slots[t].arr[j]] = NBHD_EMPTY;
+	}
+	KVecClear(w->local_slots + t);
+    }
+    return hs;
+}
+
+AVLKmerNode* bfsNeighborsInSampleRadius(NbhdWorkspace* w, AVLArena* arena,
+					kmer cur, int check_sample){
+    if(w->num_threads > 1) return bfsParallel(w, arena, cur, check_sample);
+
+    int k = w->k;
+    SampleD1Fn in_sample = check_sample ? sampleD1Kernel() : NULL;
+    clearVisited(w);
+    visit(w, cur);
+    KVecClear(&w->cur);
+    KVecPush(&w->cur, cur);
+    KVecClear(&w->found);
+    if(!check_sample || isInSampleD1(cur, k)) KVecPush(&w->found, cur);
+    size_t i;
+    int depth;
+
+    for(depth=1; depth<=w->r; depth+=1){
+	KVecClear(&w->next);
+	for(i=0; i<w->cur.used; i+=1){
+	    expandNode(w, w->cur.arr[i], in_sample, 0, &w->next, &w->found, NULL);
+	}
+	KVecSwap(&w->cur, &w->next);
+    }
+
+    countNeighborhood(w->found.used);
+    KVecSort(&w->found);
+    return AVLKmerBuild(arena, w->found.arr, w->found.used);
+}//end bfsNeighborsInSampleRadius
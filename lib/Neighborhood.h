@@ -0,0 +1,111 @@
+/*
+  Breadth-first enumeration of the edit neighborhood of a k-mer, with
+  all the buffers owned by a reusable workspace.
+
+  The neighbors at each depth are the k-mers obtained by one
+  substitution and the (k-1)-mers obtained by one deletion from the
+  k-mers of the previous depth, and the k-mers obtained by one insertion
+  from its (k-1)-mers. A (k-1)-mer x is stored as x | NBHD_KM1_FLAG.
+
+  The visited set is an open addressing table whose slots are stamped
+  with the epoch of the search that filled them, so it is emptied in
+  O(1) by advancing the epoch. The table and the frontiers are sized
+  from the bound on the number of new k-mers (a_d) and (k-1)-mers (b_d)
+  at depth d:
+    a_0 = 1, b_0 = 0, a_{d+1} = 3k*a_d + 4k*b_d, b_{d+1} = k*a_d,
+  so they are only reallocated if a search ever exceeds them.
+
+  With more than one thread (NbhdSetThreads), each layer is split among
+  the threads, which insert into a shared lock-free (compare-and-swap)
+  open addressing table and write the next layer to their own buffers,
+  concatenated between layers. The resulting set of k-mers is the same.
+  Each thread sorts its part of the result, and the resulting tree is
+  built from their merge in linear time (AVLKmerBuild), as is the tree
+  of the sequential search from its sorted k-mers.
+  The threads are started once by NbhdSetThreads and wait for each
+  search at a barrier, and each search empties only the slots of the
+  shared table it filled, so small neighborhoods pay neither a thread
+  creation nor a pass over the whole table.
+*/
+
+#ifndef _NEIGHBORHOOD_H
+#define _NEIGHBORHOOD_H 1
+
+#include "util.h"
+#include "AVLTree.h"
+#include "KmerVec.h"
+#include <stdint.h>
+#include <pthread.h>
+
+//the top bit of a kmer, so k < KMER_MAX_K
+#define NBHD_KM1_FLAG ((kmer) 1 << (KMER_MAX_K*2 - 1))
+//presized buffers are capped at this many entries, larger ones grow on demand
+#define NBHD_MAX_PRESIZE (1lu<<22)
+//empty slot of the shared table, not a valid k-mer or (k-1)-mer for k < KMER_MAX_K
+#define NBHD_EMPTY (~(kmer) 0)
+
+typedef struct {
+    int k;
+    int r;
+    //visited set, slot i is used iff stamps[i] == epoch
+    kmer* keys;
+    uint32_t* stamps;
+    size_t size; //a power of 2
+    size_t used;
+    uint32_t epoch;
+    //frontiers
+    KmerVec cur;
+    KmerVec next;
+    KmerVec found; //k-mers of the resulting tree
+    //parallel expansion
+    int num_threads;
+    KmerVec* local_next; //per thread
+    KmerVec* local_found;
+    KmerVec* local_slots; //indices of the slots of ckeys filled by each thread
+    kmer* ckeys; //shared visited set, NBHD_EMPTY if unused
+    size_t csize; //a power of 2
+    //pool of num_threads-1 workers, waiting at barrier between searches
+    pthread_t* workers;
+    struct NbhdThread* threads;
+    pthread_barrier_t barrier;
+    SampleD1Fn in_sample; //of the current search, NULL for every k-mer
+    int stop; //set to end the workers
+} NbhdWorkspace;
+
+/*
+  Upper bound on the number of distinct k-mers and (k-1)-mers within
+  distance r of a k-mer (the sum of a_d + b_d for d <= r).
+*/
+size_t nbhdSizeBound(const int k, const int r);
+
+/*
+  Write to out the nodes at distance 1 from t (a k-mer or a flagged
+  (k-1)-mer), possibly with duplicates and t itself, and return their
+  number, at most NBHD_STEP_MAX(k).
+*/
+#define NBHD_STEP_MAX(k) (5*(k))
+size_t nbhdStep(const kmer t, const int k, kmer* out);
+
+/*
+  Allocate a workspace for the neighborhoods of radius r of k-mers.
+*/
+void NbhdInit(NbhdWorkspace* w, const int k, const int r);
+
+void NbhdFree(NbhdWorkspace* w);
+
+/*
+  Expand each neighborhood with num_threads threads (1 by default). The
+  num_threads-1 worker threads run until the next call or NbhdFree, and
+  hold the address of w, which must not be moved meanwhile.
+*/
+void NbhdSetThreads(NbhdWorkspace* w, const int num_threads);
+
+/*
+  Do bfs for w->r layers from the given k-mer cur, add each k-mer found
+  (including cur) that is isInSampleD1 (or every k-mer if check_sample
+  is 0) to the resulting tree, whose nodes are taken from arena.
+*/
+AVLKmerNode* bfsNeighborsInSampleRadius(NbhdWorkspace* w, AVLArena* arena,
+					kmer cur, int check_sample);
+
+#endif // Neighborhood.h
@@ -0,0 +1,204 @@
+#include "RadixSort.h"
+#include <string.h>
+#include <pthread.h>
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1<<RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE-1)
+
+#define DIGIT(p, on_label, shift) \
+    ((((on_label) ? (p).label : (p).id) >> (shift)) & RADIX_MASK)
+
+static void radixCount(const Posting* src, const size_t st, const size_t ed,
+		       const int on_label, const int shift, size_t* count){
+    memset(count, 0, sizeof *count * RADIX_SIZE);
+    size_t i;
+    for(i=st; i<ed; i+=1){
+	count[DIGIT(src[i], on_label, shift)] += 1;
+    }
+}
+
+static void radixScatter(const Posting* src, Posting* dest,
+			 const size_t st, const size_t ed,
+			 const int on_label, const int shift, size_t* pos){
+    size_t i;
+    for(i=st; i<ed; i+=1){
+	dest[pos[DIGIT(src[i], on_label, shift)]++] = src[i];
+    }
+}
+
+//one stable counting pass on the digit of the label (or id) at shift,
+//return 0 without moving anything if all keys have the same digit
+static int radixPass(const Posting* src, Posting* dest, const size_t num,
+		     const int on_label, const int shift){
+    size_t count[RADIX_SIZE];
+    radixCount(src, 0, num, on_label, shift, count);
+    if(count[DIGIT(src[0], on_label, shift)] == num) return 0;
+
+    size_t i, d, sum;
+    for(i=0, sum=0; i<RADIX_SIZE; i+=1){
+	d = count[i];
+	count[i] = sum;
+	sum += d;
+    }
+    radixScatter(src, dest, 0, num, on_label, shift, count);
+    return 1;
+}
+
+//the largest label and id in arr[st..ed), and whether the ids are
+//nondecreasing there (including from arr[st-1] if st > 0)
+static void maxKeys(const Posting* arr, const size_t st, const size_t ed,
+		    size_t* max_label, size_t* max_id, int* ids_sorted){
+    size_t i;
+    *max_label = *max_id = 0;
+    *ids_sorted = st == 0 || arr[st-1].id <= arr[st].id;
+    for(i=st; i<ed; i+=1){
+	if(arr[i].label > *max_label) *max_label = arr[i].label;
+	if(arr[i].id > *max_id) *max_id = arr[i].id;
+	if(i > st && arr[i].id < arr[i-1].id) *ids_sorted = 0;
+    }
+}
+
+void radixSortPostings(Posting* arr, Posting* tmp, const size_t num){
+    if(num < 2) return;
+
+    size_t max_label, max_id;
+    int ids_sorted;
+    maxKeys(arr, 0, num, &max_label, &max_id, &ids_sorted);
+    //the passes on the label are stable, so ids already in order (as
+    //the postings of the tools are made) need no pass of their own
+    if(ids_sorted) max_id = 0;
+
+    Posting *src = arr, *dest = tmp, *swap;
+    int shift;
+    //least significant key (id) first
+    for(shift=0; shift<64 && (max_id >> shift); shift+=RADIX_BITS){
+	if(radixPass(src, dest, num, 0, shift)){
+	    swap = src; src = dest; dest = swap;
+	}
+    }
+    for(shift=0; shift<64 && (max_label >> shift); shift+=RADIX_BITS){
+	if(radixPass(src, dest, num, 1, shift)){
+	    swap = src; src = dest; dest = swap;
+	}
+    }
+
+    if(src != arr){
+	memcpy(arr, src, sizeof *arr * num);
+    }
+}
+
+/*
+  Parallel version: each thread owns a contiguous slice of the input.
+  In every pass, the threads count the digits of their slices, then
+  the first thread turns the per-thread counts into scatter positions
+  (digit-major, thread-minor, which keeps the pass stable) and the
+  threads scatter their slices independently. The threads are started
+  once per sort and step through the passes at a barrier.
+*/
+typedef struct RadixShared RadixShared;
+
+typedef struct {
+    RadixShared* sh;
+    int id;
+    size_t st, ed;
+    size_t max_label, max_id;
+    int ids_sorted;
+    size_t count[RADIX_SIZE];
+} RadixWork;
+
+struct RadixShared {
+    Posting* arr;
+    Posting* tmp;
+    size_t num;
+    int threads;
+    RadixWork* works;
+    pthread_barrier_t barrier;
+    int moved; //whether the current pass scatters
+};
+
+//the positions of the pass from the counts, 0 if all keys have the
+//same digit d0 (the digit of the first key)
+static int radixPositions(RadixShared* sh, const size_t d0){
+    size_t d, sum, cur;
+    int t;
+    for(t=0, sum=0; t<sh->threads; t+=1){
+	sum += sh->works[t].count[d0];
+    }
+    if(sum == sh->num) return 0;
+
+    for(d=0, sum=0; d<RADIX_SIZE; d+=1){
+	for(t=0; t<sh->threads; t+=1){
+	    cur = sh->works[t].count[d];
+	    sh->works[t].count[d] = sum;
+	    sum += cur;
+	}
+    }
+    return 1;
+}
+
+static void* radixWorker(void* arg){
+    RadixWork* w = arg;
+    RadixShared* sh = w->sh;
+    maxKeys(sh->arr, w->st, w->ed, &w->max_label, &w->max_id, &w->ids_sorted);
+    pthread_barrier_wait(&sh->barrier);
+
+    //every thread derives the same passes from the slices
+    size_t max_label = 0, max_id = 0, max_key;
+    int ids_sorted = 1, key, shift, t;
+    for(t=0; t<sh->threads; t+=1){
+	if(sh->works[t].max_label > max_label) max_label = sh->works[t].max_label;
+	if(sh->works[t].max_id > max_id) max_id = sh->works[t].max_id;
+	ids_sorted &= sh->works[t].ids_sorted;
+    }
+    if(ids_sorted) max_id = 0;
+
+    Posting *src = sh->arr, *dest = sh->tmp, *swap;
+    for(key=0; key<2; key+=1){
+	max_key = key ? max_label : max_id;
+	for(shift=0; shift<64 && (max_key >> shift); shift+=RADIX_BITS){
+	    radixCount(src, w->st, w->ed, key, shift, w->count);
+	    pthread_barrier_wait(&sh->barrier);
+	    if(w->id == 0) sh->moved = radixPositions(sh, DIGIT(src[0], key, shift));
+	    pthread_barrier_wait(&sh->barrier);
+	    if(!sh->moved) continue;
+
+	    radixScatter(src, dest, w->st, w->ed, key, shift, w->count);
+	    pthread_barrier_wait(&sh->barrier);
+	    swap = src; src = dest; dest = swap;
+	}
+    }
+
+    //the result is in src, every slice is copied back by its thread
+    if(src != sh->arr){
+	memcpy(sh->arr + w->st, src + w->st, sizeof *src * (w->ed - w->st));
+    }
+    return NULL;
+}
+
+void radixSortPostingsParallel(Posting* arr, Posting* tmp, const size_t num,
+			       int threads){
+    if(threads <= 1 || num < (size_t) threads * RADIX_SIZE){
+	radixSortPostings(arr, tmp, num);
+	return;
+    }
+
+    RadixShared sh = {arr, tmp, num, threads};
+    sh.works = malloc_harder(sizeof *sh.works * threads);
+    pthread_barrier_init(&sh.barrier, NULL, threads);
+    pthread_t tids[threads];
+    int t;
+    for(t=0; t<threads; t+=1){
+	sh.works[t].sh = &sh;
+	sh.works[t].id = t;
+	sh.works[t].st = num / threads * t;
+	sh.works[t].ed = t == threads-1 ? num : num / threads * (t+1);
+	if(t) pthread_create(tids+t, NULL, radixWorker, sh.works+t);
+    }
+    radixWorker(sh.works);
+    for(t=1; t<threads; t+=1){
+	pthread_join(tids[t], NULL);
+    }
+    pthread_barrier_destroy(&sh.barrier);
+    free(sh.works);
+}
@@ -0,0 +1,30 @@
+/*
+  LSD radix sort for (label, id) pairs, e.g., the buckets of k-mers.
+*/
+
+#ifndef _RADIXSORT_H
+#define _RADIXSORT_H 1
+
+#include "util.h"
+
+typedef struct {
+    size_t label;
+    size_t id;
+} Posting;
+
+/*
+  Sort arr by label, ties broken by id. tmp must have space for num
+  postings. Digits on which all the keys agree are skipped, so sorting
+  small labels and ids only costs a few passes, and if the ids are
+  already in nondecreasing order (as when the postings are made id by
+  id) only the labels are sorted. The result is always stored in arr.
+*/
+void radixSortPostings(Posting* arr, Posting* tmp, const size_t num);
+
+/*
+  Same as radixSortPostings, using the given number of threads.
+*/
+void radixSortPostingsParallel(Posting* arr, Posting* tmp, const size_t num,
+			       int threads);
+
+#endif // RadixSort.h
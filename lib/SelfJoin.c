@@ -0,0 +1,196 @@
+#include "SelfJoin.h"
+#include <pthread.h>
+#include <time.h>
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    //shared input
+    const kmer* xs;
+    int n, func, max_d;
+    size_t* labels; //sorted labels of k-mer i at [i*n, i*n+n), padded by -1
+    Posting* postings;
+    //this thread's range of k-mers (bucketing) or postings (joining)
+    size_t st, ed;
+    //output
+    size_t num_postings;
+    size_t candidates;
+    KMerPair* pairs;
+    size_t pairs_size, pairs_used;
+} JoinWork;
+
+static void* bucketWorker(void* arg){
+    JoinWork* w = arg;
+    int n = w->n, num, j, l;
+    size_t i, tmp, *cur;
+    w->num_postings = 0;
+    for(i=w->st; i<w->ed; i+=1){
+	cur = w->labels + i*n;
+	num = assignBucketsWith64(w->func, w->xs[i], n, cur, 0);
+	//sort the labels of this k-mer, pad with -1
+	for(j=1; j<num; j+=1){
+	    tmp = cur[j];
+	    for(l=j-1; l>=0 && cur[l]>tmp; l-=1){
+		cur[l+1] = cur[l];
+	    }
+	    cur[l+1] = tmp;
+	}
+	for(j=num; j<n; j+=1){
+	    cur[j] = (size_t) -1;
+	}
+	w->num_postings += num;
+    }
+    return NULL;
+}
+
+//the smallest label shared by the sorted label lists la and lb
+static inline size_t minSharedLabel(const size_t* la, const size_t* lb,
+				    const int n){
+    int i=0, j=0;
+    while(i<n && j<n){
+	if(la[i] == lb[j]) return la[i];
+	else if(la[i] < lb[j]) i += 1;
+	else j += 1;
+    }
+    return (size_t) -1;
+}
+
+static void* joinWorker(void* arg){
+    JoinWork* w = arg;
+    const Posting* p = w->postings;
+    int n = w->n, d;
+    size_t st, ed, i, j, a, b;
+    w->candidates = 0;
+    w->pairs_used = 0;
+    for(st=w->st; st<w->ed; st=ed){
+	for(ed=st+1; ed<w->ed && p[ed].label == p[st].label; ed+=1);
+	for(i=st; i<ed; i+=1){
+	    a = p[i].id;
+	    for(j=i+1; j<ed; j+=1){
+		b = p[j].id;
+		if(minSharedLabel(w->labels + a*n, w->labels + b*n, n)
+		   != p[st].label) continue;
+		w->candidates += 1;
+		d = editDist2(w->xs[a], n, w->xs[b], n, w->max_d+1);
+		if(d > w->max_d) continue;
+		if(w->pairs_used == w->pairs_size){
+		    w->pairs_size = w->pairs_size ? w->pairs_size << 1 : 1024;
+		    w->pairs = realloc_harder(w->pairs,
+					      sizeof *w->pairs * w->pairs_size);
+		}
+		w->pairs[w->pairs_used].a = a;
+		w->pairs[w->pairs_used].b = b;
+		w->pairs[w->pairs_used].dist = d;
+		w->pairs_used += 1;
+	    }
+	}
+    }
+    return NULL;
+}
+
+static void runWorkers(JoinWork* works, const int threads,
+		       void* (*worker)(void*)){
+    pthread_t tids[threads];
+    int t;
+    for(t=1; t<threads; t+=1){
+	pthread_create(tids+t, NULL, worker, works+t);
+    }
+    worker(works);
+    for(t=1; t<threads; t+=1){
+	pthread_join(tids[t], NULL);
+    }
+}
+
+size_t selfJoinKMers(const kmer* xs, const size_t num, const int n,
+		     const int func, const int max_d, int threads,
+		     KMerPair** pairs, SelfJoinStats* stats){
+    if(threads < 1) threads = 1;
+    double time = seconds();
+
+    JoinWork* works = calloc_harder(threads, sizeof *works);
+    size_t* labels = malloc_harder(sizeof *labels * num * n);
+    int t;
+    for(t=0; t<threads; t+=1){
+	works[t].xs = xs;
+	works[t].n = n;
+	works[t].func = func;
+	works[t].max_d = max_d;
+	works[t].labels = labels;
+	works[t].st = num / threads * t;
+	works[t].ed = t == threads-1 ? num : num / threads * (t+1);
+    }
+    runWorkers(works, threads, bucketWorker);
+
+    size_t num_postings = 0, i;
+    int j;
+    for(t=0; t<threads; t+=1){
+	num_postings += works[t].num_postings;
+    }
+    Posting* postings = malloc_harder(sizeof *postings * num_postings);
+    Posting* tmp = malloc_harder(sizeof *tmp * num_postings);
+    size_t m = 0;
+    for(i=0; i<num; i+=1){
+	for(j=0; j<n && labels[i*n+j] != (size_t) -1; j+=1){
+	    postings[m].label = labels[i*n+j];
+	    postings[m].id = i;
+	    m += 1;
+	}
+    }
+    if(stats){
+	stats->bucket_time = seconds() - time;
+	time = seconds();
+    }
+
+    radixSortPostingsParallel(postings, tmp, num_postings, threads);
+    free(tmp);
+    if(stats){
+	stats->sort_time = seconds() - time;
+	time = seconds();
+    }
+
+    //split the postings into ranges of whole buckets
+    size_t st = 0, ed;
+    for(t=0; t<threads; t+=1){
+	ed = t == threads-1 ? num_postings : num_postings / threads * (t+1);
+	if(ed < st) ed = st;
+	while(ed > st && ed < num_postings
+	      && postings[ed].label == postings[ed-1].label){
+	    ed += 1;
+	}
+	works[t].postings = postings;
+	works[t].st = st;
+	works[t].ed = ed;
+	st = ed;
+    }
+    runWorkers(works, threads, joinWorker);
+
+    size_t num_pairs = 0, candidates = 0;
+    for(t=0; t<threads; t+=1){
+	num_pairs += works[t].pairs_used;
+	candidates += works[t].candidates;
+    }
+    *pairs = malloc_harder(sizeof **pairs * (num_pairs ? num_pairs : 1));
+    for(t=0, m=0; t<threads; t+=1){
+	for(i=0; i<works[t].pairs_used; i+=1){
+	    (*pairs)[m++] = works[t].pairs[i];
+	}
+	free(works[t].pairs);
+    }
+
+    if(stats){
+	stats->join_time = seconds() - time;
+	stats->num_kmers = num;
+	stats->num_postings = num_postings;
+	stats->candidates = candidates;
+	stats->pairs = num_pairs;
+    }
+
+    free(postings);
+    free(labels);
+    free(works);
+    return num_pairs;
+}
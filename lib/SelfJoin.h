@@ -0,0 +1,48 @@
+/*
+  All pairs of similar k-mers in a set, found by bucketing.
+
+  Every k-mer is assigned to its buckets, the (bucket, id) postings are
+  grouped by a parallel radix sort, and the k-mers sharing a bucket are
+  paired up. A pair sharing several buckets is only emitted in the
+  smallest one, then verified by editDist2.
+
+  With BUCKET_FUNC_OPT12 ((1,2)-sensitive) all pairs within edit
+  distance 1 are found; with BUCKET_FUNC_SAMPLE ((1,3)-sensitive) pairs
+  within edit distance 1 are found and pairs with edit distance 2 may be.
+*/
+
+#ifndef _SELFJOIN_H
+#define _SELFJOIN_H 1
+
+#include "util.h"
+#include "bucketing.h"
+#include "RadixSort.h"
+
+typedef struct {
+    size_t a; //a < b are indices into the input array
+    size_t b;
+    int dist;
+} KMerPair;
+
+typedef struct {
+    size_t num_kmers;
+    size_t num_postings;
+    size_t candidates; //distinct pairs sharing a bucket
+    size_t pairs; //candidates within the edit distance threshold
+    double bucket_time; //in seconds
+    double sort_time;
+    double join_time;
+} SelfJoinStats;
+
+/*
+  Find all pairs of the num n-mers in xs that share a bucket of the
+  bucketing function func (BUCKET_FUNC_*) and have edit distance at most
+  max_d, using the given number of threads. The pairs are stored in a
+  newly allocated array *pairs; their number is returned. If stats is
+  not NULL, the counts and timings of the join are stored there.
+*/
+size_t selfJoinKMers(const kmer* xs, const size_t num, const int n,
+		     const int func, const int max_d, int threads,
+		     KMerPair** pairs, SelfJoinStats* stats);
+
+#endif // SelfJoin.h
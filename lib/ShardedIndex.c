@@ -0,0 +1,319 @@
+#include "ShardedIndex.h"
+#include "BucketServer.h"
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+static inline void reportShardError(const char* path, const char* msg){
+    fprintf(stderr, "error with shard map %s: %s\n", path, msg);
+    exit(1);
+}
+
+int shardHistShift(const size_t max_label){
+    int shift = 0;
+    while((max_label >> shift) >= (1lu << SHARD_HIST_BITS)) shift += 1;
+    return shift;
+}
+
+//split path into its directory and file name
+static char* mapDir(const char* path, const char** name){
+    const char* slash = strrchr(path, '/');
+    if(slash == NULL){
+	*name = path;
+	return strdup(".");
+    }
+    *name = slash + 1;
+    return strndup(path, slash - path + (slash == path));
+}
+
+void ShardMapBalance(ShardMap* m, const char* path, const int n,
+		     const int func, const size_t max_label,
+		     const size_t* hist, const int shift, const int num_shards){
+    const char* name;
+    m->dir = mapDir(path, &name);
+    m->n = n;
+    m->func = func;
+    m->num_shards = num_shards;
+    m->bounds = malloc_harder(sizeof *m->bounds * (num_shards+1));
+    m->files = malloc_harder(sizeof *m->files * num_shards);
+
+    size_t num_bins = (max_label >> shift) + 1, total = 0, acc = 0, target, b;
+    for(b=0; b<num_bins; b+=1) total += hist[b];
+
+    //each boundary is the bin edge closest to an equal share
+    int i;
+    m->bounds[0] = 0;
+    for(i=1, b=0; i<num_shards; i+=1){
+	target = total / num_shards * i + total % num_shards * i / num_shards;
+	while(b < num_bins && acc + hist[b] <= target) acc += hist[b++];
+	if(b < num_bins && target - acc > acc + hist[b] - target) acc += hist[b++];
+	//b << shift may wrap when b == num_bins and max_label is SIZE_MAX
+	m->bounds[i] = b < num_bins ? b << shift : max_label;
+    }
+    m->bounds[num_shards] = max_label;
+
+    size_t len = strlen(name) + 16;
+    for(i=0; i<num_shards; i+=1){
+	m->files[i] = malloc_harder(len);
+	snprintf(m->files[i], len, "%s.%d", name, i);
+    }
+}
+
+void ShardMapWrite(const ShardMap* m, const char* path){
+    FILE* fout = fopen(path, "w");
+    if(fout == NULL) reportShardError(path, "cannot open for writing");
+    fprintf(fout, "%s %d %d %d\n", SHARD_MAGIC, m->n, m->func, m->num_shards);
+    int i;
+    for(i=0; i<m->num_shards; i+=1){
+	fprintf(fout, "%zu %zu %s\n", m->bounds[i], m->bounds[i+1], m->files[i]);
+    }
+    if(fclose(fout)) reportShardError(path, "cannot write");
+}
+
+void ShardMapRead(ShardMap* m, const char* path){
+    FILE* fin = fopen(path, "r");
+    if(fin == NULL) reportShardError(path, "cannot open");
+    char magic[16], file[4096];
+    size_t lo, hi;
+    if(fscanf(fin, "%15s %d %d %d", magic, &m->n, &m->func, &m->num_shards) != 4
+       || strcmp(magic, SHARD_MAGIC) || m->num_shards <= 0){
+	reportShardError(path, "invalid header");
+    }
+
+    const char* name;
+    m->dir = mapDir(path, &name);
+    m->bounds = malloc_harder(sizeof *m->bounds * (m->num_shards+1));
+    m->files = malloc_harder(sizeof *m->files * m->num_shards);
+    m->bounds[0] = 0;
+    int i;
+    for(i=0; i<m->num_shards; i+=1){
+	if(fscanf(fin, "%zu %zu %4095s", &lo, &hi, file) != 3
+	   || lo != m->bounds[i] || hi < lo){
+	    reportShardError(path, "invalid shard range");
+	}
+	m->bounds[i+1] = hi;
+	m->files[i] = strdup(file);
+    }
+    fclose(fin);
+}
+
+void ShardMapFree(ShardMap* m){
+    int i;
+    for(i=0; i<m->num_shards; i+=1){
+	free(m->files[i]);
+    }
+    free(m->files);
+    free(m->bounds);
+    free(m->dir);
+}
+
+int ShardMapFind(const ShardMap* m, const size_t label){
+    int lo = 0, hi = m->num_shards - 1, mid;
+    while(lo < hi){
+	mid = (lo + hi + 1) >> 1;
+	if(m->bounds[mid] <= label) lo = mid;
+	else hi = mid - 1;
+    }
+    return lo;
+}
+
+size_t ShardMapLast(const ShardMap* m, const int i){
+    if(i == m->num_shards - 1) return m->bounds[i+1];
+    return m->bounds[i+1] > m->bounds[i] ? m->bounds[i+1] - 1 : m->bounds[i];
+}
+
+char* ShardMapPath(const ShardMap* m, const int i){
+    size_t len = strlen(m->dir) + strlen(m->files[i]) + 2;
+    char* path = malloc_harder(len);
+    snprintf(path, len, "%s/%s", m->dir, m->files[i]);
+    return path;
+}
+
+//the child process of shard i, its pipes are in and out
+static void serveShard(ShardClient* c, const int i, const int in, const int out,
+		       const int num_threads){
+    int j;
+    for(j=0; j<i; j+=1){
+	close(c->to[j]);
+	close(c->from[j]);
+    }
+    char* path = ShardMapPath(&c->map, i);
+    BucketIndex idx;
+    BIndexOpen(&idx, path);
+    free(path);
+
+    BucketServer server;
+    BServerInit(&server, &idx, num_threads, 256, -1);
+    BServerServe(&server, in, out);
+    BServerFree(&server);
+    BIndexClose(&idx);
+    _exit(0);
+}
+
+void ShardClientStart(ShardClient* c, const char* path, const int num_threads){
+    ShardMapRead(&c->map, path);
+    int num = c->map.num_shards, i;
+    c->pids = malloc_harder(sizeof *c->pids * num);
+    c->to = malloc_harder(sizeof *c->to * num);
+    c->from = malloc_harder(sizeof *c->from * num);
+    //a server that exits early must not kill the client
+    signal(SIGPIPE, SIG_IGN);
+
+    int req[2], res[2];
+    for(i=0; i<num; i+=1){
+	if(pipe(req) || pipe(res)){
+	    fprintf(stderr, "cannot create pipes for shard %d\n", i);
+	    exit(1);
+	}
+	fflush(NULL);
+	c->pids[i] = fork();
+	if(c->pids[i] < 0){
+	    fprintf(stderr, "cannot start the server of shard %d\n", i);
+	    exit(1);
+	}
+	if(c->pids[i] == 0){
+	    close(req[1]);
+	    close(res[0]);
+	    serveShard(c, i, req[0], res[1], num_threads);
+	}
+	close(req[0]);
+	close(res[1]);
+	c->to[i] = req[1];
+	c->from[i] = res[0];
+	fcntl(c->to[i], F_SETFL, fcntl(c->to[i], F_GETFL) | O_NONBLOCK);
+    }
+}
+
+//the requests to and the responses from one shard in a lookup
+typedef struct {
+    char* req;
+    size_t req_len, req_sent;
+    char* res;
+    size_t res_len, res_size;
+    size_t num; //number of requests
+    size_t lines; //number of complete responses
+} ShardExchange;
+
+//parse a response line "id,id,...\n" into ids, return the number of ids
+static size_t parseIds(const char* line, size_t** ids, size_t* ids_size,
+		       size_t used){
+    char* end;
+    size_t id;
+    while(*line != '\n'){
+	id = strtoul(line, &end, 10);
+	if(end == line) break;
+	if(used == *ids_size){
+	    *ids_size = *ids_size ? *ids_size << 1 : 1024;
+	    *ids = realloc_harder(*ids, sizeof **ids * (*ids_size));
+	}
+	(*ids)[used++] = id;
+	line = *end == ',' ? end + 1 : end;
+    }
+    return used;
+}
+
+size_t ShardClientLookup(ShardClient* c, const size_t* labels, const size_t num,
+			 size_t** ids, size_t* ids_size, size_t* offsets){
+    int num_shards = c->map.num_shards, i, active = 0;
+    ShardExchange* ex = calloc_harder(num_shards, sizeof *ex);
+    int* shard = malloc_harder(sizeof *shard * (num+1));
+    size_t k;
+
+    //scatter: one @label request per label to its shard
+    FILE* req[num_shards];
+    for(i=0; i<num_shards; i+=1){
+	req[i] = open_memstream(&ex[i].req, &ex[i].req_len);
+    }
+    for(k=0; k<num; k+=1){
+	shard[k] = ShardMapFind(&c->map, labels[k]);
+	fprintf(req[shard[k]], "@%zu\n", labels[k]);
+	ex[shard[k]].num += 1;
+    }
+    for(i=0; i<num_shards; i+=1){
+	fclose(req[i]);
+	if(ex[i].num) active += 1;
+    }
+
+    //write the requests and read the responses at the same time, so that
+    //neither side blocks on a full pipe
+    struct pollfd fds[2*num_shards];
+    ssize_t got;
+    int num_fds;
+    while(active > 0){
+	num_fds = 0;
+	for(i=0; i<num_shards; i+=1){
+	    if(ex[i].req_sent < ex[i].req_len){
+		fds[num_fds++] = (struct pollfd) {c->to[i], POLLOUT, 0};
+	    }
+	    if(ex[i].lines < ex[i].num){
+		fds[num_fds++] = (struct pollfd) {c->from[i], POLLIN, 0};
+	    }
+	}
+	if(poll(fds, num_fds, -1) < 0) continue;
+
+	for(i=0; i<num_shards; i+=1){
+	    if(ex[i].req_sent < ex[i].req_len){
+		got = write(c->to[i], ex[i].req + ex[i].req_sent,
+			    ex[i].req_len - ex[i].req_sent);
+		if(got > 0) ex[i].req_sent += got;
+	    }
+	    if(ex[i].lines == ex[i].num) continue;
+	    struct pollfd p = {c->from[i], POLLIN, 0};
+	    if(poll(&p, 1, 0) <= 0) continue;
+	    if(ex[i].res_size - ex[i].res_len < 4096){
+		ex[i].res_size = ex[i].res_size ? ex[i].res_size << 1 : 1<<16;
+		ex[i].res = realloc_harder(ex[i].res, ex[i].res_size);
+	    }
+	    got = read(c->from[i], ex[i].res + ex[i].res_len,
+		       ex[i].res_size - ex[i].res_len);
+	    if(got <= 0){
+		fprintf(stderr, "the server of shard %d stopped\n", i);
+		exit(1);
+	    }
+	    for(k=ex[i].res_len; k<ex[i].res_len+got; k+=1){
+		ex[i].lines += (ex[i].res[k] == '\n');
+	    }
+	    ex[i].res_len += got;
+	    if(ex[i].lines == ex[i].num) active -= 1;
+	}
+    }
+
+    //gather: the responses of each shard are in the order of its requests
+    char* next[num_shards];
+    for(i=0; i<num_shards; i+=1){
+	next[i] = ex[i].res;
+    }
+    size_t used = 0;
+    for(k=0; k<num; k+=1){
+	offsets[k] = used;
+	i = shard[k];
+	used = parseIds(next[i], ids, ids_size, used);
+	next[i] = strchr(next[i], '\n') + 1;
+    }
+    offsets[num] = used;
+
+    for(i=0; i<num_shards; i+=1){
+	free(ex[i].req);
+	free(ex[i].res);
+    }
+    free(ex);
+    free(shard);
+    return used;
+}
+
+void ShardClientStop(ShardClient* c){
+    int i;
+    for(i=0; i<c->map.num_shards; i+=1){
+	close(c->to[i]);
+    }
+    for(i=0; i<c->map.num_shards; i+=1){
+	waitpid(c->pids[i], NULL, 0);
+	close(c->from[i]);
+    }
+    free(c->pids);
+    free(c->to);
+    free(c->from);
+    ShardMapFree(&c->map);
+}
@@ -0,0 +1,110 @@
+/*
+  A bucket index split by ranges of bucket labels into shards, each an
+  independent BucketIndex file, so that the postings of one set can be
+  held by several processes (or machines).
+
+  The shard map is a text file:
+    LSBSHARD1 n func num_shards
+    lo hi file
+    ...
+  where shard i holds the labels in [lo, hi), the last one in [lo, hi]
+  so that the full range of 64-bit labels fits, and file is the name of
+  its index relative to the directory of the map. The ranges are chosen from a
+  histogram of the labels so that the shards get about the same number of
+  postings.
+
+  ShardClient is a scatter-gather driver: it starts one BucketServer
+  process per shard connected by pipes, routes each label of a query to
+  its shard as an @label request and gathers the responses.
+*/
+
+#ifndef _SHARDEDINDEX_H
+#define _SHARDEDINDEX_H 1
+
+#include "util.h"
+#include "BucketIndex.h"
+#include <sys/types.h>
+
+#define SHARD_MAGIC "LSBSHARD1"
+//labels are counted in 2^SHARD_HIST_BITS bins to balance the shards
+#define SHARD_HIST_BITS 16
+
+typedef struct {
+    int n;
+    int func;
+    int num_shards;
+    //shard i holds the labels in [bounds[i], bounds[i+1]), the last one
+    //up to bounds[num_shards] = max_label included
+    size_t* bounds;
+    char** files;
+    char* dir; //directory of the map, the files are relative to it
+} ShardMap;
+
+typedef struct {
+    ShardMap map;
+    pid_t* pids;
+    int* to; //request pipe of each shard
+    int* from; //response pipe of each shard
+} ShardClient;
+
+/*
+  The shift such that (label >> shift) < 2^SHARD_HIST_BITS for all labels
+  up to max_label.
+*/
+int shardHistShift(const size_t max_label);
+
+/*
+  Split [0, max_label] into num_shards ranges with about the same number
+  of postings, given hist[b], the number of postings with
+  (label >> shift) == b. The file of shard i is name.i, where name is the
+  file name of the map at path.
+*/
+void ShardMapBalance(ShardMap* m, const char* path, const int n,
+		     const int func, const size_t max_label,
+		     const size_t* hist, const int shift, const int num_shards);
+
+void ShardMapWrite(const ShardMap* m, const char* path);
+
+/*
+  Read the map at path. Exit with an error message if it is not valid.
+*/
+void ShardMapRead(ShardMap* m, const char* path);
+
+void ShardMapFree(ShardMap* m);
+
+/*
+  Return the shard holding label.
+*/
+int ShardMapFind(const ShardMap* m, const size_t label);
+
+/*
+  Return the largest label of shard i (bounds[i] if it is empty).
+*/
+size_t ShardMapLast(const ShardMap* m, const int i);
+
+/*
+  Return the path of the index of shard i, to be freed by the caller.
+*/
+char* ShardMapPath(const ShardMap* m, const int i);
+
+/*
+  Start one server process with num_threads workers per shard of the map
+  at path.
+*/
+void ShardClientStart(ShardClient* c, const char* path, const int num_threads);
+
+/*
+  Look up the buckets labels[0..num-1] on their shards. The ids of
+  labels[i] are (*ids)[offsets[i]..offsets[i+1]-1] in increasing order,
+  *ids is (re)allocated if *ids_size is too small and offsets has num+1
+  entries. Return the total number of ids.
+*/
+size_t ShardClientLookup(ShardClient* c, const size_t* labels, const size_t num,
+			 size_t** ids, size_t* ids_size, size_t* offsets);
+
+/*
+  Stop the server processes and free the client.
+*/
+void ShardClientStop(ShardClient* c);
+
+#endif // ShardedIndex.h
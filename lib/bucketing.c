@@ -0,0 +1,381 @@
+#include "bucketing.h"
+#include "metrics.h"
+
+//the vector lanes of assignBucketsBatch hold 64-bit k-mers
+#if defined(__GNUC__) && KMER_BITS != 128
+#define ASSIGN_LANES 1
+#endif
+
+void assignBucketsGeneric(const kmer x, const int n,
+			  blabel* buckets, const size_t st_idx){
+    int i;
+    blabel num_A[n], val[n], mu[n];
+    METRIC_INC(METRIC_ASSIGN_BUCKETS);
+
+    kmer mask = (kmer) 3 << ((n-1)<<1);
+    blabel p = (blabel) 1 << ((n-1)<<1); //ALPHABETSIZE^(n-1)
+    kmer cur = x & mask;
+
+    blabel sum_mu;
+
+    num_A[0] = 0;
+    val[0] = x - cur;
+    sum_mu = mu[0] = cur ? p + (cur >> 2)*(n-1) : val[0];
+
+    for(i=1; i<n; ++i){
+	num_A[i] = num_A[i-1] + (cur ? 0 : 1);
+
+	mask >>= 2;
+	cur = x & mask;
+	p >>= 2;
+
+	val[i] = val[i-1] - cur;
+	mu[i] = cur ? p + (cur >> 2) * (n-i-1) : val[i];
+	sum_mu += mu[i];
+    }
+
+    mask = (kmer) 3 << ((n-1)<<1);
+    size_t j=st_idx, tail = st_idx + n - num_A[n-1] - (cur ? 0 : 1);
+
+    for(i=0; i<n; ++i){
+	cur = x & mask;
+	mask >>= 2;
+	p = sum_mu - mu[i] + val[i] - num_A[i]*cur + 1 + num_A[i];
+	if(cur){
+	    buckets[j] = p;
+	    ++j;
+	}else{
+	    buckets[tail] = p;
+	    ++tail;
+	}
+    }
+}
+
+#if defined(__GNUC__)
+#define ASSIGN_INLINE static inline __attribute__((always_inline))
+#define ASSIGN_UNROLL _Pragma("GCC unroll 32")
+#else
+#define ASSIGN_INLINE static inline
+#define ASSIGN_UNROLL
+#endif
+
+/*
+  The body of assignBucketsGeneric for a compile-time n: both loops are
+  fully unrolled, so the masks, powers and multipliers are constants and
+  the fixed-size arrays are kept in registers.
+*/
+ASSIGN_INLINE void assignBucketsFixed(const kmer x, const int n,
+				      blabel* buckets, const size_t st_idx){
+    int i;
+    blabel num_A[ASSIGN_FIXED_MAX_N], val[ASSIGN_FIXED_MAX_N], mu[ASSIGN_FIXED_MAX_N];
+    METRIC_INC(METRIC_ASSIGN_BUCKETS);
+
+    kmer mask = (kmer) 3 << ((n-1)<<1);
+    blabel p = (blabel) 1 << ((n-1)<<1);
+    kmer cur = x & mask;
+
+    blabel sum_mu;
+
+    num_A[0] = 0;
+    val[0] = x - cur;
+    sum_mu = mu[0] = cur ? p + (cur >> 2)*(n-1) : val[0];
+
+    ASSIGN_UNROLL
+    for(i=1; i<n; ++i){
+	num_A[i] = num_A[i-1] + (cur ? 0 : 1);
+
+	mask >>= 2;
+	cur = x & mask;
+	p >>= 2;
+
+	val[i] = val[i-1] - cur;
+	mu[i] = cur ? p + (cur >> 2) * (n-i-1) : val[i];
+	sum_mu += mu[i];
+    }
+
+    mask = (kmer) 3 << ((n-1)<<1);
+    size_t j=st_idx, tail = st_idx + n - num_A[n-1] - (cur ? 0 : 1);
+
+    ASSIGN_UNROLL
+    for(i=0; i<n; ++i){
+	cur = x & mask;
+	mask >>= 2;
+	p = sum_mu - mu[i] + val[i] - num_A[i]*cur + 1 + num_A[i];
+	if(cur){
+	    buckets[j] = p;
+	    ++j;
+	}else{
+	    buckets[tail] = p;
+	    ++tail;
+	}
+    }
+}
+
+#ifdef ASSIGN_LANES
+
+typedef long unsigned vkmer __attribute__((vector_size(ASSIGN_BATCH_LANES * sizeof(kmer))));
+
+/*
+  Same recurrences as assignBuckets, one k-mer per lane. Instead of
+  keeping num_A, val and mu for every position, the first pass only
+  accumulates sum_mu and the second pass recomputes them on the fly.
+  The cur ? a : b selects become masks: (cur == 0) is all ones in the
+  lanes holding an A at the current position.
+*/
+ASSIGN_INLINE void assignBucketsLanes(const kmer* xs, const int n,
+				      blabel* buckets){
+    vkmer x, cur, val, mu, sum_mu, num_A, is_A, label, dest;
+    vkmer zero = {0};
+    int i, l, shift;
+    size_t p;
+
+    for(l=0; l<ASSIGN_BATCH_LANES; ++l){
+	x[l] = xs[l];
+    }
+
+    val = x;
+    sum_mu = zero;
+    num_A = zero;
+    p = 1lu << ((n-1)<<1);
+    ASSIGN_UNROLL
+    for(i=0, shift=(n-1)<<1; i<n; ++i, shift-=2, p>>=2){
+	cur = x & (3lu << shift);
+	val -= cur;
+	is_A = (vkmer)(cur == 0);
+	mu = (val & is_A) | ((p + (cur >> 2) * (n-i-1)) & ~is_A);
+	sum_mu += mu;
+	num_A -= is_A;
+    }
+
+    //buckets of A positions start after all the non-A ones
+    vkmer tail = n - num_A;
+
+    val = x;
+    num_A = zero;
+    p = 1lu << ((n-1)<<1);
+    ASSIGN_UNROLL
+    for(i=0, shift=(n-1)<<1; i<n; ++i, shift-=2, p>>=2){
+	cur = x & (3lu << shift);
+	val -= cur;
+	is_A = (vkmer)(cur == 0);
+	mu = (val & is_A) | ((p + (cur >> 2) * (n-i-1)) & ~is_A);
+	label = sum_mu - mu + val - num_A*cur + 1 + num_A;
+	dest = ((tail + num_A) & is_A) | ((i - num_A) & ~is_A);
+	for(l=0; l<ASSIGN_BATCH_LANES; ++l){
+	    buckets[l*n + dest[l]] = label[l];
+	}
+	num_A -= is_A;
+    }
+}
+
+#endif
+
+/*
+  assignBucketsBatch with assign for the k-mers left over by the lanes.
+  Inlined with a constant n and assign, the lanes are unrolled for n too.
+*/
+ASSIGN_INLINE void assignBucketsBatchWith(const kmer* xs, const size_t num, const int n,
+					  blabel* buckets, AssignBucketsFn assign){
+    size_t i = 0;
+#ifdef ASSIGN_LANES
+    for(; i+ASSIGN_BATCH_LANES<=num; i+=ASSIGN_BATCH_LANES){
+	assignBucketsLanes(xs+i, n, buckets+i*n);
+    }
+    METRIC_ADD(METRIC_ASSIGN_BUCKETS, i);
+#endif
+    //scalar fallback for the remainder
+    for(; i<num; ++i){
+	assign(xs[i], n, buckets, i*n);
+    }
+}
+
+typedef void (*AssignBatchFn)(const kmer* xs, const size_t num, const int n,
+			      blabel* buckets);
+
+/*
+  A batch kernel for n = N (ignoring its n argument) compiled for the
+  instruction set of a level of simd.h: the lanes of assignBucketsLanes
+  fill one register only from AVX2 on.
+*/
+#define ASSIGN_BATCH_TARGET(N, LEVEL, TARGET)				\
+    TARGET static void assignBucketsBatch##LEVEL##N(const kmer* xs, const size_t num, \
+						    const int n, blabel* buckets){ \
+	(void) n;							\
+	assignBucketsBatchWith(xs, num, N, buckets, assignBuckets##N);	\
+    }
+
+#ifdef SIMD_X86
+#define ASSIGN_BATCH_X86(N)					\
+    ASSIGN_BATCH_TARGET(N, Sse42_, SIMD_TARGET_SSE42)		\
+    ASSIGN_BATCH_TARGET(N, Avx2_, SIMD_TARGET_AVX2)		\
+    ASSIGN_BATCH_TARGET(N, Avx512_, SIMD_TARGET_AVX512)
+#define ASSIGN_BATCH_LEVELS(N)						\
+    {assignBucketsBatch##N, assignBucketsBatchSse42_##N,		\
+     assignBucketsBatchAvx2_##N, assignBucketsBatchAvx512_##N}
+#else
+#define ASSIGN_BATCH_X86(N)
+#define ASSIGN_BATCH_LEVELS(N)						\
+    {assignBucketsBatch##N, assignBucketsBatch##N,			\
+     assignBucketsBatch##N, assignBucketsBatch##N}
+#endif
+
+//the kernels for n = N, which ignore their n argument
+#define ASSIGN_BUCKETS_N(N)						\
+    static void assignBuckets##N(const kmer x, const int n,		\
+				 blabel* buckets, const size_t st_idx){	\
+	(void) n;							\
+	assignBucketsFixed(x, N, buckets, st_idx);			\
+    }									\
+    ASSIGN_BATCH_TARGET(N, , )						\
+    ASSIGN_BATCH_X86(N)
+
+ASSIGN_BUCKETS_N(4) ASSIGN_BUCKETS_N(5) ASSIGN_BUCKETS_N(6) ASSIGN_BUCKETS_N(7)
+ASSIGN_BUCKETS_N(8) ASSIGN_BUCKETS_N(9) ASSIGN_BUCKETS_N(10) ASSIGN_BUCKETS_N(11)
+ASSIGN_BUCKETS_N(12) ASSIGN_BUCKETS_N(13) ASSIGN_BUCKETS_N(14) ASSIGN_BUCKETS_N(15)
+ASSIGN_BUCKETS_N(16) ASSIGN_BUCKETS_N(17) ASSIGN_BUCKETS_N(18) ASSIGN_BUCKETS_N(19)
+ASSIGN_BUCKETS_N(20) ASSIGN_BUCKETS_N(21) ASSIGN_BUCKETS_N(22) ASSIGN_BUCKETS_N(23)
+ASSIGN_BUCKETS_N(24) ASSIGN_BUCKETS_N(25) ASSIGN_BUCKETS_N(26) ASSIGN_BUCKETS_N(27)
+ASSIGN_BUCKETS_N(28) ASSIGN_BUCKETS_N(29) ASSIGN_BUCKETS_N(30) ASSIGN_BUCKETS_N(31)
+ASSIGN_BUCKETS_N(32)
+
+static void assignBucketsBatchGeneric(const kmer* xs, const size_t num, const int n,
+				      blabel* buckets){
+    assignBucketsBatchWith(xs, num, n, buckets, assignBucketsGeneric);
+}
+
+typedef struct {
+    AssignBucketsFn one;
+    AssignBatchFn batch[SIMD_LEVELS];
+} AssignKernels;
+
+#define ASSIGN_KERNELS(N) {assignBuckets##N, ASSIGN_BATCH_LEVELS(N)}
+
+//indexed by n - ASSIGN_FIXED_MIN_N
+static const AssignKernels assign_fixed[ASSIGN_FIXED_MAX_N - ASSIGN_FIXED_MIN_N + 1] = {
+    ASSIGN_KERNELS(4), ASSIGN_KERNELS(5), ASSIGN_KERNELS(6), ASSIGN_KERNELS(7),
+    ASSIGN_KERNELS(8), ASSIGN_KERNELS(9), ASSIGN_KERNELS(10), ASSIGN_KERNELS(11),
+    ASSIGN_KERNELS(12), ASSIGN_KERNELS(13), ASSIGN_KERNELS(14), ASSIGN_KERNELS(15),
+    ASSIGN_KERNELS(16), ASSIGN_KERNELS(17), ASSIGN_KERNELS(18), ASSIGN_KERNELS(19),
+    ASSIGN_KERNELS(20), ASSIGN_KERNELS(21), ASSIGN_KERNELS(22), ASSIGN_KERNELS(23),
+    ASSIGN_KERNELS(24), ASSIGN_KERNELS(25), ASSIGN_KERNELS(26), ASSIGN_KERNELS(27),
+    ASSIGN_KERNELS(28), ASSIGN_KERNELS(29), ASSIGN_KERNELS(30), ASSIGN_KERNELS(31),
+    ASSIGN_KERNELS(32)
+};
+
+//set by bucketingBindSimd
+static SimdLevel assign_level = SIMD_SCALAR;
+
+void bucketingBindSimd(SimdLevel level){
+    assign_level = level;
+}
+
+static inline int hasFixedKernels(const int n){
+    return n >= ASSIGN_FIXED_MIN_N && n <= ASSIGN_FIXED_MAX_N;
+}
+
+AssignBucketsFn assignBucketsFor(const int n){
+    return hasFixedKernels(n) ? assign_fixed[n - ASSIGN_FIXED_MIN_N].one : assignBucketsGeneric;
+}
+
+void assignBuckets(const kmer x, const int n,
+		   blabel* buckets, const size_t st_idx){
+    assignBucketsFor(n)(x, n, buckets, st_idx);
+}
+
+void assignBucketsBatch(const kmer* xs, const size_t num, const int n,
+			blabel* buckets){
+    if(hasFixedKernels(n)){
+	assign_fixed[n - ASSIGN_FIXED_MIN_N].batch[assign_level](xs, num, n, buckets);
+    }else{
+	assignBucketsBatchGeneric(xs, num, n, buckets);
+    }
+}
+
+/*
+  The labels are handed out by scanning the n-mers in increasing order
+  and, within an n-mer, its A's from left to right. So the number of
+  labels used by all the n-mers sharing a prefix with z A's and followed
+  by R free positions is z*4^R + R*4^(R-1). Fix the n-mer one position
+  at a time by skipping such blocks, then pick the A within the n-mer.
+*/
+int bucketMembers(const blabel label, const int n, kmer members[4]){
+    blabel q = (blabel) 1 << ((n-1)<<1); //4^(n-1)
+    if(label == 0 || label > q * n) return 0;
+
+    blabel rank = label - 1, block;
+    kmer x = 0;
+    int i, d, z = 0;
+    for(i=n-1; i>=0; --i){
+	//q = 4^i, the number of n-mers in each block below this position
+	for(d=0; d<3; ++d){
+	    block = (z + (d ? 0 : 1)) * q + i * (q >> 2);
+	    if(rank < block) break;
+	    rank -= block;
+	}
+	x = (x << 2) | d;
+	if(d == 0) z += 1;
+	q >>= 2;
+    }
+
+    //rank is now the index of the A (from the left) that forms the bucket
+    for(i=n-1; i>=0; --i){
+	if(((x >> (i<<1)) & 3) == 0){
+	    if(rank == 0) break;
+	    rank -= 1;
+	}
+    }
+
+    for(d=0; d<4; ++d){
+	members[d] = x | ((kmer) d << (i<<1));
+    }
+    return 4;
+}
+
+int assignSampleBuckets(const kmer x, const int n,
+			blabel* buckets, const size_t st_idx){
+    //isInSampleD1 tests b_0 - b_1 - ... - b_{n-1} = 0 (mod 4),
+    //where b_0 is the last base
+    kmer y = x;
+    int i, j, part = y & 3;
+    for(i=1; i<n; ++i){
+	y >>= 2;
+	part -= y & 3;
+    }
+    part &= 3;
+    if(part == 0){
+	buckets[st_idx] = x;
+	return 1;
+    }
+
+    //fix base i by adding part (subtracting it for the last base),
+    //then insertion sort the labels
+    blabel* out = buckets + st_idx;
+    kmer b, label;
+    for(i=0; i<n; ++i){
+	b = (x >> (i<<1)) & 3;
+	b = (i ? b + part : b - part) & 3;
+	label = (x & ~((kmer) 3 << (i<<1))) | (b << (i<<1));
+	for(j=i-1; j>=0 && out[j]>label; --j){
+	    out[j+1] = out[j];
+	}
+	out[j+1] = label;
+    }
+    return n;
+}
+
+int assignBucketsWith(const int func, const kmer x, const int n,
+		      blabel* buckets, const size_t st_idx){
+    if(func == BUCKET_FUNC_SAMPLE){
+	return assignSampleBuckets(x, n, buckets, st_idx);
+    }
+    assignBuckets(x, n, buckets, st_idx);
+    return n;
+}
+
+size_t maxBucketLabel(const int func, const int n){
+    blabel max = func == BUCKET_FUNC_SAMPLE ? KMER_MASK(n) : ((blabel) 1 << ((n-1)<<1)) * n;
+#if KMER_BITS == 128
+    if(max > (size_t) -1) return (size_t) -1;
+#endif
+    return max;
+}
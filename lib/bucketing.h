@@ -0,0 +1,151 @@
+/*
+  The optimal (1,2)-sensitive bucketing function on length-n sequences.
+  Each n-mer is assigned to n buckets (positive integer labels from 1 to
+  n*4^{n-1}), each bucket contains |\Sigma| n-mers.
+  See the manuscript for explanation of the algorithm.
+
+  Labels fit in a blabel as long as n*4^{n-1} does, i.e., n <= 30, or
+  n <= 62 with KMER_BITS=128.
+*/
+
+#ifndef _BUCKETING_H
+#define _BUCKETING_H 1
+
+#include "util.h"
+
+/*
+  A bucket label. With KMER_BITS=128 it is as wide as a kmer, since the
+  labels of n > 30 need more than 64 bits. The index modules (BucketIndex,
+  SelfJoin, ...) keep labels in a size_t, see assignBucketsWith64.
+*/
+#if KMER_BITS == 128
+typedef kmer blabel;
+#else
+typedef size_t blabel;
+#endif
+
+//the bucketing functions, see assignBucketsWith
+#define BUCKET_FUNC_OPT12 0 //assignBuckets
+#define BUCKET_FUNC_SAMPLE 1 //assignSampleBuckets
+
+//the largest n whose labels of the bucketing function func fit in a blabel
+#define BUCKET_MAX_N(func) ((func) == BUCKET_FUNC_SAMPLE ? KMER_MAX_K : KMER_MAX_K - 2)
+
+//number of k-mers processed together by assignBucketsBatch
+#define ASSIGN_BATCH_LANES 4
+
+//n with a specialized assignBuckets kernel, see assignBucketsFor
+#define ASSIGN_FIXED_MIN_N 4
+#define ASSIGN_FIXED_MAX_N 32
+
+//the signature of assignBuckets and of its kernels
+typedef void (*AssignBucketsFn)(const kmer x, const int n,
+				blabel* buckets, const size_t st_idx);
+
+/*
+  Assign all the buckets for a given kmer x. Results are stored
+  in the buckets array from st_idx to st_idx+n-1.
+  Buckets obtained at positions holding C, G or T come first (in the order
+  of positions from the left), followed by those at positions holding A.
+*/
+void assignBuckets(const kmer x, const int n,
+		   blabel* buckets, const size_t st_idx);
+
+/*
+  The same as assignBuckets for any n, with the loops over n run at
+  run time and the state in variable length arrays.
+*/
+void assignBucketsGeneric(const kmer x, const int n,
+			  blabel* buckets, const size_t st_idx);
+
+/*
+  The kernel used by assignBuckets for length-n k-mers: for n from
+  ASSIGN_FIXED_MIN_N to ASSIGN_FIXED_MAX_N a version compiled for that n
+  (fully unrolled, fixed-size state), otherwise assignBucketsGeneric.
+  Look it up once and call it in loops over k-mers of the same length
+  to save the dispatch of assignBuckets on every call.
+*/
+AssignBucketsFn assignBucketsFor(const int n);
+
+/*
+  Assign the buckets for num k-mers at once. The buckets of xs[i] are
+  stored in buckets[i*n .. i*n+n-1], in the same order as assignBuckets.
+  Every ASSIGN_BATCH_LANES k-mers are processed in vector lanes with
+  branch-free selects, the remaining ones go through assignBuckets.
+  Like assignBuckets, the loop is picked once per call from versions
+  compiled for each n in [ASSIGN_FIXED_MIN_N, ASSIGN_FIXED_MAX_N] and
+  for each instruction set of simd.h (the level bound at startup).
+*/
+void assignBucketsBatch(const kmer* xs, const size_t num, const int n,
+			blabel* buckets);
+
+/*
+  Bind the batch kernels to a level of simd.h, called by simdSetLevel.
+*/
+void bucketingBindSimd(SimdLevel level);
+
+/*
+  The inverse of assignBuckets: store the |\Sigma| n-mers in the bucket
+  with the given label into members (in the order A, C, G, T at the
+  position where they differ) and return the number of members, which is
+  always 4 for a valid label. Return 0 if label is not in [1, n*4^{n-1}].
+  Runs in O(n) time without any global table.
+*/
+int bucketMembers(const blabel label, const int n, kmer members[4]);
+
+/*
+  The (1,3)-sensitive bucketing function whose buckets are labeled by the
+  (1,1)-guaranteed sample tested by isInSampleD1: x is assigned to every
+  sample n-mer within edit distance 1 (a substitution) of it. Since each
+  position of x has exactly one base that puts x in the sample, this is
+  x itself if x is in the sample, otherwise n distinct n-mers. The labels
+  (the encoded n-mers) are stored in increasing order in the buckets array
+  from st_idx on, the number of buckets is returned.
+*/
+int assignSampleBuckets(const kmer x, const int n,
+			blabel* buckets, const size_t st_idx);
+
+/*
+  Assign the buckets of x by the bucketing function func (one of the
+  BUCKET_FUNC_* values), return the number of buckets (at most n).
+*/
+int assignBucketsWith(const int func, const kmer x, const int n,
+		      blabel* buckets, const size_t st_idx);
+
+/*
+  assignBucketsWith for the modules that keep labels in a size_t: the
+  same call in the default build. With KMER_BITS=128, a label is folded
+  into its low 64 bits xor a mix of its high 64 bits (labels below 2^64
+  are kept), which may merge buckets (more candidates to verify) but
+  never splits one. Plain truncation would merge the buckets of one
+  k-mer, whose labels often differ only in the high bits.
+*/
+static inline int assignBucketsWith64(const int func, const kmer x, const int n,
+				      size_t* buckets, const size_t st_idx){
+#if KMER_BITS == 128
+    blabel labels[n];
+    int num = assignBucketsWith(func, x, n, labels, 0), i;
+    size_t hi;
+    for(i=0; i<num; ++i){
+	//the finalizer of MurmurHash3, 0 only for 0
+	hi = labels[i] >> 64;
+	hi ^= hi >> 33;
+	hi *= 0xff51afd7ed558ccdlu;
+	hi ^= hi >> 33;
+	hi *= 0xc4ceb9fe1a85ec53lu;
+	hi ^= hi >> 33;
+	buckets[st_idx+i] = (size_t) labels[i] ^ hi;
+    }
+    return num;
+#else
+    return assignBucketsWith(func, x, n, buckets, st_idx);
+#endif
+}
+
+/*
+  The largest label that can be assigned by the bucketing function func,
+  or the largest size_t if it does not fit in one (with KMER_BITS=128).
+*/
+size_t maxBucketLabel(const int func, const int n);
+
+#endif // bucketing.h
@@ -0,0 +1,396 @@
+#include "codec.h"
+#include <string.h>
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+  The bases have distinct low 4 bits (A 0x41, C 0x43, T 0x54, G 0x47,
+  the same in lower case), so the code of a character is a lookup of its
+  low 4 bits, and it is a base iff it equals the base with the same low
+  4 bits up to case (bit 5). The lookups fit a shuffle of 16 bytes
+  (pshufb); the entry of the low bits of no base is 0, or 0xff for 0,
+  so that no character matches it.
+*/
+static const unsigned char codec_codes[16] = {0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0};
+static const unsigned char codec_bases[16] = {0xff, 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 0, 0};
+
+//clears the bit of lower case
+#define CODEC_UPPER 0xdf
+
+//the base of the high and the low 2 bits of 4 bits
+static const char codec_high[16] = "AAAACCCCGGGGTTTT";
+static const char codec_low[16] = "ACGTACGTACGTACGT";
+
+//the k-mers of encodeKMers are rolled over the codes of blocks of this many bases
+#define CODEC_BLOCK 1024
+
+static size_t encodeBasesScalar(const char* str, const size_t len, unsigned char* codes){
+    size_t i;
+    unsigned char c;
+    for(i=0; i<len; i+=1){
+	c = str[i];
+	if((c & CODEC_UPPER) != codec_bases[c & 15]) break;
+	codes[i] = codec_codes[c & 15];
+    }
+    return i;
+}
+
+static void decodeBasesScalar(const unsigned char* codes, const size_t len, char* str){
+    size_t i;
+    for(i=0; i<len; i+=1){
+	str[i] = codec_low[codes[i] & 3];
+    }
+}
+
+static size_t packBasesScalar(const char* str, const size_t len, unsigned char* packed){
+    size_t i;
+    unsigned char c, byte = 0;
+    for(i=0; i<len; i+=1){
+	c = str[i];
+	if((c & CODEC_UPPER) != codec_bases[c & 15]) break;
+	byte = byte << 2 | codec_codes[c & 15];
+	if((i & 3) == 3){
+	    packed[i >> 2] = byte;
+	    byte = 0;
+	}
+    }
+    if(i & 3) packed[i >> 2] = byte << ((4 - (i & 3)) << 1);
+    return i;
+}
+
+static void unpackBasesScalar(const unsigned char* packed, const size_t len, char* str){
+    size_t i;
+    for(i=0; i<len; i+=1){
+	str[i] = codec_low[packed[i >> 2] >> ((3 - (i & 3)) << 1) & 3];
+    }
+}
+
+#ifdef SIMD_X86
+//for unpacking: the packed byte of each output byte, and the selects of
+//the low 4 bits (bases 2 and 3 of a byte) and of the low 2 bits (bases 1, 3)
+static const unsigned char codec_spread[64] = {
+    0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+    4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+    8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15
+};
+static const unsigned char codec_nibble_sel[16] = {
+    0, 0, 0xff, 0xff, 0, 0, 0xff, 0xff, 0, 0, 0xff, 0xff, 0, 0, 0xff, 0xff
+};
+static const unsigned char codec_pair_sel[16] = {
+    0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff
+};
+//for packing: the low byte of each 32-bit word to the first 4 bytes
+static const unsigned char codec_gather[16] = {
+    0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+#define CODEC_LOAD_128(t) _mm_loadu_si128((const __m128i*) (t))
+
+/*
+  The codes of 16 characters in the bytes of a vector, and the mask of
+  the non-bases among them.
+*/
+SIMD_TARGET_SSE42 static inline __m128i encode16(const char* str, unsigned* bad){
+    __m128i c = _mm_loadu_si128((const __m128i*) str);
+    __m128i low = _mm_and_si128(c, _mm_set1_epi8(15));
+    __m128i bases = _mm_shuffle_epi8(CODEC_LOAD_128(codec_bases), low);
+    c = _mm_and_si128(c, _mm_set1_epi8((char) CODEC_UPPER));
+    *bad = ~_mm_movemask_epi8(_mm_cmpeq_epi8(c, bases)) & 0xffff;
+    return _mm_shuffle_epi8(CODEC_LOAD_128(codec_codes), low);
+}
+
+SIMD_TARGET_SSE42 static size_t encodeBasesSse42(const char* str, const size_t len,
+						 unsigned char* codes){
+    size_t i;
+    unsigned bad;
+    __m128i v;
+    for(i=0; i+16<=len; i+=16){
+	v = encode16(str+i, &bad);
+	_mm_storeu_si128((__m128i*) (codes+i), v);
+	if(bad) return i + __builtin_ctz(bad);
+    }
+    return i + encodeBasesScalar(str+i, len-i, codes+i);
+}
+
+SIMD_TARGET_SSE42 static void decodeBasesSse42(const unsigned char* codes, const size_t len,
+					       char* str){
+    const __m128i lut = CODEC_LOAD_128(codec_low), low = _mm_set1_epi8(15);
+    size_t i;
+    __m128i v;
+    for(i=0; i+16<=len; i+=16){
+	v = _mm_and_si128(_mm_loadu_si128((const __m128i*) (codes+i)), low);
+	_mm_storeu_si128((__m128i*) (str+i), _mm_shuffle_epi8(lut, v));
+    }
+    decodeBasesScalar(codes+i, len-i, str+i);
+}
+
+SIMD_TARGET_SSE42 static size_t packBasesSse42(const char* str, const size_t len,
+					       unsigned char* packed){
+    const __m128i pairs = _mm_set1_epi16(0x0104), quads = _mm_set1_epi32(0x00010010);
+    const __m128i gather = CODEC_LOAD_128(codec_gather);
+    size_t i;
+    unsigned bad;
+    int word;
+    __m128i v;
+    for(i=0; i+16<=len; i+=16){
+	v = encode16(str+i, &bad);
+	if(bad) break;
+	//c0*4 + c1 in 16 bits, then (c0*4 + c1)*16 + c2*4 + c3 in 32 bits
+	v = _mm_madd_epi16(_mm_maddubs_epi16(v, pairs), quads);
+	word = _mm_cvtsi128_si32(_mm_shuffle_epi8(v, gather));
+	memcpy(packed + (i >> 2), &word, 4);
+    }
+    return i + packBasesScalar(str+i, len-i, packed + (i >> 2));
+}
+
+/*
+  The bases of the 4 packed bytes of each 128-bit lane picked by spread:
+  each output byte takes the high 4 bits of its packed byte for bases 0
+  and 1 and the low 4 bits for bases 2 and 3, then the base of their
+  high 2 bits for bases 0 and 2 and of their low 2 bits for bases 1, 3.
+*/
+SIMD_TARGET_SSE42 static inline __m128i unpack16(__m128i v){
+    __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(15));
+    __m128i low = _mm_and_si128(v, _mm_set1_epi8(15));
+    v = _mm_blendv_epi8(high, low, CODEC_LOAD_128(codec_nibble_sel));
+    return _mm_blendv_epi8(_mm_shuffle_epi8(CODEC_LOAD_128(codec_high), v),
+			   _mm_shuffle_epi8(CODEC_LOAD_128(codec_low), v),
+			   CODEC_LOAD_128(codec_pair_sel));
+}
+
+SIMD_TARGET_SSE42 static void unpackBasesSse42(const unsigned char* packed, const size_t len,
+					       char* str){
+    const __m128i spread = CODEC_LOAD_128(codec_spread);
+    size_t i;
+    int word;
+    for(i=0; i+16<=len; i+=16){
+	memcpy(&word, packed + (i >> 2), 4);
+	_mm_storeu_si128((__m128i*) (str+i),
+			 unpack16(_mm_shuffle_epi8(_mm_cvtsi32_si128(word), spread)));
+    }
+    unpackBasesScalar(packed + (i >> 2), len-i, str+i);
+}
+
+//the 16 bytes of t in both 128-bit lanes, pshufb shuffles within lanes
+#define CODEC_LOAD_256(t) _mm256_broadcastsi128_si256(CODEC_LOAD_128(t))
+
+SIMD_TARGET_AVX2 static inline __m256i encode32(const char* str, unsigned* bad){
+    __m256i c = _mm256_loadu_si256((const __m256i*) str);
+    __m256i low = _mm256_and_si256(c, _mm256_set1_epi8(15));
+    __m256i bases = _mm256_shuffle_epi8(CODEC_LOAD_256(codec_bases), low);
+    c = _mm256_and_si256(c, _mm256_set1_epi8((char) CODEC_UPPER));
+    *bad = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, bases));
+    return _mm256_shuffle_epi8(CODEC_LOAD_256(codec_codes), low);
+}
+
+SIMD_TARGET_AVX2 static size_t encodeBasesAvx2(const char* str, const size_t len,
+					       unsigned char* codes){
+    size_t i;
+    unsigned bad;
+    __m256i v;
+    for(i=0; i+32<=len; i+=32){
+	v = encode32(str+i, &bad);
+	_mm256_storeu_si256((__m256i*) (codes+i), v);
+	if(bad) return i + __builtin_ctz(bad);
+    }
+    return i + encodeBasesScalar(str+i, len-i, codes+i);
+}
+
+SIMD_TARGET_AVX2 static void decodeBasesAvx2(const unsigned char* codes, const size_t len,
+					     char* str){
+    const __m256i lut = CODEC_LOAD_256(codec_low), low = _mm256_set1_epi8(15);
+    size_t i;
+    __m256i v;
+    for(i=0; i+32<=len; i+=32){
+	v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (codes+i)), low);
+	_mm256_storeu_si256((__m256i*) (str+i), _mm256_shuffle_epi8(lut, v));
+    }
+    decodeBasesScalar(codes+i, len-i, str+i);
+}
+
+SIMD_TARGET_AVX2 static size_t packBasesAvx2(const char* str, const size_t len,
+					     unsigned char* packed){
+    const __m256i pairs = _mm256_set1_epi16(0x0104), quads = _mm256_set1_epi32(0x00010010);
+    const __m256i gather = CODEC_LOAD_256(codec_gather);
+    const __m256i lanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    size_t i;
+    unsigned bad;
+    __m256i v;
+    for(i=0; i+32<=len; i+=32){
+	v = encode32(str+i, &bad);
+	if(bad) break;
+	v = _mm256_madd_epi16(_mm256_maddubs_epi16(v, pairs), quads);
+	v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, gather), lanes);
+	_mm_storel_epi64((__m128i*) (packed + (i >> 2)), _mm256_castsi256_si128(v));
+    }
+    return i + packBasesScalar(str+i, len-i, packed + (i >> 2));
+}
+
+SIMD_TARGET_AVX2 static void unpackBasesAvx2(const unsigned char* packed, const size_t len,
+					     char* str){
+    const __m256i spread = _mm256_loadu_si256((const __m256i*) codec_spread);
+    const __m256i low_bits = _mm256_set1_epi8(15);
+    const __m256i nibble_sel = CODEC_LOAD_256(codec_nibble_sel);
+    const __m256i pair_sel = CODEC_LOAD_256(codec_pair_sel);
+    const __m256i high_lut = CODEC_LOAD_256(codec_high), low_lut = CODEC_LOAD_256(codec_low);
+    size_t i;
+    long long word;
+    __m256i v, high, low;
+    for(i=0; i+32<=len; i+=32){
+	memcpy(&word, packed + (i >> 2), 8);
+	v = _mm256_shuffle_epi8(_mm256_set1_epi64x(word), spread);
+	high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_bits);
+	low = _mm256_and_si256(v, low_bits);
+	v = _mm256_blendv_epi8(high, low, nibble_sel);
+	v = _mm256_blendv_epi8(_mm256_shuffle_epi8(high_lut, v),
+			       _mm256_shuffle_epi8(low_lut, v), pair_sel);
+	_mm256_storeu_si256((__m256i*) (str+i), v);
+    }
+    unpackBasesScalar(packed + (i >> 2), len-i, str+i);
+}
+
+#define CODEC_LOAD_512(t) _mm512_broadcast_i32x4(CODEC_LOAD_128(t))
+
+SIMD_TARGET_AVX512 static inline __m512i encode64(const char* str, __mmask64* bad){
+    __m512i c = _mm512_loadu_si512((const void*) str);
+    __m512i low = _mm512_and_si512(c, _mm512_set1_epi8(15));
+    __m512i bases = _mm512_shuffle_epi8(CODEC_LOAD_512(codec_bases), low);
+    c = _mm512_and_si512(c, _mm512_set1_epi8((char) CODEC_UPPER));
+    *bad = ~_mm512_cmpeq_epi8_mask(c, bases);
+    return _mm512_shuffle_epi8(CODEC_LOAD_512(codec_codes), low);
+}
+
+SIMD_TARGET_AVX512 static size_t encodeBasesAvx512(const char* str, const size_t len,
+						   unsigned char* codes){
+    size_t i;
+    __mmask64 bad;
+    __m512i v;
+    for(i=0; i+64<=len; i+=64){
+	v = encode64(str+i, &bad);
+	_mm512_storeu_si512((void*) (codes+i), v);
+	if(bad) return i + __builtin_ctzll(bad);
+    }
+    return i + encodeBasesScalar(str+i, len-i, codes+i);
+}
+
+SIMD_TARGET_AVX512 static void decodeBasesAvx512(const unsigned char* codes, const size_t len,
+						 char* str){
+    const __m512i lut = CODEC_LOAD_512(codec_low), low = _mm512_set1_epi8(15);
+    size_t i;
+    __m512i v;
+    for(i=0; i+64<=len; i+=64){
+	v = _mm512_and_si512(_mm512_loadu_si512((const void*) (codes+i)), low);
+	_mm512_storeu_si512((void*) (str+i), _mm512_shuffle_epi8(lut, v));
+    }
+    decodeBasesScalar(codes+i, len-i, str+i);
+}
+
+SIMD_TARGET_AVX512 static size_t packBasesAvx512(const char* str, const size_t len,
+						 unsigned char* packed){
+    const __m512i pairs = _mm512_set1_epi16(0x0104), quads = _mm512_set1_epi32(0x00010010);
+    const __m512i gather = CODEC_LOAD_512(codec_gather);
+    const __m512i lanes = _mm512_setr_epi32(0, 4, 8, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i;
+    __mmask64 bad;
+    __m512i v;
+    for(i=0; i+64<=len; i+=64){
+	v = encode64(str+i, &bad);
+	if(bad) break;
+	v = _mm512_madd_epi16(_mm512_maddubs_epi16(v, pairs), quads);
+	v = _mm512_permutexvar_epi32(lanes, _mm512_shuffle_epi8(v, gather));
+	_mm_storeu_si128((__m128i*) (packed + (i >> 2)), _mm512_castsi512_si128(v));
+    }
+    return i + packBasesScalar(str+i, len-i, packed + (i >> 2));
+}
+
+SIMD_TARGET_AVX512 static void unpackBasesAvx512(const unsigned char* packed, const size_t len,
+						 char* str){
+    const __m512i spread = _mm512_loadu_si512((const void*) codec_spread);
+    const __m512i low_bits = _mm512_set1_epi8(15);
+    const __m512i high_lut = CODEC_LOAD_512(codec_high), low_lut = CODEC_LOAD_512(codec_low);
+    const __mmask64 nibble_sel = 0xccccccccccccccccllu, pair_sel = 0xaaaaaaaaaaaaaaaallu;
+    size_t i;
+    __m512i v, high, low;
+    for(i=0; i+64<=len; i+=64){
+	v = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*) (packed + (i >> 2))));
+	v = _mm512_shuffle_epi8(v, spread);
+	high = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_bits);
+	low = _mm512_and_si512(v, low_bits);
+	v = _mm512_mask_blend_epi8(nibble_sel, high, low);
+	v = _mm512_mask_blend_epi8(pair_sel, _mm512_shuffle_epi8(high_lut, v),
+				   _mm512_shuffle_epi8(low_lut, v));
+	_mm512_storeu_si512((void*) (str+i), v);
+    }
+    unpackBasesScalar(packed + (i >> 2), len-i, str+i);
+}
+#endif
+
+//set by codecBindSimd
+static size_t (*encode_bases)(const char*, size_t, unsigned char*) = encodeBasesScalar;
+static void (*decode_bases)(const unsigned char*, size_t, char*) = decodeBasesScalar;
+static size_t (*pack_bases)(const char*, size_t, unsigned char*) = packBasesScalar;
+static void (*unpack_bases)(const unsigned char*, size_t, char*) = unpackBasesScalar;
+
+void codecBindSimd(SimdLevel level){
+    encode_bases = encodeBasesScalar;
+    decode_bases = decodeBasesScalar;
+    pack_bases = packBasesScalar;
+    unpack_bases = unpackBasesScalar;
+#ifdef SIMD_X86
+    if(level >= SIMD_AVX512){
+	encode_bases = encodeBasesAvx512;
+	decode_bases = decodeBasesAvx512;
+	pack_bases = packBasesAvx512;
+	unpack_bases = unpackBasesAvx512;
+    }else if(level >= SIMD_AVX2){
+	encode_bases = encodeBasesAvx2;
+	decode_bases = decodeBasesAvx2;
+	pack_bases = packBasesAvx2;
+	unpack_bases = unpackBasesAvx2;
+    }else if(level >= SIMD_SSE42){
+	encode_bases = encodeBasesSse42;
+	decode_bases = decodeBasesSse42;
+	pack_bases = packBasesSse42;
+	unpack_bases = unpackBasesSse42;
+    }
+#endif
+}
+
+size_t encodeBases(const char* str, const size_t len, unsigned char* codes){
+    return encode_bases(str, len, codes);
+}
+
+void decodeBases(const unsigned char* codes, const size_t len, char* str){
+    decode_bases(codes, len, str);
+}
+
+size_t packBases(const char* str, const size_t len, unsigned char* packed){
+    return pack_bases(str, len, packed);
+}
+
+void unpackBases(const unsigned char* packed, const size_t len, char* str){
+    unpack_bases(packed, len, str);
+}
+
+size_t encodeKMers(const char* str, const size_t len, const int k, kmer* kmers){
+    unsigned char codes[CODEC_BLOCK];
+    const kmer mask = KMER_MASK(k);
+    kmer x = 0;
+    size_t st, i, m, r;
+    for(st=0; st<len; st+=m){
+	m = len - st < CODEC_BLOCK ? len - st : CODEC_BLOCK;
+	r = encode_bases(str+st, m, codes);
+	//the bases shifted out of x are masked off the stored k-mers
+	for(i=0; i<r && st+i+1 < (size_t) k; i+=1){
+	    x = (x << 2) + codes[i];
+	}
+	for(; i<r; i+=1){
+	    x = (x << 2) + codes[i];
+	    kmers[st+i+1-k] = x & mask;
+	}
+	if(r < m) return st + r;
+    }
+    return len;
+}
@@ -0,0 +1,61 @@
+/*
+  Bulk conversions between DNA strings and the 2-bit encoding of util.h
+  (A-00, C-01, G-10, T-11), for whole reads instead of one k-mer at a
+  time as encode and decode do. The kernels translate 16 (SSE4.2), 32
+  (AVX2) or 64 (AVX-512) characters per instruction with lookup shuffles
+  on their low 4 bits and are bound to the level of simd.h; every level
+  gives identical results (see bench-codec.out).
+
+  Only A, C, G and T, in upper or lower (soft-masked) case, are bases.
+  The functions that read strings stop at the first other character
+  (e.g. N) and return its index, or len if there is none.
+*/
+
+#ifndef _CODEC_H
+#define _CODEC_H 1
+
+#include "util.h"
+
+/*
+  Store the code (0-3) of each of the first len characters of str in a
+  byte of codes. Return the index r of the first non-base: codes[0..r)
+  are set, the rest of codes[0..len) is unspecified.
+*/
+size_t encodeBases(const char* str, const size_t len, unsigned char* codes);
+
+/*
+  The inverse of encodeBases: store the bases of the len codes (taken
+  mod 4) in str, without a terminating '\0'.
+*/
+void decodeBases(const unsigned char* codes, const size_t len, char* str);
+
+/*
+  Pack the first len characters of str into (len+3)/4 bytes, 4 bases
+  per byte with the first one in the high bits (so that the bytes of a
+  sequence read in order are its encoding as in encode), and the unused
+  low bits of the last byte 0. Return the index r of the first non-base:
+  only the first r bases are packed.
+*/
+size_t packBases(const char* str, const size_t len, unsigned char* packed);
+
+/*
+  The inverse of packBases: store the len bases of packed in str,
+  without a terminating '\0'.
+*/
+void unpackBases(const unsigned char* packed, const size_t len, char* str);
+
+/*
+  Encode all the k-mers of str in one pass: kmers[i] = encode(str+i, k)
+  for i = 0, ..., len-k. Return the index r of the first non-base: only
+  the r-k+1 k-mers before it (none if r < k) are stored, so the next
+  k-mer without a non-base starts at r+1.
+*/
+size_t encodeKMers(const char* str, const size_t len, const int k, kmer* kmers);
+
+/*
+  Bind the kernels of this module to a level of simd.h, called by
+  simdSetLevel.
+*/
+void codecBindSimd(SimdLevel level);
+
+#endif // codec.h
@@ -0,0 +1,93 @@
+#include "metrics.h"
+#include <time.h>
+
+long unsigned metrics[METRIC_COUNT];
+
+#ifdef LSB_METRICS
+static const char* metric_names[METRIC_COUNT] = {
+    "random_edit_calls",
+    "random_edit_rejects",
+    "nbhd_calls",
+    "nbhd_kmers",
+    "nbhd_max_kmers",
+    "htable_lookups",
+    "htable_probes",
+    "htable_max_probe",
+    "htable_resizes",
+    "avl_nodes",
+    "editdist2_calls",
+    "editdist2_early_exits",
+    "assign_buckets",
+    "time_sampling_ns",
+    "time_bfs_ns",
+    "time_collision_ns",
+    "time_exact_ns",
+    "time_assign_ns",
+    "time_verify_ns",
+    "time_output_ns"
+};
+#endif
+
+long unsigned metricsNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000lu + ts.tv_nsec;
+}
+
+void metricsMax(MetricId id, long unsigned v){
+    long unsigned cur = __atomic_load_n(metrics+id, __ATOMIC_RELAXED);
+    while(cur < v && !__atomic_compare_exchange_n(metrics+id, &cur, v, 1,
+						  __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static double ratio(long unsigned a, long unsigned b){
+    return b ? (double) a / b : 0;
+}
+
+void metricsWriteJSON(FILE* fout, const char* tool, double wall_s){
+    fprintf(fout, "{\"tool\": \"%s\", \"wall_s\": %.3f", tool, wall_s);
+#ifdef LSB_METRICS
+    int i;
+    fprintf(fout, ", \"enabled\": true");
+    for(i=0; i<METRIC_COUNT; i+=1){
+	fprintf(fout, ", \"%s\": %lu", metric_names[i],
+		__atomic_load_n(metrics+i, __ATOMIC_RELAXED));
+    }
+    fprintf(fout, ", \"random_edit_reject_rate\": %.4f",
+	    ratio(metrics[METRIC_RANDOM_EDIT_REJECTS],
+		  metrics[METRIC_RANDOM_EDIT_CALLS] + metrics[METRIC_RANDOM_EDIT_REJECTS]));
+    fprintf(fout, ", \"nbhd_avg_kmers\": %.2f",
+	    ratio(metrics[METRIC_NBHD_KMERS], metrics[METRIC_NBHD_CALLS]));
+    fprintf(fout, ", \"htable_avg_probe\": %.3f",
+	    ratio(metrics[METRIC_HTABLE_PROBES], metrics[METRIC_HTABLE_LOOKUPS]));
+    fprintf(fout, ", \"editdist2_early_exit_rate\": %.4f",
+	    ratio(metrics[METRIC_EDITDIST2_EARLY_EXITS], metrics[METRIC_EDITDIST2_CALLS]));
+#else
+    fprintf(fout, ", \"enabled\": false");
+#endif
+    fprintf(fout, "}\n");
+}
+
+void metricsProgress(FILE* fout, double interval_s, size_t done, size_t total){
+    static long unsigned start = 0, last = 0;
+    if(interval_s <= 0) return;
+    long unsigned now = metricsNow();
+    if(start == 0){
+	start = last = now;
+	return;
+    }
+    if(now - last < interval_s * 1e9) return;
+    last = now;
+
+    double elapsed = (now - start) * 1e-9;
+    fprintf(fout, "{\"progress\": %.4f, \"done\": %zu, \"total\": %zu,"
+	    " \"elapsed_s\": %.1f, \"per_s\": %.1f",
+	    ratio(done, total), done, total, elapsed, done / elapsed);
+#ifdef LSB_METRICS
+    fprintf(fout, ", \"nbhd_avg_kmers\": %.2f, \"random_edit_rejects\": %lu",
+	    ratio(metrics[METRIC_NBHD_KMERS], metrics[METRIC_NBHD_CALLS]),
+	    metrics[METRIC_RANDOM_EDIT_REJECTS]);
+#endif
+    fprintf(fout, "}\n");
+    fflush(fout);
+}
@@ -0,0 +1,85 @@
+/*
+  Counters and timers for the hot paths (randomEdit, the neighborhood
+  bfs, HashTable and GroupHashTable probes, AVL nodes, editDist2) and
+  the phases of the tools. They are compiled in only with -DLSB_METRICS
+  (make METRICS=1, after a make clean), otherwise the METRIC_* macros
+  expand to nothing and cost nothing.
+
+  The counters are global and updated with relaxed atomic adds, so they
+  may be bumped from any thread. Timers are in nanoseconds of wall time,
+  summed over the threads that run the phase.
+*/
+
+#ifndef _METRICS_H
+#define _METRICS_H 1
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef enum {
+    METRIC_RANDOM_EDIT_CALLS,
+    METRIC_RANDOM_EDIT_REJECTS, //edits redrawn as their distance was not d
+    METRIC_NBHD_CALLS,
+    METRIC_NBHD_KMERS, //k-mers in the neighborhoods returned
+    METRIC_NBHD_MAX_KMERS,
+    METRIC_HTABLE_LOOKUPS, //inserts and searches (and deletes of GroupHashTable)
+    METRIC_HTABLE_PROBES, //slots (HashTable) or groups (GroupHashTable) checked
+    METRIC_HTABLE_MAX_PROBE,
+    METRIC_HTABLE_RESIZES, //including the rehashes of GroupHashTable
+    METRIC_AVL_NODES, //nodes allocated, by AVLAdd or from an AVLArena
+    METRIC_EDITDIST2_CALLS,
+    METRIC_EDITDIST2_EARLY_EXITS, //stopped at max_d
+    METRIC_ASSIGN_BUCKETS, //k-mers bucketed by assignBuckets(Batch)
+    METRIC_TIME_SAMPLING, //drawing random pairs
+    METRIC_TIME_BFS,
+    METRIC_TIME_COLLISION,
+    METRIC_TIME_EXACT, //the enumeration of the exact mode of LSB-statistics
+    METRIC_TIME_ASSIGN,
+    METRIC_TIME_VERIFY,
+    METRIC_TIME_OUTPUT,
+    METRIC_COUNT
+} MetricId;
+
+extern long unsigned metrics[METRIC_COUNT];
+
+#ifdef LSB_METRICS
+#define METRIC_ADD(id, n) __atomic_fetch_add(metrics+(id), (n), __ATOMIC_RELAXED)
+#define METRIC_INC(id) METRIC_ADD(id, 1)
+#define METRIC_MAX(id, v) metricsMax(id, v)
+//start a timer t, METRIC_ELAPSED adds the time since then to id
+#define METRIC_TIMER(t) long unsigned t = metricsNow()
+#define METRIC_ELAPSED(t, id) METRIC_ADD(id, metricsNow() - (t))
+#else
+#define METRIC_ADD(id, n) ((void) 0)
+#define METRIC_INC(id) ((void) 0)
+#define METRIC_MAX(id, v) ((void) 0)
+#define METRIC_TIMER(t) ((void) 0)
+#define METRIC_ELAPSED(t, id) ((void) 0)
+#endif
+
+/*
+  Nanoseconds of a monotonic clock.
+*/
+long unsigned metricsNow();
+
+/*
+  Raise counter id to v if it is smaller.
+*/
+void metricsMax(MetricId id, long unsigned v);
+
+/*
+  Write the counters (and averages derived from them) as one JSON object
+  to fout, with the name of the tool and the total wall time. If the
+  metrics are compiled out, only those two and "enabled": false.
+*/
+void metricsWriteJSON(FILE* fout, const char* tool, double wall_s);
+
+/*
+  Print a progress line (a JSON object) to fout if at least interval_s
+  seconds passed since the last one: done out of total units of work,
+  the rate, and some of the counters if enabled. interval_s <= 0 turns
+  the lines off.
+*/
+void metricsProgress(FILE* fout, double interval_s, size_t done, size_t total);
+
+#endif // metrics.h
@@ -0,0 +1,69 @@
+#include "simd.h"
+#include "util.h"
+#include "bucketing.h"
+#include "codec.h"
+#include <string.h>
+
+static const char* simd_names[SIMD_LEVELS] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+static SimdLevel simd_level = SIMD_SCALAR;
+
+SimdLevel simdDetect(){
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+       && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512bw")){
+	return SIMD_AVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")){
+	return SIMD_AVX2;
+    }
+    if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")){
+	return SIMD_SSE42;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel simdLevel(){
+    return simd_level;
+}
+
+SimdLevel simdSetLevel(SimdLevel level){
+    SimdLevel best = simdDetect();
+    simd_level = level > best ? best : level;
+    utilBindSimd(simd_level);
+    bucketingBindSimd(simd_level);
+    codecBindSimd(simd_level);
+    return simd_level;
+}
+
+const char* simdLevelName(SimdLevel level){
+    return level < SIMD_LEVELS ? simd_names[level] : "unknown";
+}
+
+SimdLevel simdParseLevel(const char* name){
+    int i;
+    for(i=0; i<SIMD_LEVELS; i+=1){
+	if(strcmp(name, simd_names[i]) == 0) return i;
+    }
+    return SIMD_LEVELS;
+}
+
+//bind the best level, or the one forced by LSB_SIMD, before main
+__attribute__((constructor)) static void simdInit(){
+    SimdLevel best = simdDetect(), level = best;
+    const char* env = getenv("LSB_SIMD");
+    if(env && *env){
+	level = simdParseLevel(env);
+	if(level == SIMD_LEVELS){
+	    fprintf(stderr, "LSB_SIMD: unknown level %s, using %s\n", env, simdLevelName(best));
+	    level = best;
+	}else if(level > best){
+	    fprintf(stderr, "LSB_SIMD: %s is not supported by this CPU, using %s\n",
+		    env, simdLevelName(best));
+	    level = best;
+	}
+    }
+    simdSetLevel(level);
+}
@@ -0,0 +1,60 @@
+/*
+  Runtime selection of the instruction set used by the hot kernels.
+  The makefile builds for the baseline x86-64 ISA, so the kernels that
+  profit from wider vectors or newer instructions (isInSampleD1,
+  assignBucketsBatch and the conversions of codec.h) are also compiled
+  for higher levels with target attributes. The best level supported by
+  the CPU is detected once at startup (before main) and the kernels of
+  every module are bound to it.
+
+  The environment variable LSB_SIMD=scalar|sse4.2|avx2|avx512 forces a
+  lower level, e.g. to compare the results of the levels. Every level
+  gives identical results (see bench-simd.out and bench-codec.out).
+*/
+
+#ifndef _SIMD_H
+#define _SIMD_H 1
+
+typedef enum {
+    SIMD_SCALAR, //the baseline ISA of the build
+    SIMD_SSE42, //SSE4.2 and popcnt
+    SIMD_AVX2, //AVX2, BMI2
+    SIMD_AVX512, //AVX-512 F, VL, DQ and BW
+    SIMD_LEVELS
+} SimdLevel;
+
+//the variants above the baseline exist only on x86 with GCC or clang
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#define SIMD_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,bmi2,popcnt")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512dq,avx512bw,avx2,bmi2,popcnt")))
+#endif
+
+/*
+  The best level supported by the CPU.
+*/
+SimdLevel simdDetect();
+
+/*
+  The level the kernels are bound to.
+*/
+SimdLevel simdLevel();
+
+/*
+  Bind the kernels of all modules to level, or to simdDetect() if the
+  CPU does not support it, and return the level bound.
+*/
+SimdLevel simdSetLevel(SimdLevel level);
+
+/*
+  The name of a level as accepted by LSB_SIMD and simdParseLevel.
+*/
+const char* simdLevelName(SimdLevel level);
+
+/*
+  The level named name, or SIMD_LEVELS if there is none.
+*/
+SimdLevel simdParseLevel(const char* name);
+
+#endif // simd.h
@@ -1,4 +1,5 @@
 #include "util.h"
+#include "metrics.h"
 
 void printIntArray(const int* x, const int len){
   int i;
@@ -14,8 +15,12 @@ int editDist(const kmer s1, const kmer s2, const int k, const int max_id){
 
 int editDist2(const kmer s1, const int k1, const kmer s2, const int k2, const int max_d){
     if(k1 > k2) return editDist2(s2, k2, s1, k1, max_d);
+    METRIC_INC(METRIC_EDITDIST2_CALLS);
     int diag_index = k2 - k1;
-    if(max_d >= 0 && diag_index >= max_d) return diag_index;
+    if(max_d >= 0 && diag_index >= max_d){
+	METRIC_INC(METRIC_EDITDIST2_EARLY_EXITS);
+	return diag_index;
+    }
     
     int row[k2+1];
     int i, j, diag, cur,tmp;
@@ -44,6 +49,7 @@ int editDist2(const kmer s1, const int k1, const kmer s2, const int k2, const in
 	}
 
 	if(max_d >= 0 && row[diag_index] >= max_d){
+	    if(i < k1) METRIC_INC(METRIC_EDITDIST2_EARLY_EXITS);
 	    break;
 	}
     }
@@ -89,6 +95,124 @@ int editDist3(const char* s1, const int l1, const char* s2, const int l2, const
     return row[diag_index];
 }
 
+int editDist3Banded(const char* s1, const int l1, const char* s2, const int l2, const int max_d){
+    int d = l1 > l2 ? l1 - l2 : l2 - l1;
+    if(d > max_d) return max_d + 1;
+
+    //band[t] holds the entry at (i, j=i+t-max_d)
+    int w = (max_d << 1) + 1;
+    int prev[w+1], cur[w+1];
+    int i, j, t, tmp, best, inf = max_d + 1;
+    for(t=0; t<=w; t+=1){
+	j = t - max_d;
+	prev[t] = (j >= 0 && j <= l2 && t < w) ? j : inf;
+    }
+    cur[w] = inf;
+
+    for(i=1; i<=l1; i+=1){
+	best = inf;
+	for(t=0; t<w; t+=1){
+	    j = i + t - max_d;
+	    if(j < 0 || j > l2){
+		cur[t] = inf;
+		continue;
+	    }
+	    if(j == 0){
+		cur[t] = i;
+	    }else{
+		//substitution
+		cur[t] = prev[t] + (s1[i-1] == s2[j-1] ? 0 : 1);
+		//deletion
+		tmp = prev[t+1] + 1;
+		if(tmp < cur[t]) cur[t] = tmp;
+		//insertion
+		tmp = t > 0 ? cur[t-1] + 1 : inf;
+		if(tmp < cur[t]) cur[t] = tmp;
+	    }
+	    if(cur[t] > inf) cur[t] = inf;
+	    if(cur[t] < best) best = cur[t];
+	}
+	if(best > max_d) return inf;
+	for(t=0; t<w; t+=1){
+	    prev[t] = cur[t];
+	}
+    }
+
+    return prev[l2 - l1 + max_d];
+}
+
+long unsigned editIndelMask(const kmer s1, const int k1, const kmer s2, const int k2,
+			    const int max_d, int* dist){
+    int d = k1 > k2 ? k1 - k2 : k2 - k1;
+    *dist = max_d + 1;
+    if(d > max_d || max_d > 63) return 0;
+
+    //band[t] holds the entry at (i, j=i+t-max_d) as in editDist3Banded,
+    //along with the mask of the numbers of indels of the optimal paths
+    int w = (max_d << 1) + 1;
+    int prev[w+1], cur[w+1];
+    long unsigned prev_m[w+1], cur_m[w+1];
+    int i, j, t, tmp, best, inf = max_d + 1;
+    kmer s1_copy, s2_copy;
+    for(t=0; t<=w; t+=1){
+	j = t - max_d;
+	prev[t] = (j >= 0 && j <= k2 && t < w) ? j : inf;
+	prev_m[t] = prev[t] < inf ? 1lu << j : 0;
+    }
+    cur[w] = inf;
+    cur_m[w] = 0;
+
+    for(i=1, s1_copy=s1; i<=k1; i+=1, s1_copy>>=2){
+	best = inf;
+	for(t=0; t<w; t+=1){
+	    j = i + t - max_d;
+	    if(j < 0 || j > k2){
+		cur[t] = inf;
+		cur_m[t] = 0;
+		continue;
+	    }
+	    if(j == 0){
+		cur[t] = i;
+		cur_m[t] = i < 64 ? 1lu << i : 0;
+	    }else{
+		s2_copy = s2 >> ((j-1) << 1);
+		//substitution
+		cur[t] = prev[t] + ((s1_copy & 3) == (s2_copy & 3) ? 0 : 1);
+		cur_m[t] = prev_m[t];
+		//deletion
+		tmp = prev[t+1] + 1;
+		if(tmp < cur[t]){
+		    cur[t] = tmp;
+		    cur_m[t] = 0;
+		}
+		if(tmp == cur[t]) cur_m[t] |= prev_m[t+1] << 1;
+		//insertion
+		tmp = t > 0 ? cur[t-1] + 1 : inf;
+		if(tmp < cur[t]){
+		    cur[t] = tmp;
+		    cur_m[t] = 0;
+		}
+		if(tmp == cur[t] && t > 0) cur_m[t] |= cur_m[t-1] << 1;
+	    }
+	    if(cur[t] >= inf){
+		cur[t] = inf;
+		cur_m[t] = 0;
+	    }
+	    if(cur[t] < best) best = cur[t];
+	}
+	if(best > max_d) return 0;
+	for(t=0; t<w; t+=1){
+	    prev[t] = cur[t];
+	    prev_m[t] = cur_m[t];
+	}
+    }
+
+    t = k2 - k1 + max_d;
+    if(prev[t] > max_d) return 0;
+    *dist = prev[t];
+    return prev_m[t];
+}
+
 kmer encode(const char* str, const int k){
     kmer enc = 0;
     int i, x = 0;
@@ -234,14 +358,14 @@ void* realloc_harder(void* ptr, size_t new_size){
 }
 
 kmer randomKMer(int k){
+    kmer mask = KMER_MASK(k);
     k <<= 1;
 
-    kmer mask = (1lu<<k)-1;
     int rand_digits = 10;
     int rand_max = 1<<rand_digits;
     int parts = k/rand_digits + 1;
     
-    kmer s=0lu, cur;
+    kmer s=0, cur;
     int i;
     for(i=0; i<parts; i+=1){
 	cur = rand()%rand_max;
@@ -305,7 +429,8 @@ kmer randomEdit(kmer s, int k, int d){
     
     int i, j, body;
     kmer head, tail, mask, new_body;
-    
+
+    METRIC_INC(METRIC_RANDOM_EDIT_CALLS);
     while(!done){
 	if(k > d){
 	    for(i=0; i<k; i+=1){
@@ -324,14 +449,14 @@ kmer randomEdit(kmer s, int k, int d){
 		//deletion
 		j = ops[i]<<1;
 		head = (s>>(j+2))<<j;
-		tail = ((1lu<<j)-1) & s;
+		tail = (((kmer) 1<<j)-1) & s;
 		s = head|tail;
 		//insertion
 		j = ops[i+1];
 		changed[j] = 1;
 		j <<= 1;
 		head = (s>>j)<<(j+2);
-		tail = ((1lu<<j)-1) & s;
+		tail = (((kmer) 1<<j)-1) & s;
 		new_body = (long unsigned) randBase(-1);
 		s = head | (new_body<<j) | tail;	    
 	    }
@@ -344,7 +469,7 @@ kmer randomEdit(kmer s, int k, int d){
 		changed[j] = 1;
 	    
 		j <<= 1;
-		mask = 3lu<<j;
+		mask = (kmer) 3<<j;
 		body = (s & mask)>>j;
 		new_body = (long unsigned) randBase(body);
 		s = (s & ~mask) | (new_body << j);
@@ -353,7 +478,7 @@ kmer randomEdit(kmer s, int k, int d){
 	}else{//k==d, substitute all
 	    for(i=0; i<k; i+=1){
 		j = i << 1;
-		mask = 3lu<<j;
+		mask = (kmer) 3<<j;
 		body = (s & mask)>>j;
 		new_body = (long unsigned) randBase(body);
 		s = (s & ~mask) | (new_body << j);		
@@ -361,7 +486,10 @@ kmer randomEdit(kmer s, int k, int d){
 	}
 
 	if(editDist2(s, k, t, k, -1) == d) done = 1;
-	else s = t; //restore and try again
+	else{
+	    s = t; //restore and try again
+	    METRIC_INC(METRIC_RANDOM_EDIT_REJECTS);
+	}
     }
     return s;
 }
@@ -387,7 +515,7 @@ int isSubsequence(kmer x, int b, kmer s, int k){
 
 int isSubstring(kmer x, int l, kmer s, int k){
     int i;
-    kmer mask = (1lu<<(l<<1))-1;
+    kmer mask = KMER_MASK(l);
     for(i=0; i<=k-l; i+=1){
 	if((s^x)&mask){
 	    s >>= 2;
@@ -398,8 +526,8 @@ int isSubstring(kmer x, int l, kmer s, int k){
     return 0;
 }
 
-int isInSampleD1(kmer x, int k){
-    kmer mask = 3lu;
+static int isInSampleD1Loop(kmer x, int k){
+    kmer mask = 3;
     int cur_partition = x & mask;
     int i = 1;
     int cur_symbol;
@@ -412,3 +540,41 @@ int isInSampleD1(kmer x, int k){
     }
     return (cur_partition == 0);
 }
+
+#ifdef SIMD_X86
+#if KMER_BITS == 128
+#define KMER_POPCOUNT(x) (__builtin_popcountl((long unsigned) (x))	\
+			  + __builtin_popcountl((long unsigned) ((x) >> 64)))
+#else
+#define KMER_POPCOUNT(x) __builtin_popcountl(x)
+#endif
+
+/*
+  The loop computes b_0 - b_1 - ... - b_{k-1} (mod 4), i.e., 2*b_0 minus
+  the sum of all the bases, which is the number of low bits set plus
+  twice the number of high bits set.
+*/
+SIMD_TARGET_SSE42 static int isInSampleD1Popcnt(kmer x, int k){
+    const kmer low = (kmer) -1 / 3; //01 in every base
+    x &= KMER_MASK(k);
+    int sum = KMER_POPCOUNT(x & low) + 2 * KMER_POPCOUNT(x & (low << 1));
+    return ((2 * (int) (x & 3) - sum) & 3) == 0;
+}
+#endif
+
+static SampleD1Fn is_in_sample_d1 = isInSampleD1Loop;
+
+void utilBindSimd(SimdLevel level){
+    is_in_sample_d1 = isInSampleD1Loop;
+#ifdef SIMD_X86
+    if(level >= SIMD_SSE42) is_in_sample_d1 = isInSampleD1Popcnt;
+#endif
+}
+
+int isInSampleD1(kmer x, int k){
+    return is_in_sample_d1(x, k);
+}
+
+SampleD1Fn sampleD1Kernel(){
+    return is_in_sample_d1;
+}
@@ -10,13 +10,28 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h> //for sleep
+#include "simd.h"
 
 /*
   Leran@PSU provides the centers of the partitions. 
   Following her, each k-mer is represented by a long unsigned int 
   with the encoding A-00, C-01, G-10, T-11.
-*/
+  Built with make KMER_BITS=128 (after a make clean), a k-mer is an
+  unsigned __int128 instead, so that k can be up to 64. Everything that
+  takes k-mers takes their length too, and the default 64-bit build is
+  unchanged.
+*/
+#if KMER_BITS == 128
+typedef unsigned __int128 kmer;
+#else
 typedef long unsigned kmer;
+#endif
+
+//the largest k such that a k-mer fits in a kmer
+#define KMER_MAX_K ((int) sizeof(kmer) * 4)
+
+//the 2k low bits, for 0 < k <= KMER_MAX_K
+#define KMER_MASK(k) ((kmer) -1 >> ((KMER_MAX_K - (k)) << 1))
 
 /*
   Calculate Levenshtein distance between two strings using Wagner-Fischer algorithm.
@@ -25,6 +40,23 @@ typedef long unsigned kmer;
 */
 int editDist3(const char* s1, const int l1, const char* s2, const int l2, const int max_d);
 
+/*
+  Banded version of editDist3: only cells within max_d of the diagonal
+  are computed, in O(max(l1, l2)*max_d) time. Return the Levenshtein
+  distance if it is at most max_d, otherwise max_d+1.
+*/
+int editDist3Banded(const char* s1, const int l1, const char* s2, const int l2, const int max_d);
+
+/*
+  Edit-operation composition of two x-mers. If their Levenshtein distance
+  is at most max_d (<= 63), store it in dist and return the mask whose
+  bit i is set iff some optimal alignment has exactly i indels (and
+  dist - i substitutions). Otherwise, set dist to max_d+1 and return 0.
+  One banded DP pass in O(max(k1, k2)*max_d) time.
+*/
+long unsigned editIndelMask(const kmer s1, const int k1, const kmer s2, const int k2,
+			    const int max_d, int* dist);
+
 /*
   Calculate Levenshtein distance between two x-mers using Wagner-Fischer algorithm.
   If max_d is nonnegative, the calculation may stop earlier if a diagonal entry
@@ -111,4 +143,18 @@ int isSubstring(kmer x, int l, kmer s, int k);
 */
 int isInSampleD1(kmer x, int k);
 
+/*
+  The kernel isInSampleD1 dispatches to, bound by utilBindSimd. Loops
+  over many k-mers load it once instead of going through isInSampleD1
+  for every k-mer.
+*/
+typedef int (*SampleD1Fn)(kmer x, int k);
+SampleD1Fn sampleD1Kernel();
+
+/*
+  Bind the kernels of this module (isInSampleD1) to a level of simd.h,
+  called by simdSetLevel.
+*/
+void utilBindSimd(SimdLevel level);
+
 #endif // util.h
@@ -1,7 +1,10 @@
 /*
-  Input: k r w(hole)|s(ample)
+  Input: [--threads t] [--exact] [--trials N] [--adaptive tol%] [--reuse[=m]]
+	 [--shard i/P --seed S] [--checkpoint file] [--metrics file|-]
+	 [--progress seconds] k r w(hole)|s(ample)
+     or: merge file...
 
-  For d=1, 2, ..., 6, generata N pairs of length-k sequences with 
+  For d=1, 2, ..., 6, generata N (default 100000) pairs of length-k sequences with 
   edit distance d. A pair (s, t) is said to have a collision if they
   share an r-neighbor [if option s, then the neighbor is required to
   be in the (1,1)-guaranteed sample tested by isInSampleD1()].
@@ -21,265 +24,948 @@
   iii) s differs from t by 2 indels (more than 4 mismatches, no mismatch can
   be changed to make edit=3).
 
+  In general, the pairs at each distance d are split by the minimum
+  number j of indel pairs (an insertion and a deletion) over all the
+  optimal alignments, shown as (d-2j)+j*2 in the second table.
+
+  With --adaptive tol%, the pairs at each d are drawn in batches until
+  the 95% Wilson confidence interval of every rate at d (overall and per
+  edit type) is narrower than tol percentage points, or N pairs are
+  drawn. The rates pinned at 100% or 0% then stop after a few thousand
+  pairs. The number of pairs behind each rate is in the # columns and
+  the width of its interval in the ci% columns.
+
+  With --reuse[=m], each random s is paired with m (default 1) random
+  partners at every d, so that the neighborhood of s is built once
+  instead of for every pair, up to 6m times fewer. The rates have the
+  same meaning, but the pairs sharing an s are not independent.
+
+  With --threads t > 1, each neighborhood is expanded by t threads
+  (see lib/Neighborhood.h), which pays off for large neighborhoods
+  (r >= 3).
+
+  With --exact (for k <= 12), the rates are not estimated from random
+  pairs but counted over all ordered pairs (s, t) with edit distance d,
+  for d up to 2r. No pair beyond 2r can collide, so the rows of d > 2r
+  (up to 6) show 0 collisions and - for their uncounted pairs. The
+  k-mers s are split among the t threads. Each thread needs 12.5*4^k
+  bytes of tables (200MB at k=12), the threads are capped to fit in
+  half of the physical memory.
+
+  Every pair is drawn from its own seed, derived from --seed S (default:
+  the time) and the index of the pair, so the same S gives the same
+  counts however the run is split. With --shard i/P, only the pairs
+  whose index is i mod P are drawn (the k-mers s in chunks of 256 in the
+  exact mode). With --checkpoint file, the counts and the progress (the
+  chunks done in the exact mode) are written to file every minute and
+  at the end, and a run given an existing file resumes from it.
+  "merge file..." sums the files of the shards of one run and prints
+  the tables.
+
+  --metrics file (- for stderr) writes a JSON summary of the run, with
+  the counters and phase timers of lib/metrics.h if built with
+  METRICS=1, and --progress seconds prints a JSON progress line to
+  stderr at that interval.
+
   By: Ke@PSU
   Last edited: 05/22/2022
 */
 
 #include "util.h"
 #include "AVLTree.h"
-#include "ArrayList.h"
-#include "HashTable.h"
+#include "Neighborhood.h"
+#include "KmerVec.h"
+#include "GroupHashTable.h"
+#include "metrics.h"
 #include <time.h>
 #include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
+
+#define DEFAULT_TRIALS 100000
+#define MAX_D 6
+//trials per d between two checks of the confidence intervals
+#define ADAPTIVE_BATCH 1000
+//z-score of the 95% confidence intervals
+#define WILSON_Z 1.96
+
+/*
+  The edit type of a pair at edit distance d: the minimum number j of
+  indel pairs over the optimal alignments, i.e., s differs from t by
+  d-2j substitutions and j insertions and j deletions. Return -1 if the
+  edit distance is not d. See editIndelMask in util.h.
+*/
+int getEditType(kmer s, kmer t, int k, int d){
+    int dist;
+    long unsigned mask = editIndelMask(s, k, t, k, d, &dist);
+    if(dist != d) return -1;
+    return __builtin_ctzl(mask) >> 1;
+}
 
-#define N 100000
+int hasCollision(AVLKmerNode* hs, AVLKmerNode* ht){
+    if(hs == NULL) return 0;
+    AVLKmerNode* node = AVLKmerSearch(ht, hs->key);
+    if(node)
+	return 1;
+    if(hasCollision(hs->left, ht)) return 1;
+    if(hasCollision(hs->right, ht)) return 1;
+    return 0;
+}
 
-//mask for (k-1)-mers
-#define luMSB 0x8000000000000000lu
+//same as hasCollision with the neighborhood of s in a hashtable
+static int hasCollisionTable(const GroupHashTable* hs, const AVLKmerNode* ht){
+    if(ht == NULL) return 0;
+    if(GHTableSearch(hs, ht->key)) return 1;
+    if(hasCollisionTable(hs, ht->left)) return 1;
+    return hasCollisionTable(hs, ht->right);
+}
 
-int cmpKMer(const void* a, const void* b){
-    kmer s = (kmer) a;
-    kmer t = (kmer) b;
-    if(s==t) return 0;
-    else if(s<t) return -1;
-    else return 1;
+static void tableAddTree(GroupHashTable* table, const AVLKmerNode* root){
+    if(root == NULL) return;
+    GHTableInsert(table, root->key);
+    tableAddTree(table, root->left);
+    tableAddTree(table, root->right);
 }
 
-//see beginning comment for details
-int getEditType(kmer s, kmer t, int k, int d){
-    int i, ct=0;
-    kmer mask=3lu;
-    if(d==2){
-	for(i=0; i<k; i+=1){
-	    if((s&mask) != (t&mask)){
-		ct += 1;
+//counts of pairs and collisions, indexed by d (up to max_d) and edit type
+typedef struct {
+    int max_d;
+    size_t* pairs;
+    size_t* cols;
+    double tol; //if > 0, print the width of the confidence intervals
+} Rates;
+
+static void ratesInit(Rates* rt, int max_d){
+    rt->max_d = max_d;
+    rt->tol = 0;
+    rt->pairs = calloc_harder((max_d+1) * (max_d/2+1), sizeof *rt->pairs);
+    rt->cols = calloc_harder((max_d+1) * (max_d/2+1), sizeof *rt->cols);
+}
+
+static void ratesFree(Rates* rt){
+    free(rt->pairs);
+    free(rt->cols);
+}
+
+static inline void ratesAdd(Rates* rt, int d, int edit_type, int col){
+    size_t i = d * (rt->max_d/2+1) + edit_type;
+    rt->pairs[i] += 1;
+    rt->cols[i] += col;
+}
+
+/*
+  Width of the Wilson score interval of the rate x/n, which unlike the
+  normal approximation stays meaningful at rates near 0 or 1.
+*/
+static double wilsonWidth(size_t x, size_t n){
+    if(n == 0) return 1;
+    double p = (double) x / n, z2 = WILSON_Z * WILSON_Z;
+    return 2 * WILSON_Z * sqrt(p*(1-p)/n + z2/(4.0*n*n)) / (1 + z2/n);
+}
+
+//the pairs and collisions at distance d, over all edit types
+static void ratesOfD(const Rates* rt, int d, size_t* pairs, size_t* cols){
+    int j, w = rt->max_d/2+1;
+    *pairs = *cols = 0;
+    for(j=0; j<w; j+=1){
+	*pairs += rt->pairs[d*w+j];
+	*cols += rt->cols[d*w+j];
+    }
+}
+
+//return 1 if every nonempty cell at distance d has an interval narrower than tol
+static int ratesPrecise(const Rates* rt, int d, double tol){
+    int j, w = rt->max_d/2+1;
+    size_t pairs, cols;
+    ratesOfD(rt, d, &pairs, &cols);
+    if(wilsonWidth(cols, pairs) >= tol) return 0;
+    for(j=0; j<w; j+=1){
+	if(rt->pairs[d*w+j] &&
+	   wilsonWidth(rt->cols[d*w+j], rt->pairs[d*w+j]) >= tol) return 0;
+    }
+    return 1;
+}
+
+/*
+  The exact mode counts up to d = 2r only, the rows of the first table
+  beyond it (up to MAX_D) show - pairs and no collisions.
+*/
+static void printRates(const Rates* rt){
+    int d, j, w = rt->max_d/2+1;
+    size_t pairs, cols;
+    printf("edit\t#\t#col\tcol%%%s\n", rt->tol > 0 ? "\tci%" : "");
+    for(d=1; d<=rt->max_d; d+=1){
+	ratesOfD(rt, d, &pairs, &cols);
+	printf("%d\t%zu\t%zu\t%.2f%%", d, pairs, cols, pairs ? cols*100.0/pairs : 0);
+	if(rt->tol > 0) printf("\t%.2f%%", wilsonWidth(cols, pairs)*100);
+	printf("\n");
+    }
+    for(; d<=MAX_D; d+=1) printf("%d\t-\t0\t0.00%%\n", d);
+
+    printf("\nedit\tedit_type\t#\t#col\tcol%%%s\n", rt->tol > 0 ? "\tci%" : "");
+    for(d=1; d<=rt->max_d; d+=1){
+	for(j=0; (j<<1)<=d; j+=1){
+	    if(rt->pairs[d*w+j] == 0) continue;
+	    printf("%d\t%d+%d*2\t\t%zu\t%zu\t%.2f%%",
+		   d, d-(j<<1), j, rt->pairs[d*w+j], rt->cols[d*w+j],
+		   rt->cols[d*w+j]*100.0/rt->pairs[d*w+j]);
+	    if(rt->tol > 0){
+		printf("\t%.2f%%", wilsonWidth(rt->cols[d*w+j], rt->pairs[d*w+j])*100);
 	    }
-	    mask <<= 2;
+	    printf("\n");
+	}
+    }
+}
+
+/*
+  The parameters and the progress of a run, or of its shard i of P: the
+  trials j with j % P == i. A trial is a pair at one d (its own seed is
+  derived from seed, d and j, so the counts do not depend on how the run
+  is split or resumed), a source s with --reuse, or a chunk of
+  EXACT_CHUNK k-mers s in the exact mode.
+*/
+typedef struct {
+    int k, r, check_sample, exact, reuse;
+    long unsigned seed;
+    int shard, num_shards;
+    size_t trials; //pairs per d, or k-mers in the exact mode
+    double tol;
+    //next trial of each d; with --reuse next[0] is the next source and
+    //next[d] = trials once d stops; in the exact mode next[0] = trials when done
+    size_t next[MAX_D+1];
+    char* done; //exact mode: done[c] = 1 once chunk c is counted, or NULL
+    const char* checkpoint; //file for the counts and progress, or NULL
+    time_t saved; //time of the last checkpoint
+    double progress_s; //seconds between progress lines, 0 for none
+} Run;
+
+#define CHECKPOINT_SECONDS 60
+#define CHECKPOINT_MAGIC "LSBSTAT1"
+//k-mers s per trial of the exact mode
+#define EXACT_CHUNK 256
+
+//chunks of EXACT_CHUNK k-mers in the exact mode
+static size_t exactChunks(const Run* run){
+    return (run->trials + EXACT_CHUNK - 1) / EXACT_CHUNK;
+}
+
+//sources of a run with --reuse, each gives reuse pairs at every d
+//but the last one, which gives the rest of the trials
+static size_t reuseSources(const Run* run){
+    return (run->trials + run->reuse - 1) / run->reuse;
+}
+
+//pairs at every d of source j with --reuse
+static size_t reusePartners(const Run* run, size_t j){
+    size_t rest = run->trials - j * run->reuse;
+    return rest < (size_t) run->reuse ? rest : run->reuse;
+}
+
+static int runDone(const Run* run){
+    int d;
+    if(run->exact) return run->next[0] >= run->trials;
+    if(run->reuse && run->next[0] >= reuseSources(run)) return 1;
+    for(d=1; d<=MAX_D; d+=1){
+	if(run->next[d] < run->trials) return 0;
+    }
+    return 1;
+}
+
+//seed rand() for trial j at d (d = 0 for the sources with --reuse)
+static void seedTrial(const Run* run, int d, size_t j){
+    long unsigned x = run->seed + 0x9e3779b97f4a7c15lu * (j * (MAX_D+1) + d + 1);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9lu;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eblu;
+    srand((unsigned) (x ^ (x >> 31)));
+}
+
+/*
+  Write the run and its counts to file.tmp, then rename it to file, so
+  an interrupted write leaves the previous checkpoint intact.
+*/
+static void saveRun(Run* run, const Rates* rt, const char* file){
+    char tmp[strlen(file) + 5];
+    sprintf(tmp, "%s.tmp", file);
+    FILE* fout = fopen(tmp, "w");
+    if(fout == NULL){
+	fprintf(stderr, "Cannot write checkpoint %s\n", tmp);
+	exit(1);
+    }
+    int d, j, w = rt->max_d/2+1;
+    fprintf(fout, "%s\nk %d r %d sample %d exact %d reuse %d seed %lu"
+	    " shard %d %d trials %zu tol %.17g max_d %d\nnext",
+	    CHECKPOINT_MAGIC, run->k, run->r, run->check_sample, run->exact,
+	    run->reuse, run->seed, run->shard, run->num_shards, run->trials,
+	    run->tol, rt->max_d);
+    for(d=0; d<=MAX_D; d+=1) fprintf(fout, " %zu", run->next[d]);
+    fprintf(fout, "\n");
+    if(run->exact && run->done && !runDone(run)){
+	//the chunks counted so far, those not of the shard are 0
+	size_t c, chunks = exactChunks(run);
+	fprintf(fout, "done ");
+	for(c=0; c<chunks; c+=1) putc('0' + run->done[c], fout);
+	fprintf(fout, "\n");
+    }
+    for(d=1; d<=rt->max_d; d+=1){
+	for(j=0; j<w; j+=1){
+	    if(rt->pairs[d*w+j] == 0) continue;
+	    fprintf(fout, "%d %d %zu %zu\n", d, j, rt->pairs[d*w+j], rt->cols[d*w+j]);
 	}
-	if(ct == 2) return 0;
-	else return 1;
-    }else if(d!=4){
-	return -1;
-    }
-    
-    int hasSub=0;
-    kmer new_s, tmp;
-    for(i=0; i<k; i+=1){
-	if((s&mask) != (t&mask)){
-	    ct += 1;
+    }
+    if(fclose(fout) != 0 || rename(tmp, file) != 0){
+	fprintf(stderr, "Cannot write checkpoint %s\n", file);
+	exit(1);
+    }
+    run->saved = time(NULL);
+}
+
+static void maybeSaveRun(Run* run, const Rates* rt){
+    if(run->checkpoint && time(NULL) - run->saved >= CHECKPOINT_SECONDS){
+	saveRun(run, rt, run->checkpoint);
+    }
+}
+
+//print a progress line if due, the pairs done out of those of the shard
+static void reportProgress(const Run* run, const Rates* rt){
+    if(run->progress_s <= 0) return;
+    size_t done = 0, pairs, cols, slice;
+    int d;
+    for(d=1; d<=rt->max_d; d+=1){
+	ratesOfD(rt, d, &pairs, &cols);
+	done += pairs;
+    }
+    if(run->reuse){
+	size_t sources = reuseSources(run);
+	slice = (sources - run->shard + run->num_shards - 1) / run->num_shards;
+	slice *= run->reuse;
+	if((sources - 1) % run->num_shards == (size_t) run->shard){
+	    slice -= run->reuse - reusePartners(run, sources - 1);
 	}
-	mask <<= 2;
-    }
-    if(ct == 4) return 0; //4 subs
-
-    mask=3lu;
-    //need at least 1 indel
-    //check if it's possible to do a sub at certain position i
-    //so that the resulting edit distance is 3
-    //this sub may happen between i in s and {i-1, i, i+1} in t
-    for(i=0; i<k; i+=1){
-	if(i>0){//sub with i-1 in t
-	    tmp = t & (mask>>2);
-	    if((s&mask) != tmp){
-		new_s = (s&~mask)|(tmp<<2);
-		if(editDist2(new_s, k, t, k, 4) == 3){
-		    hasSub = 1;
-		    break;
-		}
+    }else{
+	slice = (run->trials - run->shard + run->num_shards - 1) / run->num_shards;
+    }
+    metricsProgress(stderr, run->progress_s, done, slice * MAX_D);
+}
+
+/*
+  Read a file written by saveRun into run and rt (initialized here).
+  Return 0 if the file cannot be opened, exit if it is malformed.
+  run->done is allocated for an unfinished run of the exact mode.
+*/
+static int loadRun(const char* file, Run* run, Rates* rt){
+    FILE* fin = fopen(file, "r");
+    if(fin == NULL) return 0;
+    char magic[16];
+    int d, j, max_d, w;
+    size_t pairs, cols;
+    if(fscanf(fin, "%15s k %d r %d sample %d exact %d reuse %d seed %lu"
+	      " shard %d %d trials %zu tol %lf max_d %d next",
+	      magic, &run->k, &run->r, &run->check_sample, &run->exact,
+	      &run->reuse, &run->seed, &run->shard, &run->num_shards,
+	      &run->trials, &run->tol, &max_d) != 12
+       || strcmp(magic, CHECKPOINT_MAGIC) || max_d < 1 || max_d > 64
+       || run->num_shards < 1 || run->shard < 0 || run->shard >= run->num_shards){
+	fprintf(stderr, "%s is not an LSB-statistics checkpoint\n", file);
+	exit(1);
+    }
+    for(d=0; d<=MAX_D; d+=1){
+	if(fscanf(fin, "%zu", run->next+d) != 1){
+	    fprintf(stderr, "%s is truncated\n", file);
+	    exit(1);
+	}
+    }
+    run->done = NULL;
+    if(run->exact && !runDone(run)){
+	char tag[8];
+	size_t c, chunks = exactChunks(run);
+	run->done = malloc_harder(chunks);
+	if(fscanf(fin, "%7s ", tag) != 1 || strcmp(tag, "done")){
+	    fprintf(stderr, "%s is truncated\n", file);
+	    exit(1);
+	}
+	for(c=0; c<chunks; c+=1){
+	    j = getc(fin);
+	    if(j != '0' && j != '1'){
+		fprintf(stderr, "%s is truncated\n", file);
+		exit(1);
 	    }
+	    run->done[c] = j - '0';
+	}
+    }
+    ratesInit(rt, max_d);
+    rt->tol = run->tol;
+    w = max_d/2+1;
+    while(fscanf(fin, "%d %d %zu %zu", &d, &j, &pairs, &cols) == 4){
+	if(d < 1 || d > max_d || j < 0 || j >= w){
+	    fprintf(stderr, "%s has a bad cell %d %d\n", file, d, j);
+	    exit(1);
 	}
-	//sub with i in t
-	tmp = t&mask;
-	if((s&mask) != tmp){
-	    new_s = (s&~mask)|tmp;
-	    if(editDist2(new_s, k, t, k, 4) == 3){
-		hasSub = 1;
-		break;
+	rt->pairs[d*w+j] = pairs;
+	rt->cols[d*w+j] = cols;
+    }
+    fclose(fin);
+    run->checkpoint = NULL;
+    run->saved = time(NULL);
+    return 1;
+}
+
+//return 1 if a and b are shards of the same run
+static int sameRun(const Run* a, const Run* b){
+    return a->k == b->k && a->r == b->r && a->check_sample == b->check_sample
+	&& a->exact == b->exact && a->reuse == b->reuse && a->seed == b->seed
+	&& a->num_shards == b->num_shards && a->trials == b->trials
+	&& a->tol == b->tol;
+}
+
+/*
+  Estimate the rates from run->trials random pairs for each d, each
+  neighborhood is expanded by the given number of threads. If rt->tol > 0,
+  the pairs at each d are drawn in batches until the confidence intervals
+  of all the rates at d (overall and per edit type) are narrower than
+  rt->tol, with trials as the upper limit.
+*/
+static void sampleRates(Run* run, int threads, Rates* rt){
+    int k = run->k, check_sample = run->check_sample, d, edit_type, col;
+    size_t pairs, cols;
+    kmer s, t;
+    AVLKmerNode *hs, *ht;
+    NbhdWorkspace w;
+    NbhdInit(&w, k, run->r);
+    NbhdSetThreads(&w, threads);
+    AVLArena arena;
+    AVLArenaInit(&arena);
+
+    for(d=1; d<=rt->max_d; d+=1){
+	while(run->next[d] < run->trials){
+	    METRIC_TIMER(t_sample);
+	    seedTrial(run, d, run->next[d]);
+	    s = randomKMer(k);
+	    t = randomEdit(s, k, d);
+	    METRIC_ELAPSED(t_sample, METRIC_TIME_SAMPLING);
+
+	    METRIC_TIMER(t_bfs);
+	    hs = bfsNeighborsInSampleRadius(&w, &arena, s, check_sample);
+	    ht = bfsNeighborsInSampleRadius(&w, &arena, t, check_sample);
+	    METRIC_ELAPSED(t_bfs, METRIC_TIME_BFS);
+
+	    METRIC_TIMER(t_col);
+	    col = hasCollision(hs, ht);
+	    edit_type = getEditType(s, t, k, d);
+	    ratesAdd(rt, d, edit_type, col);
+	    METRIC_ELAPSED(t_col, METRIC_TIME_COLLISION);
+
+	    AVLArenaReset(&arena);
+	    run->next[d] += run->num_shards;
+	    if(rt->tol > 0){
+		ratesOfD(rt, d, &pairs, &cols);
+		if(pairs % ADAPTIVE_BATCH == 0 && ratesPrecise(rt, d, rt->tol)){
+		    run->next[d] = run->trials;
+		}
 	    }
+	    maybeSaveRun(run, rt);
+	    reportProgress(run, rt);
 	}
-	if(i<k-1){//sub with i+1 in t
-	    tmp = t & (mask<<2);
-	    if((s&mask) != tmp){
-		new_s = (s&~mask)|(tmp>>2);
-		if(editDist2(new_s, k, t, k, 4) == 3){
-		    hasSub = 1;
-		    break;
+    }
+
+    NbhdFree(&w);
+    AVLArenaFree(&arena);
+}
+
+/*
+  Same as sampleRates, but each random s is paired with run->reuse
+  partners at every d (fewer for the last s, so that there are
+  run->trials pairs per d), so the neighborhood of s is built once
+  (into a hashtable for the probes) for up to MAX_D*reuse pairs. The
+  pairs at each d are still uniform s and uniform edits of it, pairs
+  sharing an s are no longer independent. In the adaptive mode, each d
+  stops drawing partners once its intervals are narrow enough, and
+  sampling stops when all d have.
+*/
+static void sampleRatesReuse(Run* run, int threads, Rates* rt){
+    int k = run->k, check_sample = run->check_sample, d, edit_type, col;
+    size_t pairs, cols, p, partners;
+    kmer s, t;
+    AVLKmerNode *hs, *ht;
+    NbhdWorkspace w;
+    NbhdInit(&w, k, run->r);
+    NbhdSetThreads(&w, threads);
+    AVLArena arena;
+    AVLArenaInit(&arena);
+    GroupHashTable table;
+    GHTableInit(&table);
+
+    while(!runDone(run)){
+	METRIC_TIMER(t_sample);
+	seedTrial(run, 0, run->next[0]);
+	s = randomKMer(k);
+	partners = reusePartners(run, run->next[0]);
+	METRIC_ELAPSED(t_sample, METRIC_TIME_SAMPLING);
+	METRIC_TIMER(t_bfs);
+	hs = bfsNeighborsInSampleRadius(&w, &arena, s, check_sample);
+	GHTableClear(&table);
+	GHTableReserve(&table, AVLKMERSIZE(hs));
+	tableAddTree(&table, hs);
+	AVLArenaReset(&arena);
+	METRIC_ELAPSED(t_bfs, METRIC_TIME_BFS);
+
+	for(d=1; d<=rt->max_d; d+=1){
+	    for(p=0; p<partners && run->next[d]<run->trials; p+=1){
+		METRIC_TIMER(t_sample);
+		t = randomEdit(s, k, d);
+		METRIC_ELAPSED(t_sample, METRIC_TIME_SAMPLING);
+
+		METRIC_TIMER(t_bfs);
+		ht = bfsNeighborsInSampleRadius(&w, &arena, t, check_sample);
+		METRIC_ELAPSED(t_bfs, METRIC_TIME_BFS);
+
+		METRIC_TIMER(t_col);
+		col = hasCollisionTable(&table, ht);
+		edit_type = getEditType(s, t, k, d);
+		ratesAdd(rt, d, edit_type, col);
+		METRIC_ELAPSED(t_col, METRIC_TIME_COLLISION);
+
+		AVLArenaReset(&arena);
+		if(rt->tol > 0){
+		    ratesOfD(rt, d, &pairs, &cols);
+		    if(pairs % ADAPTIVE_BATCH == 0 && ratesPrecise(rt, d, rt->tol)){
+			run->next[d] = run->trials;
+		    }
 		}
 	    }
 	}
-	mask <<= 2;
+	run->next[0] += run->num_shards;
+	maybeSaveRun(run, rt);
+	reportProgress(run, rt);
     }
-    if(hasSub) return 1; //2 subs 1 indel
-    else return 2;//2 indels
+
+    NbhdFree(&w);
+    AVLArenaFree(&arena);
+    GHTableFree(&table);
 }
 
 /*
-  Do bfs for r layers from the given kmer cur, for each
-  that is isInSampleD1, add to the resulting hs
+  Exact mode: every k-mer s is the source of a bfs to depth max_d on a
+  dense table of all k-mers and (k-1)-mers, so every partner t is found
+  once, at depth ED(s, t). The k-mers within r of the centers (sample
+  k-mers within r of s) are marked by one bfs from all the centers; t
+  collides with s iff it is marked. Threads take chunks of EXACT_CHUNK
+  consecutive sources, those of the shard of the run not done yet, and
+  add the counts of each chunk to the run when it is finished, so a
+  checkpoint holds the counts of the chunks marked done.
 */
-AVLNode* bfsNeighborsInSampleRadius(kmer cur, int k, int r, int check_sample){
-    AVLNode *hs = NULL;
-    if(!check_sample || isInSampleD1(cur, k)){
-	hs = AVLAdd(hs, (void*)cur, cmpKMer);
-    }
-
-    HashTable visited;
-    HTableInit(&visited);
-    HTableInsert(&visited, cur);
-
-    ArrayList cur_layer, next_layer;
-    AListInit(&cur_layer);
-    AListInit(&next_layer);
-    AListInsert(&cur_layer, (void*)cur);
-
-    
-    size_t i, j;
-    int depth;
-    kmer t, head, body, tail, x, m;
-
-    for(depth=1; depth<=r; depth+=1){
-	for(i=0; i<cur_layer.used; i+=1){
-	    t = (kmer) cur_layer.arr[i];
-	    //(k-1)-mer, no need to ^luMSB as the head will shift MSB out
-	    if(t>=luMSB){
-		//insertion
-		for(j=0; j<k; j+=1){
-		    head = (t>>(j<<1))<<((j+1)<<1);
-		    tail = ((1lu<<(j<<1))-1) & t;
-		    for(m=0; m<4; m+=1){
-			body = m<<(j<<1);
-			x = head|body|tail;
-			//x is a k-mer
-			//add to next_layer if not visited
-			if(!HTableSearch(&visited, x)){
-			    AListInsert(&next_layer, (void*) x);
-			    HTableInsert(&visited, x);
-			    //add to hs if is in sample
-			    if(!check_sample || isInSampleD1(x, k)){
-				hs = AVLAdd(hs, (void*)x, cmpKMer);
-			    }
+//r=1 takes minutes at k=12, but r=2 is impractical beyond k=9: the time
+//grows about 6 times per k (97s at k=8), so k=12 would take days
+#define EXACT_MAX_K 12
+//bytes per k-mer and (k-1)-mer in a thread: the stamps of seen and mark,
+//depth and dels
+#define EXACT_NODE_BYTES (2 * sizeof(uint32_t) + 2)
+
+typedef struct {
+    int k, r, check_sample;
+    size_t num_kmers; //4^k
+    size_t next; //first source of the next chunk
+    size_t stride; //EXACT_CHUNK times the number of shards
+    double progress_s; //seconds between progress lines, 0 for none
+    pthread_mutex_t lock; //for next, and for run and rt once a chunk is done
+    Run* run;
+    Rates* rt;
+} ExactJob;
+
+//stamped dense set of the k-mers and (k-1)-mers
+typedef struct {
+    uint32_t* stamp;
+    uint32_t epoch;
+    size_t size;
+} DenseSet;
+
+static void denseInit(DenseSet* ds, size_t size){
+    ds->stamp = calloc_harder(size, sizeof *ds->stamp);
+    ds->epoch = 0;
+    ds->size = size;
+}
+
+static inline void denseClear(DenseSet* ds){
+    ds->epoch += 1;
+    if(ds->epoch == 0){
+	memset(ds->stamp, 0, sizeof *ds->stamp * ds->size);
+	ds->epoch = 1;
+    }
+}
+
+//the (k-1)-mers follow the 4^k k-mers
+static inline size_t denseIndex(kmer x, int k){
+    return x >= NBHD_KM1_FLAG ? (1lu << (k<<1)) + (x ^ NBHD_KM1_FLAG) : x;
+}
+
+//return 1 if x was not in the set and add it
+static inline int denseAdd(DenseSet* ds, kmer x, int k){
+    size_t i = denseIndex(x, k);
+    if(ds->stamp[i] == ds->epoch) return 0;
+    ds->stamp[i] = ds->epoch;
+    return 1;
+}
+
+static void* exactWorker(void* arg){
+    ExactJob* job = arg;
+    int k = job->k, r = job->r, max_d = job->rt->max_d, d, e;
+    SampleD1Fn in_sample = job->check_sample ? sampleD1Kernel() : NULL;
+    size_t nodes = job->num_kmers + (job->num_kmers >> 2);
+    size_t st, ed, i, j, l, num, layer[max_d+2], ix, ip;
+    kmer s, x;
+    kmer step[NBHD_STEP_MAX(k)];
+    DenseSet seen, mark;
+    denseInit(&seen, nodes);
+    denseInit(&mark, nodes);
+    //for the nodes in seen, their depth and the fewest deletions on a
+    //shortest path from s, which is the edit type of the k-mers
+    uint8_t* depth = malloc_harder(nodes);
+    uint8_t* dels = malloc_harder(nodes);
+    KmerVec found, centers, cur, next;
+    KVecInit(&found);
+    KVecInit(&centers);
+    KVecInit(&cur);
+    KVecInit(&next);
+    Rates rt; //counts of the current chunk
+    ratesInit(&rt, max_d);
+    size_t cells = (size_t) (max_d+1)*(max_d/2+1);
+
+    while(1){
+	pthread_mutex_lock(&job->lock);
+	do{
+	    st = job->next;
+	    job->next += job->stride;
+	}while(st < job->num_kmers && job->run->done[st / EXACT_CHUNK]);
+	metricsProgress(stderr, job->progress_s, st < job->num_kmers ? st : job->num_kmers,
+			job->num_kmers);
+	pthread_mutex_unlock(&job->lock);
+	if(st >= job->num_kmers) break;
+	ed = st + EXACT_CHUNK < job->num_kmers ? st + EXACT_CHUNK : job->num_kmers;
+	memset(rt.pairs, 0, sizeof *rt.pairs * cells);
+	memset(rt.cols, 0, sizeof *rt.cols * cells);
+
+	for(s=st; s<ed; s+=1){
+	    //all nodes within max_d of s by layers, found[layer[d]..layer[d+1]-1]
+	    denseClear(&seen);
+	    denseAdd(&seen, s, k);
+	    depth[s] = 0;
+	    dels[s] = 0;
+	    KVecClear(&found);
+	    KVecPush(&found, s);
+	    KVecClear(&centers);
+	    if(!in_sample || in_sample(s, k)) KVecPush(&centers, s);
+	    layer[0] = 0;
+	    layer[1] = 1;
+	    for(d=1; d<=max_d; d+=1){
+		for(i=layer[d-1]; i<layer[d]; i+=1){
+		    ip = denseIndex(found.arr[i], k);
+		    num = nbhdStep(found.arr[i], k, step);
+		    for(j=0; j<num; j+=1){
+			x = step[j];
+			ix = denseIndex(x, k);
+			e = dels[ip] + (x >= NBHD_KM1_FLAG);
+			if(!denseAdd(&seen, x, k)){
+			    if(depth[ix] == d && e < dels[ix]) dels[ix] = e;
+			    continue;
+			}
+			depth[ix] = d;
+			dels[ix] = e;
+			KVecPush(&found, x);
+			if(d <= r && x < NBHD_KM1_FLAG &&
+			   (!in_sample || in_sample(x, k))){
+			    KVecPush(&centers, x);
 			}
 		    }
 		}
+		layer[d+1] = found.used;
+	    }
+
+	    //mark the k-mers within r of a center: bfs from all centers at once
+	    denseClear(&mark);
+	    KVecClear(&cur);
+	    for(l=0; l<centers.used; l+=1){
+		denseAdd(&mark, centers.arr[l], k);
+		KVecPush(&cur, centers.arr[l]);
 	    }
-	    //k-mer
-	    else{
-		//deletion
-		for(j=0; j<k; j+=1){
-		    head = (t>>((j+1)<<1))<<(j<<1);
-		    tail = ((1lu<<(j<<1))-1) & t;
-		    x = head|tail|luMSB;
-		    //x is a (k-1)-mer
-		    //add to next_layer if not visited
-		    if(!HTableSearch(&visited, x)){
-			AListInsert(&next_layer, (void*)x);
-			HTableInsert(&visited, x);
+	    for(e=1; e<=r; e+=1){
+		KVecClear(&next);
+		for(i=0; i<cur.used; i+=1){
+		    num = nbhdStep(cur.arr[i], k, step);
+		    for(j=0; j<num; j+=1){
+			if(denseAdd(&mark, step[j], k)) KVecPush(&next, step[j]);
 		    }
-		    
 		}
-		//substitution
-		for(j=1; j<=k; j+=1){
-		    head = (t>>(j<<1))<<(j<<1);
-		    tail = ((1lu<<((j-1)<<1))-1) & t;
-		    for(m=0; m<4; m+=1){
-			body = m<<((j-1)<<1);
-			x = head|body|tail;
-			//x is a k-mer
-			//add to next_layer if not visited
-			if(!HTableSearch(&visited, x)){
-			    AListInsert(&next_layer, (void*)x);
-			    HTableInsert(&visited, x);
-                            //add to hs if is in sample
-			    if(!check_sample || isInSampleD1(x, k)){
-				hs = AVLAdd(hs, (void*)x, cmpKMer);
-			    }
-			}
-		    }
+		KVecSwap(&cur, &next);
+	    }
+
+	    for(d=1; d<=max_d; d+=1){
+		for(i=layer[d]; i<layer[d+1]; i+=1){
+		    x = found.arr[i];
+		    if(x >= NBHD_KM1_FLAG) continue;
+		    ratesAdd(&rt, d, dels[x], !denseAdd(&mark, x, k));
 		}
-	    }//end k-mer
-	}//end for each in cur_layer
+	    }
+	}
+
+	pthread_mutex_lock(&job->lock);
+	for(i=0; i<cells; i+=1){
+	    job->rt->pairs[i] += rt.pairs[i];
+	    job->rt->cols[i] += rt.cols[i];
+	}
+	job->run->done[st / EXACT_CHUNK] = 1;
+	maybeSaveRun(job->run, job->rt);
+	pthread_mutex_unlock(&job->lock);
+    }
+
+    ratesFree(&rt);
+    free(seen.stamp);
+    free(mark.stamp);
+    free(depth);
+    free(dels);
+    KVecFree(&found);
+    KVecFree(&centers);
+    KVecFree(&cur);
+    KVecFree(&next);
+    return NULL;
+}
 
-	AListClear(&cur_layer, NULL);
-	AListSwap(&cur_layer, &next_layer);
-    }//end for depth from 1 to r
+/*
+  The number of threads, at most threads, whose tables fit in half of
+  the physical memory (at least 1).
+*/
+static int exactThreads(int k, int threads){
+    size_t nodes = (1lu << (k<<1)) + (1lu << ((k-1)<<1));
+    size_t per_thread = nodes * EXACT_NODE_BYTES, fit;
+    long pages = sysconf(_SC_PHYS_PAGES), page = sysconf(_SC_PAGESIZE);
+    if(pages <= 0 || page <= 0) return threads;
+    fit = (size_t) pages * page / 2 / per_thread;
+    if(fit < 1) fit = 1;
+    if((size_t) threads <= fit) return threads;
+    fprintf(stderr, "--exact needs %zuMB per thread, using %zu threads instead of %d\n",
+	    per_thread >> 20, fit, threads);
+    return fit;
+}
 
-    HTableFree(&visited);
-    AListFree(&cur_layer, NULL);
-    AListFree(&next_layer, NULL);
+static void exactRates(Run* run, int threads, Rates* rt){
+    ExactJob job;
+    job.k = run->k;
+    job.r = run->r;
+    job.check_sample = run->check_sample;
+    job.num_kmers = run->trials;
+    job.next = (size_t) run->shard * EXACT_CHUNK;
+    job.stride = (size_t) run->num_shards * EXACT_CHUNK;
+    job.progress_s = run->progress_s;
+    job.run = run;
+    job.rt = rt;
+    if(run->done == NULL) run->done = calloc_harder(exactChunks(run), 1);
+    pthread_mutex_init(&job.lock, NULL);
 
-    return hs;    
-}//end bfsNeighborsInSampleRadius
+    threads = exactThreads(run->k, threads);
+    pthread_t tids[threads];
+    int t;
+    for(t=1; t<threads; t+=1){
+	pthread_create(tids+t, NULL, exactWorker, &job);
+    }
+    exactWorker(&job);
+    for(t=1; t<threads; t+=1){
+	pthread_join(tids[t], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+    run->next[0] = run->trials;
+}
 
-int hasCollision(AVLNode* hs, AVLNode* ht){
-    if(hs == NULL) return 0;
-    AVLNode* node = AVLSearch(ht, hs->data, cmpKMer);
-    if(node)
+/*
+  Sum the counts of the given checkpoint files, which must be shards of
+  the same run, and print them. Missing or unfinished shards are
+  reported on stderr, the counts printed are then partial.
+*/
+static int mergeRuns(int num, char* files[]){
+    if(num < 1){
+	printf("usage: LSB-statistics.out merge file...\n");
 	return 1;
-    if(hasCollision(hs->left, ht)) return 1;
-    if(hasCollision(hs->right, ht)) return 1;
+    }
+    Run first, run;
+    Rates rt, part;
+    int i, d, missing = 0;
+    size_t c;
+    if(!loadRun(files[0], &first, &rt)){
+	fprintf(stderr, "Cannot open %s\n", files[0]);
+	return 1;
+    }
+    char* seen = calloc_harder(first.num_shards, 1);
+    seen[first.shard] = 1;
+    if(!runDone(&first)) fprintf(stderr, "%s is not finished\n", files[0]);
+
+    for(i=1; i<num; i+=1){
+	if(!loadRun(files[i], &run, &part)){
+	    fprintf(stderr, "Cannot open %s\n", files[i]);
+	    return 1;
+	}
+	if(!sameRun(&first, &run) || part.max_d != rt.max_d){
+	    fprintf(stderr, "%s is not a shard of the same run as %s\n",
+		    files[i], files[0]);
+	    return 1;
+	}
+	if(seen[run.shard]){
+	    fprintf(stderr, "shard %d/%d is given twice\n", run.shard, run.num_shards);
+	    return 1;
+	}
+	seen[run.shard] = 1;
+	if(!runDone(&run)) fprintf(stderr, "%s is not finished\n", files[i]);
+	free(run.done);
+	for(c=0; c<(size_t) (rt.max_d+1)*(rt.max_d/2+1); c+=1){
+	    rt.pairs[c] += part.pairs[c];
+	    rt.cols[c] += part.cols[c];
+	}
+	ratesFree(&part);
+    }
+    for(d=0; d<first.num_shards; d+=1) missing += !seen[d];
+    if(missing) fprintf(stderr, "%d of %d shards are missing\n", missing, first.num_shards);
+
+    printRates(&rt);
+    ratesFree(&rt);
+    free(seen);
+    free(first.done);
     return 0;
 }
 
 int main(int argc, char* argv[]){
-    if(argc != 4 || (argv[3][0] != 'w' && argv[3][0] != 's')){
-	printf("usage: LSB-statistics.out n r w(hole)|s(ample)\n");
+    static struct option long_options[] = {
+	{"threads", required_argument, 0, 't'},
+	{"exact", no_argument, 0, 'x'},
+	{"trials", required_argument, 0, 'n'},
+	{"adaptive", required_argument, 0, 'a'},
+	{"reuse", optional_argument, 0, 'r'},
+	{"shard", required_argument, 0, 'p'},
+	{"seed", required_argument, 0, 'e'},
+	{"checkpoint", required_argument, 0, 'c'},
+	{"metrics", required_argument, 0, 'm'},
+	{"progress", required_argument, 0, 'g'},
+	{0, 0, 0, 0}
+    };
+    Run run;
+    memset(&run, 0, sizeof run);
+    run.num_shards = 1;
+    run.seed = time(0);
+    int threads = 1, has_seed = 0, opt;
+    const char* metrics_file = NULL;
+    long unsigned start = metricsNow();
+    long trials = DEFAULT_TRIALS;
+    while((opt = getopt_long(argc, argv, "t:xn:a:r::p:e:c:m:g:", long_options, NULL)) != -1){
+	switch(opt){
+	case 't': threads = atoi(optarg); break;
+	case 'x': run.exact = 1; break;
+	case 'n': trials = atol(optarg); break;
+	case 'a': run.tol = atof(optarg) / 100; break;
+	case 'r': run.reuse = optarg ? atoi(optarg) : 1; break;
+	case 'p':
+	    if(sscanf(optarg, "%d/%d", &run.shard, &run.num_shards) != 2) argc = 0;
+	    break;
+	case 'e': run.seed = strtoul(optarg, NULL, 10); has_seed = 1; break;
+	case 'c': run.checkpoint = optarg; break;
+	case 'm': metrics_file = optarg; break;
+	case 'g': run.progress_s = atof(optarg); break;
+	default: argc = 0;
+	}
+    }
+    if(argc > optind && strcmp(argv[optind], "merge") == 0){
+	return mergeRuns(argc - optind - 1, argv + optind + 1);
+    }
+    if(argc - optind != 3 || (argv[optind+2][0] != 'w' && argv[optind+2][0] != 's')
+       || threads < 1 || trials < 1 || run.tol < 0 || run.reuse < 0
+       || run.num_shards < 1 || run.shard < 0 || run.shard >= run.num_shards){
+	printf("usage: LSB-statistics.out [--threads t] [--exact] [--trials N]"
+	       " [--adaptive tol%%] [--reuse[=m]]\n"
+	       "\t[--shard i/P --seed S] [--checkpoint file] [--metrics file|-]"
+	       " [--progress seconds]\n\tn r w(hole)|s(ample)\n"
+	       "       LSB-statistics.out merge file...\n"
+	       "--exact (n <= %d) needs 12.5*4^n bytes per thread (200MB at n=12)\n",
+	       EXACT_MAX_K);
+	return 1;
+    }
+    if(run.num_shards > 1 && !has_seed){
+	fprintf(stderr, "--shard needs --seed so that the shards split the same run\n");
+	return 1;
+    }
+    if(run.num_shards > 1 && run.tol > 0){
+	fprintf(stderr, "--adaptive stops on the counts of the whole run,"
+		" it cannot be used with --shard\n");
 	return 1;
     }
 
-    int k = atoi(argv[1]);
-    int r = atoi(argv[2]);
-    int check_sample = (argv[3][0] == 'w' ? 0 : 1);
+    run.k = atoi(argv[optind]);
+    run.r = atoi(argv[optind+1]);
+    run.check_sample = (argv[optind+2][0] == 'w' ? 0 : 1);
+    if(run.k < 1 || run.k >= KMER_MAX_K){
+	//the top bit of a kmer tags the (k-1)-mers of the neighborhoods
+	fprintf(stderr, "n must be in [1, %d]\n", KMER_MAX_K - 1);
+	return 1;
+    }
+    Rates rt;
+    Run saved;
+    int d;
 
-    srand(time(0));
+    if(run.exact){
+	if(run.k > EXACT_MAX_K){
+	    fprintf(stderr, "the exact mode needs n <= %d\n", EXACT_MAX_K);
+	    return 1;
+	}
+	run.trials = 1lu << (run.k<<1);
+	run.tol = 0;
+	run.reuse = 0;
+    }else{
+	run.trials = trials;
+	for(d=1; d<=MAX_D; d+=1) run.next[d] = run.reuse ? 0 : run.shard;
+    }
+    run.next[0] = run.exact || run.reuse ? run.shard : 0;
 
-    int i, j, d;
-    kmer s, t;
-    int share_center[2][3] = {{0, 0, 0}, {0, 0, 0}};
-    int ct[2][3] = {{0, 0, 0}, {0, 0, 0}};
-    int edit_type;
-    int col;
-    int col_ct;
-
-    AVLNode *hs, *ht;
-
-    printf("edit\t#col\tcol%%\n");
-    for(d=1; d<7; d+=1){
-	col_ct = 0;
-	for(i=0; i<N; i+=1){
-	    s = randomKMer(k);
-	    t = randomEdit(s, k, d);
-	    
-	    
-	    hs = bfsNeighborsInSampleRadius(s, k, r, check_sample);
-	    ht = bfsNeighborsInSampleRadius(t, k, r, check_sample);
-	    
-	    col = hasCollision(hs, ht);
-	    if(col) col_ct += 1;
-		
-	    if(d==2 || d==4){
-		edit_type = getEditType(s, t, k, d);
-		ct[d/2-1][edit_type] += 1;
-		if(col){
-		    share_center[d/2-1][edit_type] += 1;
-		}
-	    }
-	    
-	    AVLFreeTree(hs, NULL);
-	    AVLFreeTree(ht, NULL);
+    if(run.checkpoint && loadRun(run.checkpoint, &saved, &rt)){
+	if(!has_seed) run.seed = saved.seed;
+	if(!sameRun(&run, &saved) || run.shard != saved.shard){
+	    fprintf(stderr, "%s is a checkpoint of another run\n", run.checkpoint);
+	    return 1;
+	}
+	memcpy(run.next, saved.next, sizeof run.next);
+	run.done = saved.done;
+    }else if(run.exact){
+	//no pair beyond 2r can collide, by the triangle inequality
+	ratesInit(&rt, 2*run.r);
+    }else{
+	ratesInit(&rt, MAX_D);
+	rt.tol = run.tol;
+    }
+    run.saved = time(NULL);
+
+    if(!runDone(&run)){
+	if(run.exact){
+	    METRIC_TIMER(t_exact);
+	    exactRates(&run, threads, &rt);
+	    METRIC_ELAPSED(t_exact, METRIC_TIME_EXACT);
+	}else if(run.reuse){
+	    sampleRatesReuse(&run, threads, &rt);
+	}else{
+	    sampleRates(&run, threads, &rt);
 	}
-	printf("%d\t%d\t%.2f%%\n", d, col_ct, col_ct*100.0/N);
     }
 
-    printf("\nedit\tedit_type\t#\t#col\tcol%%\n");
+    METRIC_TIMER(t_output);
+    if(run.checkpoint) saveRun(&run, &rt, run.checkpoint);
+    printRates(&rt);
+    fflush(stdout);
+    METRIC_ELAPSED(t_output, METRIC_TIME_OUTPUT);
+    ratesFree(&rt);
+    free(run.done);
 
-    for(i=0; i<2; i+=1){
-	d = (i<<1) + 2;
-	for(j=0; j<2+i; j+=1){
-	    printf("%d\t%d+%d*2\t\t%d\t%d\t%.2f%%\n",
-		   d, d-(j<<1), j, ct[i][j], share_center[i][j],
-		   share_center[i][j]*100.0/ct[i][j]);
+    if(metrics_file){
+	FILE* fout = strcmp(metrics_file, "-") ? fopen(metrics_file, "w") : stderr;
+	if(fout == NULL){
+	    fprintf(stderr, "Cannot write %s\n", metrics_file);
+	    return 1;
 	}
+	metricsWriteJSON(fout, "LSB-statistics", (metricsNow() - start) * 1e-9);
+	if(fout != stderr) fclose(fout);
     }
-    
     return 0;
 }
@@ -1,32 +1,38 @@
 /*
-  Input: n
+  Input: n [metrics_file|-]
 
   Assign each n-mer to a set of buckets (int labels) according to the optimal 
   (1,2)-sensitive bucketing function.
   Each n-mer is assigned to n buckets, each bucket contains |\Sigma| n-mers.
+  If metrics_file is given, a JSON summary of the time spent in each
+  phase (and the counters of lib/metrics.h if compiled in) is written
+  to it, or to stderr for -.
 
   By: Ke@PSU
   Last edited: 03/25/2023
 */
 
 #include "util.h"
+#include "bucketing.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #define ALPHABETSIZE 4
 const char alphabet[ALPHABETSIZE] = {'A', 'C', 'G', 'T'};
 
 
 static inline void addKMerToBucket(const kmer x, const size_t bucket,
-				   const int n, size_t* nmers){
+				   const int n, blabel* nmers){
     size_t i = x * n;
     while(nmers[i] > 0){ ++i; }
     nmers[i] = bucket;
 }
 
 void printKMerBuckets(FILE* fout, const int k,
-		      const size_t* kmers, const size_t num_kmers){
+		      const blabel* kmers, const size_t num_kmers){
     char buf[k+1];
     buf[k] = '\0';
     kmer i;
@@ -35,83 +41,49 @@ void printKMerBuckets(FILE* fout, const int k,
 	decode(i, k, buf);
 	fprintf(fout, "%.*s:", k, buf);
 	for(j=i*k; j<(i+1)*k; ++j){
-	    fprintf(fout, " %zu", kmers[j]);
+	    fprintf(fout, " %zu", (size_t) kmers[j]);
 	}
 	fprintf(fout, "\n");
     }
 }
 
-/*
-  Assign all the buckets for a given kmer x. Results are stored
-  in the buckets array from st_idx to st_idx+k-1.
-
-  See the manuscript for explanation of the algorithm.
-*/
-void assignBuckets(const kmer x, const int n,
-		   size_t* buckets, const size_t st_idx){
-    int i;
-    size_t num_A[n], val[n], mu[n];
-    
-    kmer mask = 3lu << ((n-1)<<1);
-    size_t p = 1lu << ((n-1)<<1); //ALPHABETSIZE^(n-1)
-    size_t cur = x & mask;
-
-    size_t sum_mu;
-    
-    num_A[0] = 0;
-    val[0] = x - cur;
-    sum_mu = mu[0] = cur ? p + (cur >> 2)*(n-1) : val[0];
-    
-    for(i=1; i<n; ++i){
-	num_A[i] = num_A[i-1] + (cur ? 0 : 1);
-	
-	mask >>= 2;
-	cur = x & mask;
-	p >>= 2;
-	
-	val[i] = val[i-1] - cur;
-	mu[i] = cur ? p + (cur >> 2) * (n-i-1) : val[i];
-	sum_mu += mu[i];
-    }
-
-    mask = 3lu << ((n-1)<<1);
-    size_t j=st_idx, tail = st_idx + n - num_A[n-1] - (cur ? 0 : 1);
-    
-    for(i=0; i<n; ++i){
-	cur = x & mask;
-	mask >>= 2;
-	p = sum_mu - mu[i] + val[i] - num_A[i]*cur + 1 + num_A[i];
-	if(cur){
-	    buckets[j] = p;
-	    ++j;
-	}else{
-	    buckets[tail] = p;
-	    ++tail;
-	}
+//the largest n whose labels fit and whose table of n labels per n-mer
+//can be addressed by a size_t
+static int maxTableN(){
+    int n = 1;
+    while(n < BUCKET_MAX_N(BUCKET_FUNC_OPT12) && ((n+1)<<1) < (int) sizeof(size_t)*8
+	  && ((size_t) 1 << ((n+1)<<1)) <= SIZE_MAX / (n+1) / sizeof(blabel)){
+	n += 1;
     }
+    return n;
 }
 
-
 int main(int argc, char* argv[]){
-    if(argc != 2){
-	printf("usage: assignBuckets.out n\n");
+    if(argc != 2 && argc != 3){
+	printf("usage: assignBuckets.out n [metrics_file|-]\n");
 	return 1;
     }
+    long unsigned start = metricsNow();
 
     int n = atoi(argv[1]);
+    if(n < 1 || n > maxTableN()){
+	fprintf(stderr, "n must be in [1, %d]\n", maxTableN());
+	return 1;
+    }
 
     //NOTE: this should be ALPHABETSIZE^{n} for ALPHABETSIZE!=4
-    size_t NUM_KMERS = 1<<(n<<1); 
+    size_t NUM_KMERS = (size_t) 1 << (n<<1);
 
     //buckets for nmer x are at nmers[x*n .. x*n+n-1]
-    size_t* nmers = calloc(NUM_KMERS * n, sizeof *nmers);
+    blabel* nmers = calloc_harder(NUM_KMERS * n, sizeof *nmers);
 
     size_t m = 1;
     kmer k, mask, s, t;
     int i;
     
+    METRIC_TIMER(t_assign);
     for(k=0; k<NUM_KMERS; ++k){
-	mask = 3lu << ((n-1)<<1);
+	mask = (kmer) 3 << ((n-1)<<1);
 	for(i=n-1; i>=0; --i){
 	    if((k & mask) == 0){
 		addKMerToBucket(k, m, n, nmers);
@@ -125,26 +97,80 @@ int main(int argc, char* argv[]){
 	}
     }
 
+    METRIC_ELAPSED(t_assign, METRIC_TIME_ASSIGN);
+
+    METRIC_TIMER(t_output);
     char filename[200];
     sprintf(filename, "buckets-%d.txt", n);
     FILE* fout = fopen(filename, "w");
 
     printKMerBuckets(fout, n, nmers, NUM_KMERS);
+    fflush(fout);
+    METRIC_ELAPSED(t_output, METRIC_TIME_OUTPUT);
 
+    METRIC_TIMER(t_verify);
     //test assignBuckets function
-    size_t individual[k];
+    blabel individual[n];
     for(k=0, m=0; k<NUM_KMERS; ++k){
 	assignBuckets(k, n, individual, 0);
 	for(i=0; i<n; ++i){
 	    if(individual[i] != nmers[m]){
 		char buf[n+1];
 		buf[n] = '\0';
-		fprintf(stderr, "Wrong buckets for nmer %.*s, should be %zu, assigned %zu\n", n, decode(k, n, buf), nmers[m], individual[i]);
+		fprintf(stderr, "Wrong buckets for nmer %.*s, should be %zu, assigned %zu\n", n, decode(k, n, buf), (size_t) nmers[m], (size_t) individual[i]);
 	    }
 	    ++ m;
 	}
     }
+
+    //test assignBucketsBatch function, one chunk of k-mers at a time
+    size_t chunk = 1024, num;
+    kmer batch[chunk];
+    blabel* batch_buckets = malloc(sizeof *batch_buckets * chunk * n);
+    for(k=0; k<NUM_KMERS; k+=num){
+	num = NUM_KMERS - k < chunk ? NUM_KMERS - k : chunk;
+	for(m=0; m<num; ++m){
+	    batch[m] = k + m;
+	}
+	assignBucketsBatch(batch, num, n, batch_buckets);
+	if(memcmp(batch_buckets, nmers + k*n, sizeof *nmers * num * n)){
+	    fprintf(stderr, "Wrong batch buckets for nmers %lu to %lu\n",
+		    (long unsigned) k, (long unsigned) (k+num-1));
+	}
+    }
+    free(batch_buckets);
+
+    //test bucketMembers function: every bucket has ALPHABETSIZE members,
+    //each of which is assigned to this bucket by assignBuckets
+    size_t NUM_BUCKETS = (NUM_KMERS >> 2) * n;
+    kmer members[ALPHABETSIZE];
+    int j;
+    for(m=1; m<=NUM_BUCKETS; ++m){
+	if(bucketMembers(m, n, members) != ALPHABETSIZE){
+	    fprintf(stderr, "Wrong number of members for bucket %zu\n", m);
+	    continue;
+	}
+	for(j=0; j<ALPHABETSIZE; ++j){
+	    assignBuckets(members[j], n, individual, 0);
+	    for(i=0; i<n && individual[i] != m; ++i);
+	    if(i == n){
+		char buf[n+1];
+		buf[n] = '\0';
+		fprintf(stderr, "Wrong members for bucket %zu, nmer %.*s is not in it\n", m, n, decode(members[j], n, buf));
+	    }
+	}
+    }
+    METRIC_ELAPSED(t_verify, METRIC_TIME_VERIFY);
     
     fclose(fout);
+    if(argc == 3){
+	FILE* fmetrics = strcmp(argv[2], "-") ? fopen(argv[2], "w") : stderr;
+	if(fmetrics == NULL){
+	    fprintf(stderr, "Cannot write %s\n", argv[2]);
+	    return 1;
+	}
+	metricsWriteJSON(fmetrics, "assignBuckets", (metricsNow() - start) * 1e-9);
+	if(fmetrics != stderr) fclose(fmetrics);
+    }
     return 0;
 }
@@ -0,0 +1,251 @@
+/*
+  Input: build n input index [mem_MB] [o(ptimal)|s(ample)]
+	 shard n input map num_shards [mem_MB] [o(ptimal)|s(ample)]
+	 lookup index sequence
+
+  build: each line of the input file is a sequence (e.g., a k-mer or a
+  read) whose id is its line number (starting from 0). Every n-mer of
+  the sequence, except those with a character other than A, C, G, T (in
+  either case), is assigned to buckets by assignBuckets (option o, the
+  default) or by assignSampleBuckets (option s) and the resulting
+  (bucket, id) postings are written to an inverted index (see
+  lib/BucketIndex.h for the file format) using about mem_MB (default
+  1024) megabytes of memory. If every line is an n-mer, the n-mers
+  themselves are also stored in the index.
+
+  shard: same as build, but the bucket labels are split into num_shards
+  ranges with about the same number of postings (counted in a first pass
+  over the input), each written as its own index map.0, map.1, ... and
+  the ranges are written to the shard map (see lib/ShardedIndex.h). The
+  n-mers are not stored. Use shardQuery.out to query all the shards.
+
+  lookup: for each bucket of each n-mer of the given sequence, print the
+  bucket label followed by the ids in that bucket (and their n-mers
+  if they are stored).
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "codec.h"
+#include "BucketIndex.h"
+#include "ShardedIndex.h"
+#include <string.h>
+
+static int build(int n, const char* input, const char* path, size_t mem_MB,
+		 int func){
+    FILE* fin = fopen(input, "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", input);
+	return 1;
+    }
+
+    BIndexBuilder b;
+    BIndexBuilderInit(&b, path, n, func, maxBucketLabel(func, n), mem_MB << 20);
+
+    char* line = NULL;
+    size_t line_size = 0, id, i, st, ed, xs_size = 0;
+    ssize_t len;
+    size_t buckets[n];
+    kmer* xs = NULL;
+    int j, num, all_nmers = 1;
+
+    for(id=0; (len = getline(&line, &line_size, fin)) > 0; id+=1){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	if(len != n) all_nmers = 0;
+	if(len < n) continue;
+	if(xs_size < (size_t) len){
+	    xs_size = len;
+	    xs = realloc_harder(xs, sizeof *xs * xs_size);
+	}
+
+	for(st=0; st+n<=(size_t) len; st=ed+1){
+	    ed = st + encodeKMers(line+st, len-st, n, xs+st);
+	    for(i=st; i+n<=ed; i+=1){
+		num = assignBucketsWith64(func, xs[i], n, buckets, 0);
+		for(j=0; j<num; j+=1){
+		    BIndexBuilderAdd(&b, buckets[j], id);
+		}
+	    }
+	}
+	if(all_nmers) BIndexBuilderAddKMer(&b, encode(line, n));
+    }
+    if(!all_nmers && b.kmers){
+	fclose(b.kmers);
+	b.kmers = NULL;
+	b.hdr.num_kmers = 0;
+    }
+
+    BIndexBuilderFinish(&b);
+    free(line);
+    free(xs);
+    fclose(fin);
+
+    BucketIndex idx;
+    BIndexOpen(&idx, path);
+    printf("%zu sequences, %lu postings in %lu buckets, %lu bytes\n",
+	   id, idx.hdr->num_postings, idx.hdr->num_labels, idx.hdr->file_size);
+    BIndexClose(&idx);
+    return 0;
+}
+
+/*
+  One pass over the input: if builders is NULL, count the postings of
+  each label bin in hist, otherwise add them to the builder of their
+  shard. Return the number of sequences.
+*/
+static size_t shardPass(FILE* fin, int n, int func, size_t* hist, int shift,
+			const ShardMap* m, BIndexBuilder* builders){
+    char* line = NULL;
+    size_t line_size = 0, id, i, st, ed, xs_size = 0;
+    ssize_t len;
+    size_t buckets[n];
+    kmer* xs = NULL;
+    int j, num;
+
+    rewind(fin);
+    for(id=0; (len = getline(&line, &line_size, fin)) > 0; id+=1){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	if(len < n) continue;
+	if(xs_size < (size_t) len){
+	    xs_size = len;
+	    xs = realloc_harder(xs, sizeof *xs * xs_size);
+	}
+
+	for(st=0; st+n<=(size_t) len; st=ed+1){
+	    ed = st + encodeKMers(line+st, len-st, n, xs+st);
+	    for(i=st; i+n<=ed; i+=1){
+		num = assignBucketsWith64(func, xs[i], n, buckets, 0);
+		for(j=0; j<num; j+=1){
+		    if(builders == NULL){
+			hist[buckets[j] >> shift] += 1;
+		    }else{
+			BIndexBuilderAdd(builders + ShardMapFind(m, buckets[j]),
+					 buckets[j], id);
+		    }
+		}
+	    }
+	}
+    }
+    free(line);
+    free(xs);
+    return id;
+}
+
+static int shard(int n, const char* input, const char* path, int num_shards,
+		 size_t mem_MB, int func){
+    FILE* fin = fopen(input, "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", input);
+	return 1;
+    }
+    if(num_shards <= 0){
+	fprintf(stderr, "the number of shards must be positive\n");
+	return 1;
+    }
+
+    size_t max_label = maxBucketLabel(func, n);
+    int shift = shardHistShift(max_label);
+    size_t* hist = calloc_harder((max_label >> shift) + 1, sizeof *hist);
+    shardPass(fin, n, func, hist, shift, NULL, NULL);
+
+    ShardMap m;
+    ShardMapBalance(&m, path, n, func, max_label, hist, shift, num_shards);
+    free(hist);
+
+    BIndexBuilder* builders = malloc_harder(sizeof *builders * num_shards);
+    char* shard_path;
+    int i;
+    for(i=0; i<num_shards; i+=1){
+	shard_path = ShardMapPath(&m, i);
+	BIndexBuilderInit(builders+i, shard_path, n, func,
+			  ShardMapLast(&m, i), (mem_MB << 20) / num_shards);
+	free(shard_path);
+    }
+    size_t num_seqs = shardPass(fin, n, func, NULL, shift, &m, builders);
+    fclose(fin);
+    for(i=0; i<num_shards; i+=1){
+	BIndexBuilderFinish(builders+i);
+    }
+    free(builders);
+    ShardMapWrite(&m, path);
+
+    printf("%zu sequences\n", num_seqs);
+    BucketIndex idx;
+    for(i=0; i<num_shards; i+=1){
+	shard_path = ShardMapPath(&m, i);
+	BIndexOpen(&idx, shard_path);
+	printf("shard %d: labels [%zu, %zu], %lu postings in %lu buckets, %lu bytes\n",
+	       i, m.bounds[i], ShardMapLast(&m, i), idx.hdr->num_postings,
+	       idx.hdr->num_labels, idx.hdr->file_size);
+	BIndexClose(&idx);
+	free(shard_path);
+    }
+    ShardMapFree(&m);
+    return 0;
+}
+
+static int lookup(const char* path, const char* seq){
+    BucketIndex idx;
+    BIndexOpen(&idx, path);
+
+    int n = idx.hdr->n;
+    int len = strlen(seq);
+    size_t buckets[n];
+    size_t *ids = NULL, ids_size = 0, num, i;
+    char buf[n+1];
+    buf[n] = '\0';
+    int j, st, num_buckets;
+
+    for(st=0; st+n<=len; st+=1){
+	num_buckets = assignBucketsWith64(idx.hdr->func, encode(seq+st, n), n,
+					buckets, 0);
+	for(j=0; j<num_buckets; j+=1){
+	    num = BIndexLookup(&idx, buckets[j], &ids, &ids_size);
+	    printf("%zu:", buckets[j]);
+	    for(i=0; i<num; i+=1){
+		if(idx.hdr->num_kmers){
+		    printf(" %zu(%s)", ids[i], decode(idx.kmers[ids[i]], n, buf));
+		}else{
+		    printf(" %zu", ids[i]);
+		}
+	    }
+	    printf("\n");
+	}
+    }
+
+    free(ids);
+    BIndexClose(&idx);
+    return 0;
+}
+
+//the labels of the n-mers fit for n up to BUCKET_MAX_N(func), see bucketing.h
+static int checkN(const int n, const int func){
+    if(n >= 1 && n <= BUCKET_MAX_N(func)) return 1;
+    fprintf(stderr, "n must be in [1, %d] for the bucketing function %c\n",
+	    BUCKET_MAX_N(func), func == BUCKET_FUNC_SAMPLE ? 's' : 'o');
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    int n, func;
+    if(argc >= 5 && argc <= 7 && strcmp(argv[1], "build") == 0){
+	n = atoi(argv[2]);
+	func = argc == 7 && argv[6][0] == 's' ? BUCKET_FUNC_SAMPLE : BUCKET_FUNC_OPT12;
+	if(!checkN(n, func)) return 1;
+	return build(n, argv[3], argv[4], argc >= 6 ? atol(argv[5]) : 1024, func);
+    }
+    if(argc >= 6 && argc <= 8 && strcmp(argv[1], "shard") == 0){
+	n = atoi(argv[2]);
+	func = argc == 8 && argv[7][0] == 's' ? BUCKET_FUNC_SAMPLE : BUCKET_FUNC_OPT12;
+	if(!checkN(n, func)) return 1;
+	return shard(n, argv[3], argv[4], atoi(argv[5]),
+		     argc >= 7 ? atol(argv[6]) : 1024, func);
+    }
+    if(argc == 4 && strcmp(argv[1], "lookup") == 0){
+	return lookup(argv[2], argv[3]);
+    }
+    printf("usage: bucketIndex.out build n input index [mem_MB] [o(ptimal)|s(ample)]\n"
+	   "       bucketIndex.out shard n input map num_shards [mem_MB] [o(ptimal)|s(ample)]\n"
+	   "       bucketIndex.out lookup index sequence\n");
+    return 1;
+}
@@ -0,0 +1,217 @@
+/*
+  Input: create dir n [o(ptimal)|s(ample)]
+	 add dir input [first_id]
+	 delete dir input
+	 lookup dir sequence
+	 compact dir
+	 info dir
+
+  Maintain an incrementally updated bucket index in directory dir (see
+  lib/BucketLSM.h).
+
+  create: start an empty index of n-mers bucketed by assignBuckets (option
+  o, the default) or by assignSampleBuckets (option s).
+
+  add: each line of the input file is either a sequence or an id followed
+  by a space and a sequence; a line without an id gets first_id (default
+  0) plus its line number. The (bucket, id) postings of every n-mer of the
+  sequences (except those with a character other than A, C, G, T, in
+  either case) are added to the index as one update.
+
+  delete: the input file has one id per line, all their postings are
+  removed as one update.
+
+  lookup: for each bucket of each n-mer of the given sequence, print the
+  bucket label followed by the live ids in that bucket.
+
+  compact: merge all the updates into one segment.
+
+  info: print the segments and the tombstones of the index.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "codec.h"
+#include "BucketLSM.h"
+#include <string.h>
+#include <ctype.h>
+
+static int add(const char* dir, const char* input, size_t first_id){
+    FILE* fin = fopen(input, "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", input);
+	return 1;
+    }
+
+    BucketLSM lsm;
+    LSMOpen(&lsm, dir, 0, 0, 1);
+    int n = lsm.n;
+    Posting* postings = NULL;
+    size_t postings_size = 0, num_postings = 0, line_no, id, i;
+    size_t st, ed, xs_size = 0;
+    size_t buckets[n];
+    kmer* xs = NULL;
+    char* line = NULL;
+    char* seq;
+    size_t line_size = 0;
+    ssize_t len;
+    int j, num;
+
+    for(line_no=0; (len = getline(&line, &line_size, fin)) > 0; line_no+=1){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	line[len] = '\0';
+	id = first_id + line_no;
+	seq = line;
+	if(isdigit(line[0])){
+	    id = strtoul(line, &seq, 10);
+	    while(*seq == ' ' || *seq == '\t') seq += 1;
+	    len -= seq - line;
+	}
+	if(len < n) continue;
+	if(xs_size < (size_t) len){
+	    xs_size = len;
+	    xs = realloc_harder(xs, sizeof *xs * xs_size);
+	}
+
+	for(st=0; st+n<=(size_t) len; st=ed+1){
+	    ed = st + encodeKMers(seq+st, len-st, n, xs+st);
+	    for(i=st; i+n<=ed; i+=1){
+		num = assignBucketsWith64(lsm.func, xs[i], n, buckets, 0);
+		if(num_postings + num > postings_size){
+		    postings_size = postings_size ? postings_size << 1 : 1024;
+		    postings = realloc_harder(postings, sizeof *postings * postings_size);
+		}
+		for(j=0; j<num; j+=1){
+		    postings[num_postings].label = buckets[j];
+		    postings[num_postings].id = id;
+		    num_postings += 1;
+		}
+	    }
+	}
+    }
+
+    LSMAdd(&lsm, postings, num_postings);
+    printf("%zu sequences, %zu postings added\n", line_no, num_postings);
+    LSMClose(&lsm);
+    free(postings);
+    free(xs);
+    free(line);
+    fclose(fin);
+    return 0;
+}
+
+static int delete(const char* dir, const char* input){
+    FILE* fin = fopen(input, "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", input);
+	return 1;
+    }
+
+    size_t* ids = NULL;
+    size_t ids_size = 0, num = 0, id;
+    while(fscanf(fin, "%zu", &id) == 1){
+	if(num == ids_size){
+	    ids_size = ids_size ? ids_size << 1 : 1024;
+	    ids = realloc_harder(ids, sizeof *ids * ids_size);
+	}
+	ids[num++] = id;
+    }
+    fclose(fin);
+
+    BucketLSM lsm;
+    LSMOpen(&lsm, dir, 0, 0, 0);
+    LSMDelete(&lsm, ids, num);
+    printf("%zu ids deleted\n", num);
+    LSMClose(&lsm);
+    free(ids);
+    return 0;
+}
+
+static int lookup(const char* dir, const char* seq){
+    BucketLSM lsm;
+    LSMOpen(&lsm, dir, 0, 0, 0);
+
+    int n = lsm.n;
+    int len = strlen(seq);
+    size_t buckets[n];
+    size_t *ids = NULL, ids_size = 0, num, i;
+    int j, st, num_buckets;
+
+    for(st=0; st+n<=len; st+=1){
+	num_buckets = assignBucketsWith64(lsm.func, encode(seq+st, n), n,
+					buckets, 0);
+	for(j=0; j<num_buckets; j+=1){
+	    num = LSMLookup(&lsm, buckets[j], &ids, &ids_size);
+	    printf("%zu:", buckets[j]);
+	    for(i=0; i<num; i+=1){
+		printf(" %zu", ids[i]);
+	    }
+	    printf("\n");
+	}
+    }
+
+    free(ids);
+    LSMClose(&lsm);
+    return 0;
+}
+
+static int info(const char* dir){
+    BucketLSM lsm;
+    LSMOpen(&lsm, dir, 0, 0, 0);
+    printf("n=%d func=%s\n", lsm.n,
+	   lsm.func == BUCKET_FUNC_SAMPLE ? "sample" : "optimal");
+    size_t i;
+    for(i=0; i<lsm.num_segs; i+=1){
+	printf("segment seq=%zu file=%zu postings=%zu labels=%lu bytes=%lu\n",
+	       lsm.segs[i].seq, lsm.segs[i].file_no, lsm.segs[i].num_postings,
+	       lsm.segs[i].idx.hdr->num_labels, lsm.segs[i].idx.hdr->file_size);
+    }
+    for(i=0; i<lsm.num_dels; i+=1){
+	printf("tombstones seq=%zu file=%zu ids=%zu\n",
+	       lsm.dels[i].seq, lsm.dels[i].file_no, lsm.dels[i].num);
+    }
+    LSMClose(&lsm);
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    if((argc == 4 || argc == 5) && strcmp(argv[1], "create") == 0){
+	BucketLSM lsm;
+	int n = atoi(argv[3]);
+	int func = argc == 5 && argv[4][0] == 's' ? BUCKET_FUNC_SAMPLE : BUCKET_FUNC_OPT12;
+	if(n < 1 || n > BUCKET_MAX_N(func)){
+	    fprintf(stderr, "n must be in [1, %d] for the bucketing function %c\n",
+		    BUCKET_MAX_N(func), func == BUCKET_FUNC_SAMPLE ? 's' : 'o');
+	    return 1;
+	}
+	LSMOpen(&lsm, argv[2], n, func, 0);
+	LSMClose(&lsm);
+	return 0;
+    }
+    if((argc == 4 || argc == 5) && strcmp(argv[1], "add") == 0){
+	return add(argv[2], argv[3], argc == 5 ? strtoul(argv[4], NULL, 10) : 0);
+    }
+    if(argc == 4 && strcmp(argv[1], "delete") == 0){
+	return delete(argv[2], argv[3]);
+    }
+    if(argc == 4 && strcmp(argv[1], "lookup") == 0){
+	return lookup(argv[2], argv[3]);
+    }
+    if(argc == 3 && strcmp(argv[1], "compact") == 0){
+	BucketLSM lsm;
+	LSMOpen(&lsm, argv[2], 0, 0, 0);
+	LSMCompact(&lsm);
+	LSMClose(&lsm);
+	return 0;
+    }
+    if(argc == 3 && strcmp(argv[1], "info") == 0){
+	return info(argv[2]);
+    }
+    printf("usage: bucketLSM.out create dir n [o(ptimal)|s(ample)]\n"
+	   "       bucketLSM.out add dir input [first_id]\n"
+	   "       bucketLSM.out delete dir input\n"
+	   "       bucketLSM.out lookup dir sequence\n"
+	   "       bucketLSM.out compact dir\n"
+	   "       bucketLSM.out info dir\n");
+    return 1;
+}
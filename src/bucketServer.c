@@ -0,0 +1,58 @@
+/*
+  Input: [-s socket] [-t threads] [-b batch_size] [-e max_d] index
+
+  Memory-map an index built by bucketIndex.out and answer queries until
+  the end of standard input, or, with -s, on a Unix domain socket at the
+  given path (one stream per connection). See lib/BucketServer.h for
+  the request and response format. Requests are processed in batches
+  of up to batch_size (default 256) lines by the given number of worker
+  threads (default: number of cores). With -e, the ids are verified to be
+  within edit distance max_d of the query n-mer (only for indexes that
+  store their n-mers).
+
+  The statistics, including the percentiles of the batch latencies, are
+  written to standard error at the end of each stream.
+*/
+
+#include "util.h"
+#include "BucketIndex.h"
+#include "BucketServer.h"
+#include <signal.h>
+
+int main(int argc, char* argv[]){
+    const char* socket_path = NULL;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN), max_d = -1, opt;
+    size_t batch_size = 256;
+    while((opt = getopt(argc, argv, "s:t:b:e:")) != -1){
+	switch(opt){
+	case 's': socket_path = optarg; break;
+	case 't': threads = atoi(optarg); break;
+	case 'b': batch_size = atol(optarg); break;
+	case 'e': max_d = atoi(optarg); break;
+	default: argc = 0;
+	}
+    }
+    if(argc - optind != 1){
+	printf("usage: bucketServer.out [-s socket] [-t threads] "
+	       "[-b batch_size] [-e max_d] index\n");
+	return 1;
+    }
+
+    BucketIndex idx;
+    BIndexOpen(&idx, argv[optind]);
+    BucketServer server;
+    BServerInit(&server, &idx, threads, batch_size, max_d);
+
+    int ret = 0;
+    if(socket_path){
+	signal(SIGPIPE, SIG_IGN);
+	ret = BServerListen(&server, socket_path);
+    }else{
+	BServerServe(&server, 0, 1);
+	BServerPrintStats(&server, stderr);
+    }
+
+    BServerFree(&server);
+    BIndexClose(&idx);
+    return ret;
+}
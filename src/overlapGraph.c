@@ -0,0 +1,466 @@
+/*
+  Input: [options] n o(ptimal)|s(ample) reads
+  Options: -l min_overlap (default 2n)
+	   -e max_d, maximum edit distance of an overlap (default 2)
+	   -w window, only bucket the n-mers of a read starting at most
+	      window bases before the last overlap start (default: all)
+	   -m max_bucket, skip buckets with more n-mers (default 1000)
+	   -p number of label partitions processed one at a time (default 1)
+	   -t number of threads (default: number of cores)
+
+  Build an overlap graph of the reads (one per line, or FASTA).
+  A suffix of read a overlaps a prefix of read b if the first n-mer of b
+  shares a bucket with an n-mer of a starting at position p (with
+  p <= |a| - min_overlap, and p >= |a| - min_overlap - window if a window
+  is given), and the edit distance between the last |a|-p bases of a and
+  a prefix of b of about the same length (computed with editDist3Banded)
+  is at most max_d. The buckets come from the optimal (1,2)-sensitive
+  function (option o) or the (1,3)-sensitive function labeled by the
+  (1,1)-guaranteed sample (option s).
+
+  The bucket labels are split into ranges that are processed one after
+  the other so that only the n-mers of one range are kept in memory;
+  within a range the buckets are split among the threads.
+
+  For each pair of reads, the best overlap is written to standard output
+  as a GFA link line:
+  L  name_a  +  name_b  +  <overlap>M  NM:i:<edit distance>
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "codec.h"
+#include "RadixSort.h"
+#include <string.h>
+#include <pthread.h>
+
+//position and prefix/suffix flag packed in the id of a posting
+#define POS_BITS 23
+#define MAX_READ_LEN ((1lu<<POS_BITS)-1)
+
+typedef struct {
+    size_t num;
+    char* seqs; //all reads concatenated
+    size_t* offs; //read i is seqs[offs[i] .. offs[i+1])
+    char** names;
+} ReadSet;
+
+typedef struct {
+    size_t a, b;
+    int overlap; //length on read a
+    int dist;
+} Edge;
+
+typedef struct {
+    //shared parameters
+    const ReadSet* reads;
+    int n, func, min_overlap, window, max_d, max_bucket;
+    size_t label_st, label_ed; //current partition [label_st, label_ed]
+    Posting* postings; //of the partition, sorted
+    size_t num_postings;
+    //this thread's range of reads or postings
+    size_t st, ed;
+    //output
+    Posting* out;
+    size_t out_size, out_used;
+    Edge* edges;
+    size_t edges_size, edges_used;
+    //scratch: the n-mers of the window of a read
+    kmer* kmers;
+    size_t kmers_size;
+    //scratch: the sorted labels of the postings of a bucket, n each
+    size_t* labels;
+    size_t labels_size;
+} OverlapWork;
+
+static void readReads(const char* filename, ReadSet* reads){
+    FILE* fin = fopen(filename, "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", filename);
+	exit(1);
+    }
+    size_t seqs_size = 1<<20, seqs_used = 0, size = 1024, num = 0;
+    char* seqs = malloc_harder(seqs_size);
+    size_t* offs = malloc_harder(sizeof *offs * (size+1));
+    char** names = malloc_harder(sizeof *names * size);
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int fasta = 0;
+    char name[32];
+
+    offs[0] = 0;
+    while((len = getline(&line, &line_size, fin)) > 0){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	line[len] = '\0';
+	if(len == 0) continue;
+	if(line[0] == '>' || !fasta){
+	    //start a new read
+	    if(num == size){
+		size <<= 1;
+		offs = realloc_harder(offs, sizeof *offs * (size+1));
+		names = realloc_harder(names, sizeof *names * size);
+	    }
+	    sprintf(name, "%zu", num);
+	    if(line[0] == '>'){
+		//the first word of the header, or the index for a bare >
+		fasta = 1;
+		char* word = strtok(line+1, " \t");
+		names[num] = strdup(word ? word : name);
+		offs[++num] = seqs_used;
+		continue;
+	    }
+	    names[num] = strdup(name);
+	    offs[++num] = seqs_used;
+	}
+	while(seqs_used + len > seqs_size){
+	    seqs_size <<= 1;
+	    seqs = realloc_harder(seqs, seqs_size);
+	}
+	memcpy(seqs + seqs_used, line, len);
+	seqs_used += len;
+	offs[num] = seqs_used;
+    }
+    free(line);
+    fclose(fin);
+
+    reads->num = num;
+    reads->seqs = seqs;
+    reads->offs = offs;
+    reads->names = names;
+}
+
+static inline void pushPosting(OverlapWork* w, size_t label, size_t id){
+    if(w->out_used == w->out_size){
+	w->out_size = w->out_size ? w->out_size << 1 : 1024;
+	w->out = realloc_harder(w->out, sizeof *w->out * w->out_size);
+    }
+    w->out[w->out_used].label = label;
+    w->out[w->out_used].id = id;
+    w->out_used += 1;
+}
+
+//postings of the n-mers of reads [st, ed) with labels in the partition,
+//the id is (read << (POS_BITS+1)) | (pos << 1) | is_prefix;
+//the n-mers with a non-base (see codec.h) are skipped
+static void* bucketWorker(void* arg){
+    OverlapWork* w = arg;
+    const ReadSet* reads = w->reads;
+    int n = w->n, num, j;
+    size_t buckets[n];
+    size_t r, len, pos, last, first, st, ed;
+    const char* seq;
+    kmer x;
+    w->out_used = 0;
+    for(r=w->st; r<w->ed; r+=1){
+	seq = reads->seqs + reads->offs[r];
+	len = reads->offs[r+1] - reads->offs[r];
+	if(len < w->min_overlap || len > MAX_READ_LEN) continue;
+	//the first n-mer, on the prefix side
+	if(encodeKMers(seq, n, n, &x) == (size_t) n){
+	    num = assignBucketsWith64(w->func, x, n, buckets, 0);
+	    for(j=0; j<num; j+=1){
+		if(buckets[j] >= w->label_st && buckets[j] <= w->label_ed){
+		    pushPosting(w, buckets[j], (r << (POS_BITS+1)) | 1);
+		}
+	    }
+	}
+	//n-mers where an overlap may start, on the suffix side
+	last = len - w->min_overlap;
+	first = w->window >= 0 && last > w->window ? last - w->window : 0;
+	if(w->kmers_size < last - first + 1){
+	    w->kmers_size = last - first + 1;
+	    w->kmers = realloc_harder(w->kmers, sizeof *w->kmers * w->kmers_size);
+	}
+	for(st=first; st<=last; st=ed+1){
+	    ed = st + encodeKMers(seq+st, last+n-st, n, w->kmers + (st-first));
+	    for(pos=st; pos+n<=ed; pos+=1){
+		num = assignBucketsWith64(w->func, w->kmers[pos-first], n, buckets, 0);
+		for(j=0; j<num; j+=1){
+		    if(buckets[j] >= w->label_st && buckets[j] <= w->label_ed){
+			pushPosting(w, buckets[j], (r << (POS_BITS+1)) | (pos << 1));
+		    }
+		}
+	    }
+	}
+    }
+    return NULL;
+}
+
+//verify that the suffix of a starting at pos overlaps a prefix of b,
+//trying prefixes of b within max_d of the suffix length
+static int verifyOverlap(const OverlapWork* w, size_t a, size_t b,
+			 size_t pos, Edge* e){
+    const ReadSet* reads = w->reads;
+    const char* sa = reads->seqs + reads->offs[a] + pos;
+    const char* sb = reads->seqs + reads->offs[b];
+    int la = reads->offs[a+1] - reads->offs[a] - pos;
+    int lb = reads->offs[b+1] - reads->offs[b];
+    int l, d, best = w->max_d + 1;
+    for(l=la-w->max_d; l<=la+w->max_d; l+=1){
+	if(l < 1 || l > lb) continue;
+	d = editDist3Banded(sa, la, sb, l, w->max_d);
+	if(d < best) best = d;
+    }
+    if(best > w->max_d) return 0;
+    e->a = a;
+    e->b = b;
+    e->overlap = la;
+    e->dist = best;
+    return 1;
+}
+
+//the number of postings of the partition with the given label
+static size_t bucketSize(const OverlapWork* w, const size_t label){
+    const Posting* p = w->postings;
+    size_t lo = 0, hi = w->num_postings, mid, st;
+    while(lo < hi){
+	mid = (lo + hi) >> 1;
+	if(p[mid].label < label) lo = mid + 1;
+	else hi = mid;
+    }
+    st = lo;
+    hi = w->num_postings;
+    while(lo < hi){
+	mid = (lo + hi) >> 1;
+	if(p[mid].label <= label) lo = mid + 1;
+	else hi = mid;
+    }
+    return lo - st;
+}
+
+//the sorted labels of the n-mer of the posting id whose buckets are
+//joined (in the partition, with at most max_bucket n-mers) in
+//labels[0..n), padded by -1
+static void postingLabels(const OverlapWork* w, const size_t id, size_t* labels){
+    const ReadSet* reads = w->reads;
+    size_t r = id >> (POS_BITS+1), pos = id & 1 ? 0 : (id >> 1) & MAX_READ_LEN, cur;
+    int n = w->n, num, i, j;
+    kmer x;
+    encodeKMers(reads->seqs + reads->offs[r] + pos, n, n, &x);
+    num = assignBucketsWith64(w->func, x, n, labels, 0);
+    for(i=0, j=0; i<num; i+=1){
+	if(labels[i] < w->label_st || labels[i] > w->label_ed
+	   || bucketSize(w, labels[i]) > w->max_bucket) continue;
+	labels[j++] = labels[i];
+    }
+    num = j;
+    for(i=1; i<num; i+=1){
+	cur = labels[i];
+	for(j=i; j>0 && labels[j-1] > cur; j-=1) labels[j] = labels[j-1];
+	labels[j] = cur;
+    }
+    for(; num<n; num+=1) labels[num] = (size_t) -1;
+}
+
+//the smallest label shared by the sorted label lists la and lb
+static inline size_t minSharedLabel(const size_t* la, const size_t* lb,
+				    const int n){
+    int i=0, j=0;
+    while(i<n && j<n){
+	if(la[i] == lb[j]) return la[i];
+	else if(la[i] < lb[j]) i += 1;
+	else j += 1;
+    }
+    return (size_t) -1;
+}
+
+//a pair of n-mers sharing several buckets is verified only in the
+//bucket of the smallest label they share among those joined in this
+//partition; the edges found again in another partition are removed
+//with the other duplicates at the end
+static void* joinWorker(void* arg){
+    OverlapWork* w = arg;
+    const Posting* p = w->postings;
+    int n = w->n;
+    size_t st, ed, i, j, a, b, pos;
+    Edge e;
+    w->edges_used = 0;
+    for(st=w->st; st<w->ed; st=ed){
+	for(ed=st+1; ed<w->ed && p[ed].label == p[st].label; ed+=1);
+	if(ed - st > w->max_bucket) continue;
+	for(i=st; i<ed && !(p[i].id & 1); i+=1);
+	if(i == ed) continue; //no prefix side
+	if(w->labels_size < (ed - st) * n){
+	    w->labels_size = (ed - st) * n;
+	    w->labels = realloc_harder(w->labels, sizeof *w->labels * w->labels_size);
+	}
+	for(i=st; i<ed; i+=1){
+	    postingLabels(w, p[i].id, w->labels + (i-st)*n);
+	}
+	for(i=st; i<ed; i+=1){
+	    if(p[i].id & 1) continue; //suffix side
+	    a = p[i].id >> (POS_BITS+1);
+	    pos = (p[i].id >> 1) & MAX_READ_LEN;
+	    for(j=st; j<ed; j+=1){
+		if(!(p[j].id & 1)) continue; //prefix side
+		b = p[j].id >> (POS_BITS+1);
+		if(a == b) continue;
+		if(minSharedLabel(w->labels + (i-st)*n, w->labels + (j-st)*n, n)
+		   != p[st].label) continue;
+		if(!verifyOverlap(w, a, b, pos, &e)) continue;
+		if(w->edges_used == w->edges_size){
+		    w->edges_size = w->edges_size ? w->edges_size << 1 : 1024;
+		    w->edges = realloc_harder(w->edges,
+					      sizeof *w->edges * w->edges_size);
+		}
+		w->edges[w->edges_used++] = e;
+	    }
+	}
+    }
+    return NULL;
+}
+
+static void runWorkers(OverlapWork* works, const int threads,
+		       void* (*worker)(void*)){
+    pthread_t tids[threads];
+    int t;
+    for(t=1; t<threads; t+=1){
+	pthread_create(tids+t, NULL, worker, works+t);
+    }
+    worker(works);
+    for(t=1; t<threads; t+=1){
+	pthread_join(tids[t], NULL);
+    }
+}
+
+//by (a, b), then the smallest distance, then the longest overlap first
+static int cmpEdge(const void* x, const void* y){
+    const Edge* e = x;
+    const Edge* f = y;
+    if(e->a != f->a) return e->a < f->a ? -1 : 1;
+    if(e->b != f->b) return e->b < f->b ? -1 : 1;
+    if(e->dist != f->dist) return e->dist - f->dist;
+    return f->overlap - e->overlap;
+}
+
+int main(int argc, char* argv[]){
+    int min_overlap = -1, max_d = 2, window = -1, max_bucket = 1000;
+    int partitions = 1, threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while((opt = getopt(argc, argv, "l:e:w:m:p:t:")) != -1){
+	switch(opt){
+	case 'l': min_overlap = atoi(optarg); break;
+	case 'e': max_d = atoi(optarg); break;
+	case 'w': window = atoi(optarg); break;
+	case 'm': max_bucket = atoi(optarg); break;
+	case 'p': partitions = atoi(optarg); break;
+	case 't': threads = atoi(optarg); break;
+	default: argc = 0;
+	}
+    }
+    if(argc - optind != 3 || (argv[optind+1][0] != 'o' && argv[optind+1][0] != 's')){
+	printf("usage: overlapGraph.out [-l min_overlap] [-e max_d] [-w window] "
+	       "[-m max_bucket] [-p partitions] [-t threads] "
+	       "n o(ptimal)|s(ample) reads\n");
+	return 1;
+    }
+    int n = atoi(argv[optind]);
+    int func = argv[optind+1][0] == 'o' ? BUCKET_FUNC_OPT12 : BUCKET_FUNC_SAMPLE;
+    if(n < 1 || n > BUCKET_MAX_N(func)){
+	fprintf(stderr, "n must be in [1, %d] for the bucketing function %c\n",
+		BUCKET_MAX_N(func), argv[optind+1][0]);
+	return 1;
+    }
+    if(min_overlap < 0) min_overlap = n << 1;
+    if(min_overlap < n) min_overlap = n;
+    if(threads < 1) threads = 1;
+    if(partitions < 1) partitions = 1;
+
+    ReadSet reads;
+    readReads(argv[optind+2], &reads);
+
+    OverlapWork* works = calloc_harder(threads, sizeof *works);
+    int t;
+    for(t=0; t<threads; t+=1){
+	works[t].reads = &reads;
+	works[t].n = n;
+	works[t].func = func;
+	works[t].min_overlap = min_overlap;
+	works[t].window = window;
+	works[t].max_d = max_d;
+	works[t].max_bucket = max_bucket;
+    }
+
+    //max_label may be SIZE_MAX (128-bit kmers), so the ranges are inclusive
+    size_t max_label = maxBucketLabel(func, n);
+    size_t part_size = max_label / partitions + 1;
+    Edge* edges = NULL;
+    size_t num_edges = 0, edges_size = 0;
+    size_t num, i, st, ed;
+    int part;
+    for(part=0; part<partitions; part+=1){
+	//collect the postings of this partition
+	for(t=0; t<threads; t+=1){
+	    works[t].label_st = part_size * part;
+	    works[t].label_ed = part == partitions-1 ? max_label : part_size * (part+1) - 1;
+	    works[t].st = reads.num / threads * t;
+	    works[t].ed = t == threads-1 ? reads.num : reads.num / threads * (t+1);
+	}
+	runWorkers(works, threads, bucketWorker);
+
+	for(t=0, num=0; t<threads; t+=1){
+	    num += works[t].out_used;
+	}
+	Posting* postings = malloc_harder(sizeof *postings * (num+1));
+	Posting* tmp = malloc_harder(sizeof *tmp * (num+1));
+	for(t=0, i=0; t<threads; t+=1){
+	    memcpy(postings+i, works[t].out, sizeof *postings * works[t].out_used);
+	    i += works[t].out_used;
+	}
+	radixSortPostingsParallel(postings, tmp, num, threads);
+	free(tmp);
+
+	//split into ranges of whole buckets
+	for(t=0, st=0; t<threads; t+=1){
+	    ed = t == threads-1 ? num : num / threads * (t+1);
+	    if(ed < st) ed = st;
+	    while(ed > st && ed < num && postings[ed].label == postings[ed-1].label){
+		ed += 1;
+	    }
+	    works[t].postings = postings;
+	    works[t].num_postings = num;
+	    works[t].st = st;
+	    works[t].ed = ed;
+	    st = ed;
+	}
+	runWorkers(works, threads, joinWorker);
+
+	for(t=0; t<threads; t+=1){
+	    if(num_edges + works[t].edges_used > edges_size){
+		edges_size = (num_edges + works[t].edges_used) << 1;
+		edges = realloc_harder(edges, sizeof *edges * edges_size);
+	    }
+	    memcpy(edges+num_edges, works[t].edges,
+		   sizeof *edges * works[t].edges_used);
+	    num_edges += works[t].edges_used;
+	}
+	free(postings);
+    }
+
+    //keep the best overlap of each pair of reads
+    qsort(edges, num_edges, sizeof *edges, cmpEdge);
+    for(i=0; i<num_edges; i+=1){
+	if(i > 0 && edges[i].a == edges[i-1].a && edges[i].b == edges[i-1].b){
+	    continue;
+	}
+	printf("L\t%s\t+\t%s\t+\t%dM\tNM:i:%d\n", reads.names[edges[i].a],
+	       reads.names[edges[i].b], edges[i].overlap, edges[i].dist);
+    }
+
+    for(t=0; t<threads; t+=1){
+	free(works[t].out);
+	free(works[t].edges);
+	free(works[t].kmers);
+	free(works[t].labels);
+    }
+    for(i=0; i<reads.num; i+=1){
+	free(reads.names[i]);
+    }
+    free(reads.names);
+    free(reads.offs);
+    free(reads.seqs);
+    free(edges);
+    free(works);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+  Input: n d o(ptimal)|s(ample) input [threads]
+
+  Find all pairs of n-mers in the input file (one n-mer per line) that
+  share a bucket and have edit distance at most d. Option o uses the
+  optimal (1,2)-sensitive bucketing function (assignBuckets), option s
+  uses the (1,3)-sensitive function labeled by the (1,1)-guaranteed
+  sample (assignSampleBuckets).
+
+  Each resulting pair is printed as "i j dist" where i < j are the line
+  numbers (starting from 0) of the n-mers. The timings, the throughput and
+  the ratio between candidates (distinct pairs sharing a bucket) and
+  reported pairs are written to standard error.
+*/
+
+#include "util.h"
+#include "SelfJoin.h"
+#include <string.h>
+
+int main(int argc, char* argv[]){
+    if(argc < 5 || argc > 6 || (argv[3][0] != 'o' && argv[3][0] != 's')){
+	printf("usage: selfJoin.out n d o(ptimal)|s(ample) input [threads]\n");
+	return 1;
+    }
+
+    int n = atoi(argv[1]);
+    int d = atoi(argv[2]);
+    int func = argv[3][0] == 'o' ? BUCKET_FUNC_OPT12 : BUCKET_FUNC_SAMPLE;
+    int threads = argc == 6 ? atoi(argv[5]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if(n < 1 || n > BUCKET_MAX_N(func)){
+	fprintf(stderr, "n must be in [1, %d] for the bucketing function %c\n",
+		BUCKET_MAX_N(func), func == BUCKET_FUNC_SAMPLE ? 's' : 'o');
+	return 1;
+    }
+
+    FILE* fin = fopen(argv[4], "r");
+    if(fin == NULL){
+	fprintf(stderr, "error opening file %s\n", argv[4]);
+	return 1;
+    }
+    size_t num = 0, size = 1024;
+    kmer* xs = malloc_harder(sizeof *xs * size);
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while((len = getline(&line, &line_size, fin)) > 0){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	if(len != n){
+	    fprintf(stderr, "error reading file %s: line %zu is not a %d-mer\n",
+		    argv[4], num+1, n);
+	    return 1;
+	}
+	if(num == size){
+	    size <<= 1;
+	    xs = realloc_harder(xs, sizeof *xs * size);
+	}
+	xs[num++] = encode(line, n);
+    }
+    free(line);
+    fclose(fin);
+
+    KMerPair* pairs;
+    SelfJoinStats stats;
+    size_t num_pairs = selfJoinKMers(xs, num, n, func, d, threads,
+				     &pairs, &stats);
+
+    size_t i;
+    for(i=0; i<num_pairs; i+=1){
+	printf("%zu %zu %d\n", pairs[i].a, pairs[i].b, pairs[i].dist);
+    }
+
+    double total = stats.bucket_time + stats.sort_time + stats.join_time;
+    fprintf(stderr, "n-mers\t%zu\npostings\t%zu\ncandidates\t%zu\npairs\t%zu\n"
+	    "candidates/pair\t%.3f\n", stats.num_kmers, stats.num_postings,
+	    stats.candidates, stats.pairs,
+	    stats.pairs ? (double) stats.candidates / stats.pairs : 0.0);
+    fprintf(stderr, "threads\t%d\nbucket(s)\t%.3f\nsort(s)\t%.3f\njoin(s)\t%.3f\n"
+	    "n-mers/s\t%.3e\ncandidates/s\t%.3e\n", threads, stats.bucket_time,
+	    stats.sort_time, stats.join_time, num / total,
+	    stats.join_time > 0 ? stats.candidates / stats.join_time : 0.0);
+
+    free(pairs);
+    free(xs);
+    return 0;
+}
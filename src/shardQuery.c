@@ -0,0 +1,95 @@
+/*
+  Input: [-t threads] map
+
+  Query an index split into shards by bucketIndex.out shard. One server
+  process is started for each shard (with the given number of worker
+  threads, default 1) and connected by pipes, so several shards can be
+  tried on one machine without any network service.
+
+  Each line of standard input is a sequence; all the bucket labels of its
+  n-mers (except those with a character other than A, C, G, T, in either
+  case) are routed to their shards and the answers gathered. For each
+  bucket, in the order of the n-mers, the bucket label and the ids in
+  that bucket are printed as by bucketIndex.out lookup. The number of
+  queries and their throughput are written to standard error.
+*/
+
+#include "util.h"
+#include "bucketing.h"
+#include "codec.h"
+#include "ShardedIndex.h"
+#include <string.h>
+#include <time.h>
+
+int main(int argc, char* argv[]){
+    int threads = 1, opt;
+    while((opt = getopt(argc, argv, "t:")) != -1){
+	switch(opt){
+	case 't': threads = atoi(optarg); break;
+	default: argc = 0;
+	}
+    }
+    if(argc - optind != 1){
+	printf("usage: shardQuery.out [-t threads] map\n");
+	return 1;
+    }
+
+    ShardClient c;
+    ShardClientStart(&c, argv[optind], threads);
+    int n = c.map.n;
+
+    char* line = NULL;
+    size_t line_size = 0, labels_size = 0, ids_size = 0, num, i, k;
+    ssize_t len;
+    size_t *labels = NULL, *offsets = NULL, *ids = NULL;
+    size_t num_queries = 0, num_labels = 0, num_ids = 0, st, ed, xs_size = 0;
+    kmer* xs = NULL;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    while((len = getline(&line, &line_size, stdin)) > 0){
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) len -= 1;
+	if(len < n) continue;
+	if(labels_size < (size_t) (len - n + 1) * n){
+	    labels_size = (len - n + 1) * n;
+	    labels = realloc_harder(labels, sizeof *labels * labels_size);
+	    offsets = realloc_harder(offsets, sizeof *offsets * (labels_size+1));
+	}
+	if(xs_size < (size_t) len){
+	    xs_size = len;
+	    xs = realloc_harder(xs, sizeof *xs * xs_size);
+	}
+	num = 0;
+	for(st=0; st+n<=(size_t) len; st=ed+1){
+	    ed = st + encodeKMers(line+st, len-st, n, xs+st);
+	    for(i=st; i+n<=ed; i+=1){
+		num += assignBucketsWith64(c.map.func, xs[i], n, labels, num);
+	    }
+	}
+
+	num_ids += ShardClientLookup(&c, labels, num, &ids, &ids_size, offsets);
+	for(k=0; k<num; k+=1){
+	    printf("%zu:", labels[k]);
+	    for(i=offsets[k]; i<offsets[k+1]; i+=1){
+		printf(" %zu", ids[i]);
+	    }
+	    printf("\n");
+	}
+	num_queries += 1;
+	num_labels += num;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    fprintf(stderr, "%zu queries, %zu labels, %zu ids on %d shards in %.3fs "
+	    "(%.0f labels/s)\n", num_queries, num_labels, num_ids,
+	    c.map.num_shards, secs, secs > 0 ? num_labels / secs : 0);
+
+    ShardClientStop(&c);
+    free(line);
+    free(labels);
+    free(offsets);
+    free(ids);
+    free(xs);
+    return 0;
+}